@@ -0,0 +1,57 @@
+#ifndef CONSOLE_INPUT_H
+#define CONSOLE_INPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <Arduino.h>
+
+// longest line the console takes, longer input rings the bell
+#define CONSOLE_LINE_MAX 160
+// lines kept for recall with the up and down keys
+#define CONSOLE_HISTORY 8
+
+// Reads a line from the console without blocking: poll() takes whatever
+// has arrived and returns true once Enter was pressed, so the caller can
+// service the modem in between. Typed characters are echoed; backspace
+// deletes one, Ctrl-U the whole line, and the up and down arrows recall
+// earlier lines when the line is one to remember. hide() and show()
+// move the line out of the way for other output, and bring it back.
+class ConsoleInput {
+ public:
+  void begin(Stream &console);
+
+  // a new line of at most max characters after prompt (nullptr if the
+  // caller printed it)
+  void start(const char *prompt, size_t max = CONSOLE_LINE_MAX, bool remember = false);
+  bool poll();
+  const char *line() const { return buffer; }
+  size_t length() const { return len; }
+
+  void hide();
+  void show();
+
+ private:
+  void key(char c);
+  void erase();
+  void replace(const char *text);
+  void recall(int step);
+  void remember();
+
+  Stream *console = nullptr;
+  const char *prompt = nullptr;
+  size_t max = CONSOLE_LINE_MAX;
+  bool active = false;
+  bool done = false;
+  bool keep = false;
+  bool after_cr = false; // a LF straight after CR ends no second line
+  uint8_t escape = 0;    // bytes of an arrow key's escape sequence seen
+  char buffer[CONSOLE_LINE_MAX + 1] = {};
+  size_t len = 0;
+
+  char history[CONSOLE_HISTORY][CONSOLE_LINE_MAX + 1];
+  uint8_t history_count = 0;
+  uint8_t history_next = 0; // where the next line goes
+  uint8_t browsing = 0;     // lines back from the newest, 0 for none
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef HTTP_TRANSFER_H
+#define HTTP_TRANSFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <Arduino.h>
+#include <HardwareSerial.h>
+
+// body bytes asked for with each AT+HTTPREAD, two buffers of it are kept
+#define HTTP_CHUNK_SIZE 1024
+
+struct HttpResult {
+  uint16_t status;   // HTTP status code, 0 if there was no response
+  uint32_t length;   // body length the modem reported
+  uint32_t received; // body bytes passed on
+  uint32_t ms;       // from the request to the last body byte
+  uint32_t body_ms;  // reading the body
+};
+
+// Bulk HTTP transfers through the SIM7000's HTTP application, for config
+// and firmware blobs. The driver's HTTP_GET_start() keeps the body length
+// in 16 bits and the console copied it a byte at a time; here the body is
+// fetched in ranged AT+HTTPREAD=<offset>,<size> reads into one of two
+// buffers while the other one drains to the console as it has room, so
+// the modem and the console run at the same time and the body can be as
+// large as the modem holds. Talks to the modem UART directly, so the
+// driver must not be in the middle of a command.
+class HttpTransfer {
+ public:
+  void begin(Stream &modem);
+
+  bool get(const char *url, HardwareSerial &out, HttpResult &result);
+  bool post(const char *url, const char *content_type, const uint8_t *data, size_t len, HardwareSerial &out,
+            HttpResult &result);
+
+ private:
+  bool start(const char *url);
+  bool action(uint8_t method, HttpResult &result);
+  bool readBody(HardwareSerial &out, HttpResult &result);
+  bool readChunk(uint32_t offset, size_t size, uint8_t *buffer, size_t &n, HardwareSerial &out);
+  void send(const char *cmd);
+  bool command(const char *cmd, const char *expect, uint32_t timeout_ms, HardwareSerial *out = nullptr);
+  bool readLine(char *line, size_t size, uint32_t timeout_ms, HardwareSerial *out = nullptr);
+  void feed(HardwareSerial &out);
+  void flush(HardwareSerial &out);
+
+  Stream *modem = nullptr;
+  uint8_t buffers[2][HTTP_CHUNK_SIZE];
+  // the previous chunk, going out while the next one comes in
+  const uint8_t *pending = nullptr;
+  size_t pending_len = 0;
+};
+
+void printHttpResult(const HttpResult &result);
+
+#endif
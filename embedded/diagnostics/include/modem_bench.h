@@ -0,0 +1,82 @@
+#ifndef MODEM_BENCH_H
+#define MODEM_BENCH_H
+
+#include <stdint.h>
+#include "Adafruit_FONA.h"
+
+// latencies kept per operation, and so the most iterations of one run
+#define BENCH_MAX_RUNS 50
+
+enum BenchOp {
+  BENCH_GPS_STATUS,  // 's': AT+CGNSINF fix status
+  BENCH_GPS_FIX,     // 'f': GNSS off and on again, time to a fix
+  BENCH_GPRS_ATTACH, // 'a': data off and on again
+  BENCH_MQTT,        // 'm': broker settings, connect, one QoS 1 publish, disconnect
+  BENCH_HTTP_GET,    // 'h': request and read the whole body
+  BENCH_OPS
+};
+
+struct BenchConfig {
+  const char *mqtt_server;
+  uint16_t mqtt_port;
+  const char *mqtt_username; // nullptr for none
+  const char *mqtt_password;
+  const char *mqtt_topic;
+  const char *http_url;      // without the http://
+  uint32_t fix_timeout;      // ms
+  uint32_t body_timeout;     // ms without a byte of the HTTP body
+};
+
+// Latencies of one operation over a run. Only successful attempts count
+// towards the percentiles, failures are counted on their own.
+class LatencyStats {
+ public:
+  void reset();
+  void add(uint32_t ms, bool ok);
+
+  uint16_t runs() const { return attempts; }
+  uint16_t failed() const { return failures; }
+  uint16_t succeeded() const { return count; }
+  // nearest rank over the successful attempts, 0 if there are none
+  uint32_t percentile(uint8_t p) const;
+  uint32_t min() const { return percentile(0); }
+  uint32_t max() const { return percentile(100); }
+
+ private:
+  uint32_t samples[BENCH_MAX_RUNS];
+  uint16_t count = 0;
+  uint16_t attempts = 0, failures = 0;
+};
+
+// Runs a sequence of modem operations a number of times and times each
+// one, to size the production timeouts and schedules for a SIM and site.
+// The sequence is a string of op letters run in order every iteration,
+// e.g. "sah"; the results print as a table or as CSV for a spreadsheet.
+// Uses the blocking driver, so nothing else may talk to the modem
+// meanwhile; a key press on the console stops the run after the current
+// operation.
+class ModemBench {
+ public:
+  void begin(Adafruit_FONA_LTE &fona, const BenchConfig &config);
+
+  // returns false if the sequence has no known op letter
+  bool run(const char *sequence, uint16_t iterations);
+  void printTable();
+  void printCsv();
+
+ private:
+  bool runOp(BenchOp op);
+  bool gpsFix();
+  bool mqttPublish();
+  bool httpGet();
+
+  Adafruit_FONA_LTE *fona = nullptr;
+  BenchConfig config = {};
+  LatencyStats stats[BENCH_OPS];
+};
+
+// the op for a sequence letter, BENCH_OPS if there is none
+BenchOp benchOp(char c);
+const char *benchOpName(BenchOp op);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef SERIAL_TUBE_H
+#define SERIAL_TUBE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <Arduino.h>
+#include <HardwareSerial.h>
+#include <SPIFFS.h>
+
+// bytes moved in one go each way
+#define TUBE_BLOCK 256
+// transcript bytes gathered before they go to flash
+#define TUBE_RECORD_BUFFER 1024
+
+struct TubeConfig {
+  size_t host_rx_size;  // console RX buffer, to see it overrun
+  size_t modem_rx_size; // modem UART RX buffer
+  bool host_xonxoff;    // hold the host off with XOFF/XON
+  int8_t modem_rx_pin, modem_tx_pin;
+  int8_t modem_cts_pin, modem_rts_pin; // -1 for no RTS/CTS to the modem
+};
+
+struct TubeStats {
+  uint32_t ms;
+  uint32_t to_modem, to_host;             // bytes
+  uint16_t host_overruns, modem_overruns; // times an RX buffer filled up
+  uint16_t host_holds;                    // XOFFs sent to the host
+  uint32_t recorded;                      // transcript bytes on flash
+  bool record_full;                       // flash ran out while recording
+};
+
+// Bridges the console and the modem UART so AT commands can be typed by
+// hand or a host tool can drive the modem. Bytes move in blocks, each way
+// only as many as the other side has room for, so nothing is lost in the
+// tube itself; what can overrun are the RX buffers behind it, which the
+// stats count. The host can be held off with XON/XOFF, the modem with
+// RTS/CTS when those lines are wired. "~." at the start of a line from
+// the host leaves the tube, "~~" sends one '~'.
+//
+// Optionally the traffic both ways is recorded to flash with timestamps.
+// printScript() turns a recording into a modem script for the native
+// simulation (embedded/main/sim), so a session on a real modem can be
+// replayed against the firmware on the host.
+class SerialTube {
+ public:
+  void begin(HardwareSerial &host, HardwareSerial &modem, const TubeConfig &config);
+
+  // until the host sends the escape; record_path nullptr for no recording
+  void run(const char *record_path, TubeStats &stats);
+  // the recording as "<command> | <latency> | <reply>" and "@<ms> | <urc>"
+  // lines, false if there is none
+  bool printScript(const char *record_path, Print &out);
+
+ private:
+  void startFlowControl();
+  void stopFlowControl();
+  void modemCommand(const char *cmd);
+  bool pumpHost(TubeStats &stats);
+  void pumpModem(TubeStats &stats);
+  size_t unescape(const uint8_t *in, size_t n, uint8_t *out, bool &leave);
+  void record(uint8_t direction, const uint8_t *data, size_t n, TubeStats &stats);
+  void flushRecord(TubeStats &stats);
+
+  HardwareSerial *host = nullptr;
+  HardwareSerial *modem = nullptr;
+  TubeConfig config = {};
+  uint32_t started = 0;
+  bool line_start = true;
+  bool tilde = false; // a '~' at the start of a line, held back
+  bool host_held = false;
+  bool host_full = false, modem_full = false;
+  File file;
+  bool recording = false;
+  uint8_t record_buffer[TUBE_RECORD_BUFFER];
+  size_t record_len = 0;
+};
+
+void printTubeStats(const TubeStats &stats);
+
+#endif
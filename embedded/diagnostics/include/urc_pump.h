@@ -0,0 +1,37 @@
+#ifndef URC_PUMP_H
+#define URC_PUMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <Arduino.h>
+
+// longest modem line kept, the rest of a longer one is dropped
+#define URC_LINE_MAX 128
+
+// Collects what the modem sends on its own while the console waits for
+// input, a line at a time, and stamps each line with the time its first
+// byte came in. Must only run between driver commands, or it would take
+// their replies.
+class UrcPump {
+ public:
+  void begin(Stream &modem);
+
+  // takes what the modem has sent, true once that completed a line
+  bool poll();
+  const char *line() const { return text; }
+  uint32_t at() const { return ms; }
+  uint32_t count() const { return lines; }
+  // "[<seconds since boot>] <line>"
+  void print(Print &out) const;
+
+ private:
+  Stream *modem = nullptr;
+  char partial[URC_LINE_MAX + 1];
+  size_t partial_len = 0;
+  uint32_t partial_ms = 0;
+  char text[URC_LINE_MAX + 1] = {};
+  uint32_t ms = 0;
+  uint32_t lines = 0;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "console_input.h"
+
+#include <string.h>
+
+namespace {
+
+const char ctrl_u = 0x15;
+const char esc = 0x1b;
+const char bell = 0x07;
+
+}
+
+void ConsoleInput::begin(Stream &c) {
+  console = &c;
+}
+
+void ConsoleInput::start(const char *p, size_t m, bool r) {
+  prompt = p;
+  max = m < CONSOLE_LINE_MAX ? m : CONSOLE_LINE_MAX;
+  keep = r;
+  len = 0;
+  buffer[0] = 0;
+  escape = 0;
+  browsing = 0;
+  done = false;
+  active = true;
+  if (prompt) console->print(prompt);
+}
+
+bool ConsoleInput::poll() {
+  if (!active) return done;
+  while (!done && console->available()) key(console->read());
+  if (done) active = false;
+  return done;
+}
+
+void ConsoleInput::key(char c) {
+  if (escape == 1) {
+    escape = c == '[' ? 2 : 0;
+    return;
+  }
+  if (escape == 2) {
+    escape = 0;
+    if (c == 'A') recall(1);
+    else if (c == 'B') recall(-1);
+    return;
+  }
+  if (c == '\n' && after_cr) {
+    after_cr = false;
+    return;
+  }
+  after_cr = c == '\r';
+  switch (c) {
+    case '\r':
+    case '\n':
+      console->println();
+      if (keep && len > 0) remember();
+      done = true;
+      break;
+    case '\b':
+    case 0x7f:
+      if (len == 0) break;
+      buffer[--len] = 0;
+      console->print(F("\b \b"));
+      break;
+    case ctrl_u:
+      erase();
+      break;
+    case esc:
+      escape = 1;
+      break;
+    default:
+      if (c < ' ') break;
+      if (len == max) {
+        console->write(bell);
+        break;
+      }
+      buffer[len++] = c;
+      buffer[len] = 0;
+      console->write(c);
+      break;
+  }
+}
+
+void ConsoleInput::erase() {
+  while (len > 0) {
+    buffer[--len] = 0;
+    console->print(F("\b \b"));
+  }
+}
+
+void ConsoleInput::replace(const char *text) {
+  erase();
+  strncpy(buffer, text, max);
+  buffer[max] = 0;
+  len = strlen(buffer);
+  console->print(buffer);
+}
+
+void ConsoleInput::recall(int step) {
+  if (!keep) return;
+  int n = browsing + step;
+  if (n < 0 || n > history_count) return;
+  browsing = n;
+  if (browsing == 0) {
+    // past the newest, back to an empty line
+    replace("");
+    return;
+  }
+  replace(history[(history_next + CONSOLE_HISTORY - browsing) % CONSOLE_HISTORY]);
+}
+
+void ConsoleInput::remember() {
+  // the same command again only takes one entry
+  if (history_count > 0 && strcmp(history[(history_next + CONSOLE_HISTORY - 1) % CONSOLE_HISTORY], buffer) == 0)
+    return;
+  memcpy(history[history_next], buffer, len + 1);
+  history_next = (history_next + 1) % CONSOLE_HISTORY;
+  if (history_count < CONSOLE_HISTORY) history_count++;
+}
+
+void ConsoleInput::hide() {
+  if (!active) return;
+  console->println();
+}
+
+void ConsoleInput::show() {
+  if (!active) return;
+  if (prompt) console->print(prompt);
+  console->print(buffer);
+}
@@ -0,0 +1,215 @@
+#include "http_transfer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+const uint32_t command_timeout = 1000; // ms
+// the request itself, including DNS and the TCP connect
+const uint32_t action_timeout = 60000; // ms
+// one ranged read, from the command to its OK
+const uint32_t chunk_timeout = 5000;   // ms
+const uint32_t upload_timeout = 10000; // ms, for AT+HTTPDATA
+
+const uint8_t http_get = 0;
+const uint8_t http_post = 1;
+
+}
+
+void HttpTransfer::begin(Stream &m) {
+  modem = &m;
+}
+
+bool HttpTransfer::get(const char *url, HardwareSerial &out, HttpResult &result) {
+  memset(&result, 0, sizeof(result));
+  uint32_t started = millis();
+  bool ok = start(url) && action(http_get, result) && readBody(out, result);
+  result.ms = millis() - started;
+  command("AT+HTTPTERM", "OK", command_timeout);
+  return ok;
+}
+
+bool HttpTransfer::post(const char *url, const char *content_type, const uint8_t *data, size_t len,
+                        HardwareSerial &out, HttpResult &result) {
+  memset(&result, 0, sizeof(result));
+  uint32_t started = millis();
+  char cmd[64];
+  bool ok = start(url);
+  if (ok) {
+    snprintf(cmd, sizeof(cmd), "AT+HTTPPARA=\"CONTENT\",\"%s\"", content_type);
+    ok = command(cmd, "OK", command_timeout);
+  }
+  if (ok) {
+    // the body goes in raw once the modem asks for it
+    snprintf(cmd, sizeof(cmd), "AT+HTTPDATA=%u,%lu", (unsigned)len, (unsigned long)upload_timeout);
+    ok = command(cmd, "DOWNLOAD", command_timeout);
+  }
+  if (ok) {
+    modem->write(data, len);
+    char line[32];
+    ok = readLine(line, sizeof(line), upload_timeout) && strcmp(line, "OK") == 0;
+  }
+  ok = ok && action(http_post, result) && readBody(out, result);
+  result.ms = millis() - started;
+  command("AT+HTTPTERM", "OK", command_timeout);
+  return ok;
+}
+
+bool HttpTransfer::start(const char *url) {
+  // a session left over from an aborted transfer would refuse HTTPINIT
+  command("AT+HTTPTERM", "OK", command_timeout);
+  if (!command("AT+HTTPINIT", "OK", command_timeout)) return false;
+  if (!command("AT+HTTPPARA=\"CID\",1", "OK", command_timeout)) return false;
+  char cmd[128];
+  snprintf(cmd, sizeof(cmd), "AT+HTTPPARA=\"URL\",\"%s\"", url);
+  return command(cmd, "OK", command_timeout);
+}
+
+bool HttpTransfer::action(uint8_t method, HttpResult &result) {
+  char cmd[20];
+  snprintf(cmd, sizeof(cmd), "AT+HTTPACTION=%u", method);
+  if (!command(cmd, "OK", command_timeout)) return false;
+  // "+HTTPACTION: <method>,<status>,<length>", the length is not cut to 16 bits
+  char line[48];
+  uint32_t start = millis();
+  while (millis() - start < action_timeout) {
+    if (!readLine(line, sizeof(line), action_timeout - (millis() - start))) return false;
+    if (strncmp(line, "+HTTPACTION:", 12) != 0) continue;
+    char *p = strchr(line, ',');
+    if (!p) return false;
+    result.status = (uint16_t)strtoul(p + 1, &p, 10);
+    if (*p == ',') result.length = strtoul(p + 1, NULL, 10);
+    return true;
+  }
+  return false;
+}
+
+bool HttpTransfer::readBody(HardwareSerial &out, HttpResult &result) {
+  uint32_t started = millis();
+  pending = nullptr;
+  pending_len = 0;
+  int current = 0;
+  bool ok = true;
+  while (result.received < result.length) {
+    uint32_t left = result.length - result.received;
+    size_t size = left < HTTP_CHUNK_SIZE ? left : HTTP_CHUNK_SIZE;
+    size_t n = 0;
+    // the previous chunk keeps going out meanwhile
+    if (!readChunk(result.received, size, buffers[current], n, out) || n == 0) {
+      ok = false;
+      break;
+    }
+    flush(out);
+    pending = buffers[current];
+    pending_len = n;
+    result.received += n;
+    current ^= 1;
+  }
+  flush(out);
+  result.body_ms = millis() - started;
+  return ok;
+}
+
+bool HttpTransfer::readChunk(uint32_t offset, size_t size, uint8_t *buffer, size_t &n, HardwareSerial &out) {
+  char line[48];
+  snprintf(line, sizeof(line), "AT+HTTPREAD=%lu,%u", (unsigned long)offset, (unsigned)size);
+  send(line);
+  // "+HTTPREAD: <n>", then n bytes of body, then OK
+  uint32_t start = millis();
+  do {
+    if (!readLine(line, sizeof(line), chunk_timeout, &out)) return false;
+    if (strcmp(line, "ERROR") == 0) return false;
+  } while (strncmp(line, "+HTTPREAD:", 10) != 0);
+  n = strtoul(line + 10, NULL, 10);
+  if (n > size) return false;
+  size_t got = 0;
+  while (got < n) {
+    if (millis() - start > chunk_timeout) return false;
+    int avail = modem->available();
+    if (avail <= 0) {
+      feed(out);
+      continue;
+    }
+    if ((size_t)avail > n - got) avail = n - got;
+    got += modem->readBytes((char *)buffer + got, avail);
+  }
+  do {
+    if (!readLine(line, sizeof(line), chunk_timeout, &out)) return false;
+  } while (strcmp(line, "OK") != 0);
+  return true;
+}
+
+void HttpTransfer::send(const char *cmd) {
+  while (modem->available()) modem->read();
+  modem->print(cmd);
+  modem->print('\r');
+}
+
+bool HttpTransfer::command(const char *cmd, const char *expect, uint32_t timeout_ms, HardwareSerial *out) {
+  send(cmd);
+  char line[64];
+  size_t len = strlen(expect);
+  uint32_t start = millis();
+  while (millis() - start < timeout_ms) {
+    if (!readLine(line, sizeof(line), timeout_ms - (millis() - start), out)) return false;
+    if (strncmp(line, expect, len) == 0) return true;
+    if (strcmp(line, "ERROR") == 0) return false;
+  }
+  return false;
+}
+
+bool HttpTransfer::readLine(char *line, size_t size, uint32_t timeout_ms, HardwareSerial *out) {
+  // the next non-empty line, cut to size
+  size_t len = 0;
+  uint32_t start = millis();
+  while (millis() - start < timeout_ms) {
+    if (!modem->available()) {
+      if (out) feed(*out);
+      continue;
+    }
+    char c = modem->read();
+    if (c == '\r') continue;
+    if (c == '\n') {
+      if (len == 0) continue;
+      line[len] = 0;
+      return true;
+    }
+    // HTTPDATA's prompt has no line ending
+    if (len + 1 < size) line[len++] = c;
+    if (len == 8 && strncmp(line, "DOWNLOAD", 8) == 0) {
+      line[len] = 0;
+      return true;
+    }
+  }
+  return false;
+}
+
+void HttpTransfer::feed(HardwareSerial &out) {
+  if (pending_len == 0) return;
+  int room = out.availableForWrite();
+  if (room <= 0) return;
+  size_t n = (size_t)room < pending_len ? room : pending_len;
+  out.write(pending, n);
+  pending += n;
+  pending_len -= n;
+}
+
+void HttpTransfer::flush(HardwareSerial &out) {
+  if (pending_len > 0) out.write(pending, pending_len);
+  pending_len = 0;
+}
+
+void printHttpResult(const HttpResult &result) {
+  Serial.print(F("Status ")); Serial.print(result.status);
+  Serial.print(F(", ")); Serial.print(result.received);
+  Serial.print(F(" of ")); Serial.print(result.length);
+  Serial.print(F(" bytes in ")); Serial.print(result.ms); Serial.print(F(" ms"));
+  if (result.body_ms > 0) {
+    // the body alone, the request's own latency would hide the transfer rate
+    Serial.print(F(", body at ")); Serial.print((uint32_t)((uint64_t)result.received * 1000 / result.body_ms));
+    Serial.print(F(" bytes/s"));
+  }
+  Serial.println();
+}
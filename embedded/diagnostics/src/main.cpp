@@ -26,13 +26,29 @@
  ****************************************************/
 
 #include <Wire.h>
+#include <SPIFFS.h>
 #include "Adafruit_FONA.h"
+#include "modem_bench.h"
+#include "modem_link.h"
+#include "http_transfer.h"
+#include "serial_tube.h"
+#include "console_input.h"
+#include "urc_pump.h"
 
 // For SIM7000 shield with ESP32
 #define FONA_PWRKEY 18
 #define FONA_RST 5
 #define FONA_TX 16 // ESP32 hardware serial RX2 (GPIO16)
 #define FONA_RX 17 // ESP32 hardware serial TX2 (GPIO17)
+// fastest modem UART rate to try, see ModemLink
+#define FONA_MAX_BAUD 921600
+// room for a whole HTTP body chunk, see HttpTransfer
+#define FONA_RX_BUFFER (2 * HTTP_CHUNK_SIZE)
+// The shield's CTS and RTS for hardware flow control in the serial tube,
+// -1 while they are not wired
+#define FONA_CTS -1
+#define FONA_RTS -1
+#define CONSOLE_RX_BUFFER 1024
 
 // For ESP32 hardware serial
 #include <HardwareSerial.h>
@@ -41,12 +57,43 @@ HardwareSerial fonaSS(1);
 // Use this one for LTE CAT-M/NB-IoT modules (like SIM7000)
 // Notice how we don't include the reset pin because it's reserved for emergencies on the LTE module!
 Adafruit_FONA_LTE fona = Adafruit_FONA_LTE();
+ModemLink modemLink;
+HttpTransfer http;
+
+// The console takes input a line at a time while the modem's unsolicited
+// output is printed as it comes in
+ConsoleInput console;
+UrcPump urcs;
+const char prompt[] = "FONA> ";
 
-uint8_t readline(char *buff, uint8_t maxbuff, uint16_t timeout = 0);
 uint8_t type;
 char replybuffer[255]; // this is a large buffer for replies
 char imei[16] = {0}; // MUST use a 16 character buffer for IMEI!
 
+// What the benchmark ('B') talks to, a public broker and any small page
+const BenchConfig bench_config = {
+  "test.mosquitto.org", // mqtt_server
+  1883,                 // mqtt_port
+  nullptr,              // mqtt_username
+  nullptr,              // mqtt_password
+  "biketracker/bench",  // mqtt_topic
+  "dweet.io/get/latest/dweet/for/sim7500test123", // http_url
+  120000,               // fix_timeout (ms)
+  10000,                // body_timeout (ms)
+};
+ModemBench bench;
+
+// The serial tube ('S'), the host is held off with XON/XOFF
+TubeConfig tube_config = {
+  CONSOLE_RX_BUFFER,  // host_rx_size
+  FONA_RX_BUFFER,     // modem_rx_size
+  true,               // host_xonxoff
+  FONA_TX, FONA_RX,   // modem_rx_pin, modem_tx_pin
+  FONA_CTS, FONA_RTS, // modem_cts_pin, modem_rts_pin
+};
+SerialTube tube;
+const char tube_record_path[] = "/tube.bin";
+
 // Power on the module
 void powerOn() {
   digitalWrite(FONA_PWRKEY, LOW);
@@ -100,7 +147,11 @@ void printMenu(void) {
   }
   Serial.println(F("[E] Raw NMEA out (SIM808)"));
 
-  Serial.println(F("[S] Create serial passthru tunnel"));
+  // Benchmark
+  Serial.println(F("[B] Benchmark modem operations (latency and failure rate)"));
+
+  Serial.println(F("[S] Create serial passthru tunnel (\"~.\" leaves it)"));
+  Serial.println(F("Type a command and Enter, up and down recall earlier ones"));
   Serial.println(F("-------------------------------------"));
   Serial.println(F(""));
 }
@@ -117,6 +168,7 @@ void setup() {
   // This amount of time depends on the specific module that's used
   powerOn(); // See function definition at the very end of the sketch
 
+  Serial.setRxBufferSize(CONSOLE_RX_BUFFER);
   Serial.begin(115200);
   Serial.println(F("ESP32 Basic Test"));
   Serial.println(F("Initializing....(May take several seconds)"));
@@ -126,14 +178,11 @@ void setup() {
   // Press reset button if the module is still turning on and the board doesn't find it.
   // When the module is on it should communicate right after pressing reset
   
-  // Start at default SIM7000 shield baud rate
-  fonaSS.begin(115200, SERIAL_8N1, FONA_TX, FONA_RX); // baud rate, protocol, ESP32 RX pin, ESP32 TX pin
-
-  Serial.println(F("Configuring to 9600 baud"));
-  fonaSS.println("AT+IPR=9600"); // Set baud rate
-  delay(100); // Short pause to let the command run
-  fonaSS.begin(9600, SERIAL_8N1, FONA_TX, FONA_RX); // Switch to 9600
-  if (! fona.begin(fonaSS)) {
+  // The negotiated rate is remembered on SPIFFS
+  if (!SPIFFS.begin(true)) Serial.println(F("Could not mount SPIFFS"));
+  fonaSS.setRxBufferSize(FONA_RX_BUFFER);
+  // Starts at the default SIM7000 shield baud rate and steps up from there
+  if (!modemLink.begin(fonaSS, FONA_TX, FONA_RX, FONA_MAX_BAUD, false) || ! fona.begin(fonaSS)) {
     Serial.println(F("Couldn't find FONA"));
     while (1); // Don't proceed if it couldn't find the device
   }
@@ -195,7 +244,14 @@ void setup() {
   fona.setNetLED(false); // Disable network status LED
   */
 
+  bench.begin(fona, bench_config);
+  http.begin(fonaSS);
+  tube.begin(Serial, fonaSS, tube_config);
+  console.begin(Serial);
+  urcs.begin(fonaSS);
+
   printMenu();
+  console.start(prompt, CONSOLE_LINE_MAX, true);
 }
 
 void flushSerial() {
@@ -203,76 +259,44 @@ void flushSerial() {
     Serial.read();
 }
 
-char readBlocking() {
-  while (!Serial.available());
-  return Serial.read();
-}
-uint16_t readnumber() {
-  uint16_t x = 0;
-  char c;
-  while (! isdigit(c = readBlocking())) {
-    //Serial.print(c);
-  }
-  Serial.print(c);
-  x = c - '0';
-  while (isdigit(c = readBlocking())) {
-    Serial.print(c);
-    x *= 10;
-    x += c - '0';
+// Prints what the modem sent on its own, above the line being typed
+void pumpUrcs() {
+  while (urcs.poll()) {
+    console.hide();
+    urcs.print(Serial);
+    console.show();
   }
-  return x;
 }
 
-uint8_t readline(char *buff, uint8_t maxbuff, uint16_t timeout) {
-  uint16_t buffidx = 0;
-  boolean timeoutvalid = true;
-  if (timeout == 0) timeoutvalid = false;
-
-  while (true) {
-    if (buffidx > maxbuff) {
-      //Serial.println(F("SPACE"));
-      break;
-    }
-
-    while (Serial.available()) {
-      char c =  Serial.read();
-
-      //Serial.print(c, HEX); Serial.print("#"); Serial.println(c);
+char readBlocking() {
+  int c;
+  while ((c = Serial.read()) < 0) pumpUrcs();
+  return c;
+}
 
-      if (c == '\r') continue;
-      if (c == 0xA) {
-        if (buffidx == 0)   // the first 0x0A is ignored
-          continue;
+// at most maxbuff characters, buff holds one more
+uint8_t readline(char *buff, uint8_t maxbuff) {
+  console.start(nullptr, maxbuff);
+  while (!console.poll()) pumpUrcs();
+  memcpy(buff, console.line(), console.length() + 1);
+  return console.length();
+}
 
-        timeout = 0;         // the second 0x0A is the end of the line
-        timeoutvalid = true;
-        break;
-      }
-      buff[buffidx] = c;
-      buffidx++;
-    }
-
-    if (timeoutvalid && timeout == 0) {
-      //Serial.println(F("TIMEOUT"));
-      break;
-    }
-    delay(1);
-  }
-  buff[buffidx] = 0;  // null term
-  return buffidx;
+uint16_t readnumber() {
+  char digits[6];
+  readline(digits, 5);
+  return strtoul(digits, NULL, 10);
 }
 
 void loop() {
-  Serial.print(F("FONA> "));
-  while (! Serial.available() ) {
-    if (fona.available()) {
-      Serial.write(fona.read());
-    }
+  pumpUrcs();
+  if (!console.poll()) return;
+  char command = console.line()[0];
+  if (!command) {
+    console.start(prompt, CONSOLE_LINE_MAX, true);
+    return;
   }
 
-  char command = Serial.read();
-  Serial.println(command);
-
 
   switch (command) {
     case '?': {
@@ -316,8 +340,7 @@ void loop() {
         char PIN[5];
         flushSerial();
         Serial.println(F("Enter 4-digit PIN"));
-        readline(PIN, 3);
-        Serial.println(PIN);
+        readline(PIN, 4);
         Serial.print(F("Unlocking SIM card: "));
         if (! fona.unlockSIM(PIN)) {
           Serial.println(F("Failed"));
@@ -389,7 +412,7 @@ void loop() {
         flushSerial();
         Serial.print(F("Read #"));
         uint8_t smsn = readnumber();
-        Serial.print(F("\n\rReading SMS #")); Serial.println(smsn);
+        Serial.print(F("Reading SMS #")); Serial.println(smsn);
 
         // Retrieve SMS sender address/phone number.
         if (! fona.getSMSSender(smsn, replybuffer, 250)) {
@@ -452,7 +475,7 @@ void loop() {
         Serial.print(F("Delete #"));
         uint8_t smsn = readnumber();
 
-        Serial.print(F("\n\rDeleting SMS #")); Serial.println(smsn);
+        Serial.print(F("Deleting SMS #")); Serial.println(smsn);
         if (fona.deleteSMS(smsn)) {
           Serial.println(F("OK!"));
         } else {
@@ -467,10 +490,8 @@ void loop() {
         flushSerial();
         Serial.print(F("Send to #"));
         readline(sendto, 20);
-        Serial.println(sendto);
         Serial.print(F("Type out one-line message (140 char): "));
         readline(message, 140);
-        Serial.println(message);
         if (!fona.sendSMS(sendto, message)) {
           Serial.println(F("Failed"));
         } else {
@@ -486,7 +507,6 @@ void loop() {
         flushSerial();
         Serial.print(F("Type out one-line message (140 char): "));
         readline(message, 140);
-        Serial.println(message);
 
         uint16_t ussdlen;
         if (!fona.sendUSSD(message, replybuffer, 250, &ussdlen)) { // pass in buffer and max len!
@@ -645,39 +665,25 @@ void loop() {
       }
     case 'w': {
         // read website URL
-        uint16_t statuscode;
-        int16_t length;
+        HttpResult result;
         char url[80];
 
         flushSerial();
         Serial.println(F("URL to read (e.g. dweet.io/get/latest/dweet/for/sim7500test123):"));
         Serial.print(F("http://")); readline(url, 79);
-        Serial.println(url);
 
         Serial.println(F("****"));
-        if (!fona.HTTP_GET_start(url, &statuscode, (uint16_t *)&length)) {
-          Serial.println("Failed!");
-          break;
-        }
-        while (length > 0) {
-          while (fona.available()) {
-            char c = fona.read();
-
-            // Serial.write is too slow, we'll write directly to Serial register!
-            Serial.write(c);
-            length--;
-            if (! length) break;
-          }
-        }
+        // the body is read in chunks, whatever its size
+        bool ok = http.get(url, Serial, result);
         Serial.println(F("\n****"));
-        fona.HTTP_GET_end();
+        if (!ok) Serial.println("Failed!");
+        printHttpResult(result);
         break;
       }
 
     case 'W': {
         // Post data to website
-        uint16_t statuscode;
-        int16_t length;
+        HttpResult result;
         char url[80];
         char data[80];
 
@@ -685,26 +691,14 @@ void loop() {
         Serial.println(F("NOTE: in beta! Use simple websites to post!"));
         Serial.println(F("URL to post (e.g. httpbin.org/post):"));
         Serial.print(F("http://")); readline(url, 79);
-        Serial.println(url);
         Serial.println(F("Data to post (e.g. \"foo\" or \"{\"simple\":\"json\"}\"):"));
         readline(data, 79);
-        Serial.println(data);
 
         Serial.println(F("****"));
-        if (!fona.HTTP_POST_start(url, F("text/plain"), (uint8_t *) data, strlen(data), &statuscode, (uint16_t *)&length)) {
-          Serial.println("Failed!");
-          break;
-        }
-        while (length > 0) {
-          while (fona.available()) {
-            char c = fona.read();
-            Serial.write(c);
-            length--;
-            if (! length) break;
-          }
-        }
+        bool ok = http.post(url, "text/plain", (const uint8_t *)data, strlen(data), Serial, result);
         Serial.println(F("\n****"));
-        fona.HTTP_POST_end();
+        if (!ok) Serial.println("Failed!");
+        printHttpResult(result);
         break;
       }
     case '2': {
@@ -749,19 +743,49 @@ void loop() {
 
         break;
       }
+    /*********************************** Benchmark */
+
+    case 'B': {
+        // run a sequence of operations N times and report their latencies
+        char sequence[21];
+        flushSerial();
+        Serial.println(F("Operations in order: s = GPS status, f = GPS fix, a = GPRS attach,"));
+        Serial.println(F("m = MQTT connect and publish, h = HTTP GET (e.g. \"sah\"):"));
+        readline(sequence, 20);
+        Serial.print(F("Iterations (max ")); Serial.print(BENCH_MAX_RUNS); Serial.print(F("): "));
+        uint16_t iterations = readnumber();
+        flushSerial();
+        Serial.print(F("Table or CSV (t/c)? "));
+        char format = readBlocking();
+        Serial.println(format);
+        flushSerial();
+        if (!bench.run(sequence, iterations)) {
+          Serial.println(F("No known operation in the sequence"));
+          break;
+        }
+        if (format == 'c') bench.printCsv();
+        else bench.printTable();
+        break;
+      }
+
     /*****************************************/
 
     case 'S': {
-        Serial.println(F("Creating SERIAL TUBE"));
-        while (1) {
-          while (Serial.available()) {
-            delay(1);
-            fona.write(Serial.read());
-          }
-          if (fona.available()) {
-            Serial.write(fona.read());
-          }
+        flushSerial();
+        Serial.print(F("Record to flash (r), print the recording as a sim script (p), or neither? "));
+        char mode = readBlocking();
+        Serial.println(mode);
+        flushSerial();
+        if (mode == 'p') {
+          // capture it on the host as a script for embedded/main/sim
+          if (!tube.printScript(tube_record_path, Serial)) Serial.println(F("No recording"));
+          break;
         }
+        Serial.println(F("Creating SERIAL TUBE, \"~.\" at the start of a line leaves it"));
+        TubeStats stats;
+        tube.run(mode == 'r' ? tube_record_path : nullptr, stats);
+        Serial.println();
+        printTubeStats(stats);
         break;
       }
 
@@ -773,8 +797,6 @@ void loop() {
   }
   // flush input
   flushSerial();
-  while (fona.available()) {
-    Serial.write(fona.read());
-  }
-
+  pumpUrcs();
+  console.start(prompt, CONSOLE_LINE_MAX, true);
 }
@@ -0,0 +1,172 @@
+#include "modem_bench.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+namespace {
+
+const char op_letters[BENCH_OPS] = { 's', 'f', 'a', 'm', 'h' };
+const char *op_names[BENCH_OPS] = { "gps status", "gps fix", "gprs attach", "mqtt publish", "http get" };
+
+const uint32_t fix_poll_interval = 1000; // ms
+const char bench_message[] = "benchmark";
+
+}
+
+BenchOp benchOp(char c) {
+  for (int i = 0; i < BENCH_OPS; i++) {
+    if (op_letters[i] == c) return (BenchOp)i;
+  }
+  return BENCH_OPS;
+}
+
+const char *benchOpName(BenchOp op) {
+  return op < BENCH_OPS ? op_names[op] : "?";
+}
+
+void LatencyStats::reset() {
+  count = attempts = failures = 0;
+}
+
+void LatencyStats::add(uint32_t ms, bool ok) {
+  attempts++;
+  if (!ok) {
+    failures++;
+    return;
+  }
+  if (count == BENCH_MAX_RUNS) return;
+  // kept sorted, the runs are short
+  uint16_t i = count++;
+  while (i > 0 && samples[i - 1] > ms) {
+    samples[i] = samples[i - 1];
+    i--;
+  }
+  samples[i] = ms;
+}
+
+uint32_t LatencyStats::percentile(uint8_t p) const {
+  if (count == 0) return 0;
+  // nearest rank: the smallest sample with at least p % at or below it
+  uint16_t rank = ((uint32_t)p * count + 99) / 100;
+  return samples[rank > 0 ? rank - 1 : 0];
+}
+
+void ModemBench::begin(Adafruit_FONA_LTE &f, const BenchConfig &c) {
+  fona = &f;
+  config = c;
+}
+
+bool ModemBench::run(const char *sequence, uint16_t iterations) {
+  bool any = false;
+  for (const char *c = sequence; *c; c++) any |= benchOp(*c) != BENCH_OPS;
+  if (!any) return false;
+  if (iterations > BENCH_MAX_RUNS) iterations = BENCH_MAX_RUNS;
+  for (int i = 0; i < BENCH_OPS; i++) stats[i].reset();
+  for (uint16_t n = 0; n < iterations; n++) {
+    for (const char *c = sequence; *c; c++) {
+      BenchOp op = benchOp(*c);
+      if (op == BENCH_OPS) continue;
+      uint32_t start = millis();
+      bool ok = runOp(op);
+      uint32_t ms = millis() - start;
+      stats[op].add(ms, ok);
+      Serial.print(n + 1); Serial.print(' ');
+      Serial.print(benchOpName(op)); Serial.print(F(": "));
+      Serial.print(ms); Serial.println(ok ? F(" ms") : F(" ms, failed"));
+      if (Serial.available()) {
+        Serial.println(F("Stopped"));
+        return true;
+      }
+    }
+  }
+  return true;
+}
+
+bool ModemBench::runOp(BenchOp op) {
+  switch (op) {
+    case BENCH_GPS_STATUS:
+      return fona->GPSstatus() >= 0;
+    case BENCH_GPS_FIX:
+      return gpsFix();
+    case BENCH_GPRS_ATTACH:
+      // timed from a detached modem, a no-op attach says nothing
+      fona->enableGPRS(false);
+      return fona->enableGPRS(true);
+    case BENCH_MQTT:
+      return mqttPublish();
+    case BENCH_HTTP_GET:
+      return httpGet();
+    default:
+      return false;
+  }
+}
+
+bool ModemBench::gpsFix() {
+  // the receiver keeps its ephemeris while off, so this is a hot start
+  fona->enableGPS(false);
+  if (!fona->enableGPS(true)) return false;
+  uint32_t start = millis();
+  float latitude, longitude;
+  while (millis() - start < config.fix_timeout) {
+    if (fona->getGPS(&latitude, &longitude)) return true;
+    delay(fix_poll_interval);
+  }
+  return false;
+}
+
+bool ModemBench::mqttPublish() {
+  if (!fona->MQTT_setParameter("URL", config.mqtt_server, config.mqtt_port)) return false;
+  if (config.mqtt_username) {
+    if (!fona->MQTT_setParameter("USERNAME", config.mqtt_username)) return false;
+    if (!fona->MQTT_setParameter("PASSWORD", config.mqtt_password)) return false;
+  }
+  if (!fona->MQTT_connect(true)) return false;
+  bool ok = fona->MQTT_publish(config.mqtt_topic, bench_message, strlen(bench_message), 1, 0);
+  fona->MQTT_connect(false);
+  return ok;
+}
+
+bool ModemBench::httpGet() {
+  char url[80];
+  strncpy(url, config.http_url, sizeof(url) - 1);
+  url[sizeof(url) - 1] = 0;
+  uint16_t status, length;
+  if (!fona->HTTP_GET_start(url, &status, &length)) return false;
+  // the body counts, the modem only hands it over as it is read
+  uint32_t last = millis();
+  while (length > 0 && millis() - last < config.body_timeout) {
+    while (length > 0 && fona->available()) {
+      fona->read();
+      length--;
+      last = millis();
+    }
+  }
+  fona->HTTP_GET_end();
+  return length == 0 && status >= 200 && status < 300;
+}
+
+void ModemBench::printTable() {
+  Serial.println(F("operation       runs  fail%    min    p50    p95    max (ms)"));
+  char line[80];
+  for (int i = 0; i < BENCH_OPS; i++) {
+    const LatencyStats &s = stats[i];
+    if (s.runs() == 0) continue;
+    snprintf(line, sizeof(line), "%-14s %5u %6.1f %6lu %6lu %6lu %6lu", op_names[i], s.runs(),
+             100.0 * s.failed() / s.runs(), (unsigned long)s.min(), (unsigned long)s.percentile(50),
+             (unsigned long)s.percentile(95), (unsigned long)s.max());
+    Serial.println(line);
+  }
+}
+
+void ModemBench::printCsv() {
+  Serial.println(F("operation,runs,failures,min_ms,p50_ms,p95_ms,max_ms"));
+  char line[80];
+  for (int i = 0; i < BENCH_OPS; i++) {
+    const LatencyStats &s = stats[i];
+    if (s.runs() == 0) continue;
+    snprintf(line, sizeof(line), "%s,%u,%u,%lu,%lu,%lu,%lu", op_names[i], s.runs(), s.failed(),
+             (unsigned long)s.min(), (unsigned long)s.percentile(50), (unsigned long)s.percentile(95),
+             (unsigned long)s.max());
+    Serial.println(line);
+  }
+}
@@ -0,0 +1,423 @@
+#include "serial_tube.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+const char record_magic[4] = { 'T', 'U', 'B', '1' };
+// every block: ms since the start (4), direction (1), length (2), the bytes
+const size_t record_header = 7;
+const uint8_t to_modem = '>';
+const uint8_t to_host = '<';
+
+const uint8_t xon = 0x11;
+const uint8_t xoff = 0x13;
+// RTS drops once the modem UART FIFO holds this many bytes
+const uint8_t rts_threshold = 64;
+const uint32_t command_wait = 200; // ms for the modem to take AT+IFC
+// end and cancel the text after AT+CMGS
+const uint8_t ctrl_z = 0x1a;
+const uint8_t esc = 0x1b;
+// the hand-written scripts line up their replies after this many characters
+const size_t prefix_column = 11;
+
+// Builds modem script lines from the recorded traffic. What the host sends
+// up to a CR is a command, what the modem sends back up to its final
+// result is the reply; anything the modem sends with no command waiting
+// is an unsolicited result code.
+//
+// A command that takes data (AT+SMPUB, AT+HTTPDATA, AT+CMGS) gets a prompt
+// first, '>' or DOWNLOAD, and the host then sends the data with no CR
+// after it. The data is skipped, and like the simulation, which makes up
+// the prompt itself, the reply is what follows it and its latency counts
+// from the end of the data.
+class ScriptWriter {
+ public:
+  explicit ScriptWriter(Print &o) : out(o) {}
+
+  void fromHost(uint8_t c, uint32_t ms) {
+    if (data_left > 0 || data_until_ctrl_z) {
+      if (data_len < sizeof(data)) data[data_len] = c;
+      data_len++;
+      if (data_left > 0) data_left--;
+      else if (c == ctrl_z || c == esc) data_until_ctrl_z = false;
+      if (data_left == 0 && !data_until_ctrl_z) sent_ms = ms;
+      return;
+    }
+    if (c == '\n') return;
+    if (c != '\r') {
+      if (typed_len + 1 < sizeof(typed)) typed[typed_len++] = c;
+      return;
+    }
+    if (waiting) emit();
+    typed[typed_len] = 0;
+    if (typed_len > 0) {
+      memcpy(command, typed, typed_len + 1);
+      command_len = typed_len;
+      waiting = true;
+      replying = false;
+      sent_ms = ms;
+      echo_pos = reply_len = line_len = 0;
+      expectData();
+    }
+    typed_len = 0;
+  }
+
+  void fromModem(uint8_t c, uint32_t ms) {
+    if (!waiting) {
+      urc(c, ms);
+      return;
+    }
+    if (!replying) {
+      // the echo, if it is on, and the line break after it
+      if (echo_pos < command_len && c == (uint8_t)command[echo_pos]) {
+        echo_pos++;
+        return;
+      }
+      // the data's too, past what was kept of it by count
+      if (prompted && echo_pos == command_len && data_echo_pos < data_len &&
+          (data_echo_pos >= sizeof(data) || c == (uint8_t)data[data_echo_pos])) {
+        data_echo_pos++;
+        return;
+      }
+      if (c == '\r' || c == '\n' || (prompted && c == ' ')) return;
+      if (prompt == PROMPT_ARROW && !prompted && c == '>') {
+        takeData();
+        return;
+      }
+      replying = true;
+      reply_ms = ms;
+    }
+    if (reply_len + 1 < sizeof(reply)) reply[reply_len++] = c;
+    if (c != '\n') {
+      if (c != '\r' && line_len + 1 < sizeof(line)) line[line_len++] = c;
+      return;
+    }
+    line[line_len] = 0;
+    line_len = 0;
+    if (prompt == PROMPT_DOWNLOAD && !prompted && strcmp(line, "DOWNLOAD") == 0) {
+      takeData();
+      return;
+    }
+    if (strcmp(line, "OK") == 0 || strcmp(line, "ERROR") == 0 || strncmp(line, "+CME ERROR", 10) == 0 ||
+        strncmp(line, "+CMS ERROR", 10) == 0) {
+      emit();
+    }
+  }
+
+  void finish() {
+    if (waiting) emit();
+  }
+
+ private:
+  enum Prompt { PROMPT_NONE, PROMPT_ARROW, PROMPT_DOWNLOAD };
+
+  // whether the command takes data, and how much
+  void expectData() {
+    prompt = PROMPT_NONE;
+    prompted = false;
+    data_size = 0;
+    data_ctrl_z = false;
+    const char *args = strchr(command, '=');
+    if (!args) return;
+    args++;
+    if (strncmp(command, "AT+SMPUB=", 9) == 0) {
+      // "topic",length,qos,retain
+      const char *end = *args == '"' ? strchr(args + 1, '"') : args;
+      const char *comma = end ? strchr(end, ',') : nullptr;
+      data_size = comma ? strtoul(comma + 1, nullptr, 10) : 0;
+      if (data_size > 0) prompt = PROMPT_ARROW;
+    } else if (strncmp(command, "AT+HTTPDATA=", 12) == 0) {
+      // length,timeout
+      data_size = strtoul(args, nullptr, 10);
+      if (data_size > 0) prompt = PROMPT_DOWNLOAD;
+    } else if (strncmp(command, "AT+CMGS=", 8) == 0 || strncmp(command, "AT+CMGW=", 8) == 0) {
+      // the text ends with Ctrl-Z
+      data_ctrl_z = true;
+      prompt = PROMPT_ARROW;
+    }
+  }
+
+  // the prompt is in, what the host sends next is data
+  void takeData() {
+    prompted = true;
+    data_left = data_size;
+    data_until_ctrl_z = data_ctrl_z;
+    data_len = data_echo_pos = 0;
+    replying = false;
+    reply_len = line_len = 0;
+  }
+
+  void emit() {
+    while (reply_len > 0 && (reply[reply_len - 1] == '\r' || reply[reply_len - 1] == '\n')) reply_len--;
+    // the rule matches by prefix, so like the hand-written scripts it is
+    // the command without its parameters: every AT+SMPUB="...",... is an
+    // AT+SMPUB, and repeated ones replay in the recorded order
+    size_t n = strcspn(command, "=");
+    for (size_t i = 0; i < n; i++) out.print(command[i]);
+    for (size_t i = n; i < prefix_column; i++) out.print(' ');
+    out.print(F(" | "));
+    out.print(replying ? reply_ms - sent_ms : 0);
+    out.print(F(" | "));
+    escaped(reply, reply_len);
+    out.println();
+    waiting = false;
+    // a prompt that got no data never ends it
+    data_left = 0;
+    data_until_ctrl_z = false;
+  }
+
+  void urc(uint8_t c, uint32_t ms) {
+    if (c == '\r') return;
+    if (c != '\n') {
+      if (urc_len == 0) urc_ms = ms;
+      if (urc_len + 1 < sizeof(urc_line)) urc_line[urc_len++] = c;
+      return;
+    }
+    if (urc_len == 0) return;
+    out.print('@'); out.print(urc_ms); out.print(F(" | "));
+    escaped(urc_line, urc_len);
+    out.println();
+    urc_len = 0;
+  }
+
+  // as the simulation's script reader unescapes it
+  void escaped(const char *s, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      char c = s[i];
+      if (c == '\r') out.print(F("\\r"));
+      else if (c == '\n') out.print(F("\\n"));
+      else if (c == '\\') out.print(F("\\\\"));
+      else if (c < 0x20 || c > 0x7e) out.print('?');
+      else out.print(c);
+    }
+  }
+
+  Print &out;
+  char typed[128];
+  size_t typed_len = 0;
+  char command[128];
+  size_t command_len = 0;
+  bool waiting = false, replying = false;
+  Prompt prompt = PROMPT_NONE;
+  bool prompted = false;
+  size_t data_size = 0;
+  bool data_ctrl_z = false;
+  size_t data_left = 0;          // bytes of data the host still has to send
+  bool data_until_ctrl_z = false;
+  char data[512];                // what it sent, to spot the echo
+  size_t data_len = 0, data_echo_pos = 0;
+  uint32_t sent_ms = 0, reply_ms = 0;
+  size_t echo_pos = 0;
+  char reply[512];
+  size_t reply_len = 0;
+  char line[64]; // the reply's current line, to spot the final result
+  size_t line_len = 0;
+  char urc_line[256];
+  size_t urc_len = 0;
+  uint32_t urc_ms = 0;
+};
+
+}
+
+void SerialTube::begin(HardwareSerial &h, HardwareSerial &m, const TubeConfig &c) {
+  host = &h;
+  modem = &m;
+  config = c;
+}
+
+void SerialTube::run(const char *record_path, TubeStats &stats) {
+  memset(&stats, 0, sizeof(stats));
+  line_start = true;
+  tilde = host_held = host_full = modem_full = false;
+  recording = false;
+  record_len = 0;
+  if (record_path) {
+    file = SPIFFS.open(record_path, "w");
+    recording = file && file.write((const uint8_t *)record_magic, sizeof(record_magic)) == sizeof(record_magic);
+  }
+  startFlowControl();
+  started = millis();
+  bool leave = false;
+  while (!leave) {
+    leave = pumpHost(stats);
+    pumpModem(stats);
+  }
+  stats.ms = millis() - started;
+  if (host_held) host->write(xon);
+  stopFlowControl();
+  if (recording) flushRecord(stats);
+  if (file) file.close();
+}
+
+void SerialTube::startFlowControl() {
+  if (config.modem_cts_pin < 0 || config.modem_rts_pin < 0) return;
+  // the modem first, it answers before either end holds the other off
+  modemCommand("AT+IFC=2,2");
+  modem->setPins(config.modem_rx_pin, config.modem_tx_pin, config.modem_cts_pin, config.modem_rts_pin);
+  modem->setHwFlowCtrlMode(HW_FLOWCTRL_CTS_RTS, rts_threshold);
+}
+
+void SerialTube::stopFlowControl() {
+  if (config.modem_cts_pin < 0 || config.modem_rts_pin < 0) return;
+  modemCommand("AT+IFC=0,0");
+  modem->setHwFlowCtrlMode(HW_FLOWCTRL_DISABLE);
+}
+
+void SerialTube::modemCommand(const char *cmd) {
+  modem->print(cmd);
+  modem->print('\r');
+  uint32_t start = millis();
+  while (millis() - start < command_wait) {
+    while (modem->available()) modem->read();
+  }
+}
+
+bool SerialTube::pumpHost(TubeStats &stats) {
+  int avail = host->available();
+  if (config.host_xonxoff) {
+    if (!host_held && (size_t)avail > config.host_rx_size * 3 / 4) {
+      host->write(xoff);
+      host_held = true;
+      stats.host_holds++;
+    } else if (host_held && (size_t)avail < config.host_rx_size / 4) {
+      host->write(xon);
+      host_held = false;
+    }
+  }
+  bool full = avail > 0 && (size_t)avail >= config.host_rx_size;
+  if (full && !host_full) stats.host_overruns++;
+  host_full = full;
+  // a held back '~' can add a byte to the block
+  int room = modem->availableForWrite() - 1;
+  if (avail <= 0 || room <= 0) return false;
+  size_t n = avail;
+  if (n > (size_t)room) n = room;
+  if (n > TUBE_BLOCK) n = TUBE_BLOCK;
+  uint8_t in[TUBE_BLOCK], out[TUBE_BLOCK + 1];
+  n = host->readBytes((char *)in, n);
+  bool leave = false;
+  size_t m = unescape(in, n, out, leave);
+  if (m > 0) {
+    modem->write(out, m);
+    stats.to_modem += m;
+    record(to_modem, out, m, stats);
+  }
+  return leave;
+}
+
+void SerialTube::pumpModem(TubeStats &stats) {
+  int avail = modem->available();
+  bool full = avail > 0 && (size_t)avail >= config.modem_rx_size;
+  if (full && !modem_full) stats.modem_overruns++;
+  modem_full = full;
+  int room = host->availableForWrite();
+  if (avail <= 0 || room <= 0) return;
+  size_t n = avail;
+  if (n > (size_t)room) n = room;
+  if (n > TUBE_BLOCK) n = TUBE_BLOCK;
+  uint8_t block[TUBE_BLOCK];
+  n = modem->readBytes((char *)block, n);
+  host->write(block, n);
+  stats.to_host += n;
+  record(to_host, block, n, stats);
+}
+
+size_t SerialTube::unescape(const uint8_t *in, size_t n, uint8_t *out, bool &leave) {
+  size_t m = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint8_t c = in[i];
+    if (tilde) {
+      tilde = false;
+      if (c == '.') {
+        leave = true;
+        return m;
+      }
+      out[m++] = '~';
+      if (c == '~') {
+        line_start = false;
+        continue;
+      }
+    } else if (line_start && c == '~') {
+      tilde = true;
+      continue;
+    }
+    out[m++] = c;
+    line_start = c == '\r' || c == '\n';
+  }
+  return m;
+}
+
+void SerialTube::record(uint8_t direction, const uint8_t *data, size_t n, TubeStats &stats) {
+  if (!recording) return;
+  if (record_len + record_header + n > sizeof(record_buffer)) flushRecord(stats);
+  if (!recording) return;
+  uint32_t ms = millis() - started;
+  uint16_t len = n;
+  uint8_t *p = record_buffer + record_len;
+  memcpy(p, &ms, sizeof(ms));
+  p[4] = direction;
+  memcpy(p + 5, &len, sizeof(len));
+  memcpy(p + record_header, data, n);
+  record_len += record_header + n;
+}
+
+void SerialTube::flushRecord(TubeStats &stats) {
+  // stalls the tube for the flash write, the RX buffers cover it
+  if (record_len == 0) return;
+  size_t written = file.write(record_buffer, record_len);
+  stats.recorded += written;
+  if (written < record_len) {
+    recording = false;
+    stats.record_full = true;
+  }
+  record_len = 0;
+}
+
+bool SerialTube::printScript(const char *record_path, Print &out) {
+  File f = SPIFFS.open(record_path, "r");
+  if (!f) return false;
+  char magic[sizeof(record_magic)];
+  if (f.read((uint8_t *)magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, record_magic, sizeof(magic)) != 0) {
+    f.close();
+    return false;
+  }
+  out.println(F("# recorded with the diagnostics serial tube, @ times from its start"));
+  ScriptWriter writer(out);
+  uint8_t header[record_header], data[TUBE_BLOCK + 1];
+  while (f.read(header, sizeof(header)) == sizeof(header)) {
+    uint32_t ms;
+    uint16_t len;
+    memcpy(&ms, header, sizeof(ms));
+    memcpy(&len, header + 5, sizeof(len));
+    if (len > sizeof(data) || f.read(data, len) != len) break;
+    for (uint16_t i = 0; i < len; i++) {
+      if (header[4] == to_modem) writer.fromHost(data[i], ms);
+      else writer.fromModem(data[i], ms);
+    }
+  }
+  writer.finish();
+  f.close();
+  return true;
+}
+
+void printTubeStats(const TubeStats &stats) {
+  uint32_t ms = stats.ms > 0 ? stats.ms : 1;
+  Serial.print(stats.ms); Serial.println(F(" ms in the tube"));
+  Serial.print(F("To the modem: ")); Serial.print(stats.to_modem);
+  Serial.print(F(" bytes, ")); Serial.print((uint32_t)((uint64_t)stats.to_modem * 1000 / ms));
+  Serial.println(F(" bytes/s"));
+  Serial.print(F("To the host: ")); Serial.print(stats.to_host);
+  Serial.print(F(" bytes, ")); Serial.print((uint32_t)((uint64_t)stats.to_host * 1000 / ms));
+  Serial.println(F(" bytes/s"));
+  // with RTS/CTS a full modem buffer holds the modem off, nothing is lost
+  Serial.print(F("RX buffer full: host ")); Serial.print(stats.host_overruns);
+  Serial.print(F(", modem ")); Serial.print(stats.modem_overruns);
+  Serial.print(F("; host held off ")); Serial.print(stats.host_holds); Serial.println(F(" times"));
+  if (stats.recorded > 0) {
+    Serial.print(F("Recorded ")); Serial.print(stats.recorded); Serial.print(F(" bytes"));
+    if (stats.record_full) Serial.print(F(", flash full"));
+    Serial.println();
+  }
+}
@@ -0,0 +1,36 @@
+#include "urc_pump.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void UrcPump::begin(Stream &m) {
+  modem = &m;
+}
+
+bool UrcPump::poll() {
+  while (modem->available()) {
+    char c = modem->read();
+    if (c == '\r') continue;
+    if (c != '\n') {
+      if (partial_len == 0) partial_ms = millis();
+      if (partial_len < URC_LINE_MAX) partial[partial_len++] = c;
+      continue;
+    }
+    // URCs come framed by blank lines
+    if (partial_len == 0) continue;
+    memcpy(text, partial, partial_len);
+    text[partial_len] = 0;
+    ms = partial_ms;
+    partial_len = 0;
+    lines++;
+    return true;
+  }
+  return false;
+}
+
+void UrcPump::print(Print &out) const {
+  char stamp[16];
+  snprintf(stamp, sizeof(stamp), "[%5lu.%03lu] ", (unsigned long)(ms / 1000), (unsigned long)(ms % 1000));
+  out.print(stamp);
+  out.println(text);
+}
@@ -0,0 +1,222 @@
+#include "modem_link.h"
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+const uint32_t link_magic = 0x4c4e4b32; // "LNK2"
+
+struct Saved {
+  uint32_t magic;
+  uint32_t best;
+  uint32_t ceiling;
+  uint16_t clean_boots;
+};
+
+// what AT+IPR takes on the SIM7000, slowest first
+const uint32_t candidates[] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600 };
+const size_t candidate_count = sizeof(candidates) / sizeof(candidates[0]);
+// the rate after power-up
+const uint32_t default_baud = 115200;
+
+const uint32_t probe_timeout = 100;   // ms per AT
+const int probe_tries = 3;
+const uint32_t command_timeout = 500; // ms
+// after a rate change, until both UARTs are in step again
+const uint32_t settle_ms = 20;
+// cold starts without a failure before the rates above the ceiling are
+// tried again
+const uint16_t ceiling_retry_boots = 20;
+
+// the echo test sends this many lines of this many characters; an unknown
+// command, only its echo matters
+const int echo_rounds = 3;
+const size_t echo_length = 200;
+const char echo_command[] = "AT+ECHO";
+const char echo_chars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+// CRC-16/CCITT
+uint16_t crc16(uint16_t crc, uint8_t b) {
+  crc ^= (uint16_t)b << 8;
+  for (int i = 0; i < 8; i++) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  return crc;
+}
+
+}
+
+uint32_t ModemLink::begin(HardwareSerial &p, int8_t rx_pin, int8_t tx_pin, uint32_t max_baud, bool warm,
+                          const char *file_path) {
+  port = &p;
+  rx = rx_pin;
+  tx = tx_pin;
+  path = file_path;
+  if (!loaded) {
+    loaded = true;
+    File file = SPIFFS.open(path, "r");
+    if (file) {
+      Saved s;
+      if (file.read((uint8_t *)&s, sizeof(s)) == sizeof(s) && s.magic == link_magic) {
+        best = s.best;
+        ceiling = s.ceiling;
+        clean_boots = s.clean_boots;
+      }
+      file.close();
+    }
+  }
+  if (warm && current) {
+    setBaud(current);
+    if (probe()) return current;
+  }
+  if (!find()) {
+    Serial.println(F("Modem does not answer at any rate"));
+    current = 0;
+    return 0;
+  }
+  uint32_t saved_best = best, saved_ceiling = ceiling;
+  uint16_t saved_boots = clean_boots;
+  if (ceiling && clean_boots >= ceiling_retry_boots) {
+    Serial.print(F("Trying the modem link at ")); Serial.print(ceiling); Serial.println(F(" baud again"));
+    ceiling = 0;
+  }
+  // counts this start as clean unless a rate fails below
+  clean_boots++;
+  // found it above what is allowed or known to work, come back down first
+  if (current > max_baud || (ceiling && current >= ceiling)) stepTo(default_baud);
+  // straight to the rate that passed last time
+  if (best > current && best <= max_baud && (ceiling == 0 || best < ceiling)) stepTo(best);
+  for (size_t i = 0; i < candidate_count; i++) {
+    uint32_t c = candidates[i];
+    if (c <= current) continue;
+    if (c > max_baud || (ceiling && c >= ceiling)) break;
+    if (!stepTo(c)) break;
+  }
+  best = current;
+  // nothing to try again without a ceiling
+  if (ceiling == 0) clean_boots = 0;
+  if (best != saved_best || ceiling != saved_ceiling || clean_boots != saved_boots) save();
+  Serial.print(F("Modem link at ")); Serial.print(current); Serial.println(F(" baud"));
+  return current;
+}
+
+void ModemLink::setBaud(uint32_t baud) {
+  port->begin(baud, SERIAL_8N1, rx, tx);
+  current = baud;
+  delay(settle_ms);
+}
+
+bool ModemLink::probe() {
+  for (int i = 0; i < probe_tries; i++) {
+    if (command("AT", probe_timeout)) return true;
+  }
+  return false;
+}
+
+bool ModemLink::find() {
+  // where it was left, where it starts after power-up, then anywhere
+  if (best) {
+    setBaud(best);
+    if (probe()) return true;
+  }
+  setBaud(default_baud);
+  if (probe()) return true;
+  for (size_t i = candidate_count; i-- > 0;) {
+    if (candidates[i] == default_baud || candidates[i] == best) continue;
+    setBaud(candidates[i]);
+    if (probe()) return true;
+  }
+  return false;
+}
+
+bool ModemLink::stepTo(uint32_t baud) {
+  uint32_t from = current;
+  char cmd[20];
+  snprintf(cmd, sizeof(cmd), "AT+IPR=%lu", (unsigned long)baud);
+  // answered at the old rate, the modem switches right after
+  bool switched = command(cmd, command_timeout);
+  if (switched) {
+    setBaud(baud);
+    if (echoTest()) return true;
+  }
+  Serial.print(F("Modem link fails at ")); Serial.print(baud); Serial.println(F(" baud"));
+  if (ceiling == 0 || baud < ceiling) ceiling = baud;
+  clean_boots = 0;
+  if (!switched) return false;
+  // asked for at the new rate, which mostly gets through the noise
+  snprintf(cmd, sizeof(cmd), "AT+IPR=%lu", (unsigned long)from);
+  command(cmd, command_timeout);
+  setBaud(from);
+  if (!probe()) find();
+  return false;
+}
+
+bool ModemLink::echoTest() {
+  // on for the test only, the drivers expect it off
+  if (!command("ATE1", command_timeout)) return false;
+  bool ok = true;
+  size_t total = strlen(echo_command) + echo_length + 1;
+  // twice the time on the wire, plus the modem's turnaround
+  uint32_t timeout = total * 10 * 2 * 1000 / current + 100;
+  for (int r = 0; r < echo_rounds && ok; r++) {
+    drain();
+    uint16_t sent = 0xffff, echoed = 0xffff;
+    for (size_t i = 0; i < total; i++) {
+      char c;
+      if (i < strlen(echo_command)) c = echo_command[i];
+      else if (i + 1 < total) c = echo_chars[(i * 7 + r * 13) % (sizeof(echo_chars) - 1)];
+      else c = '\r';
+      port->write((uint8_t)c);
+      sent = crc16(sent, c);
+    }
+    size_t n = 0;
+    uint32_t start = millis();
+    while (n < total && millis() - start < timeout) {
+      while (n < total && port->available()) {
+        echoed = crc16(echoed, port->read());
+        n++;
+      }
+      if (n < total) delay(1);
+    }
+    ok = n == total && echoed == sent;
+    // the result code after the echo
+    delay(settle_ms);
+  }
+  return command("ATE0", command_timeout) && ok;
+}
+
+bool ModemLink::command(const char *cmd, uint32_t timeout_ms) {
+  drain();
+  port->print(cmd);
+  port->print('\r');
+  return expect("OK", timeout_ms);
+}
+
+bool ModemLink::expect(const char *reply, uint32_t timeout_ms) {
+  size_t len = strlen(reply), matched = 0;
+  uint32_t start = millis();
+  while (millis() - start < timeout_ms) {
+    while (port->available()) {
+      char c = port->read();
+      if (c == reply[matched]) matched++;
+      else matched = c == reply[0] ? 1 : 0;
+      if (matched == len) return true;
+    }
+    delay(1);
+  }
+  return false;
+}
+
+void ModemLink::drain() {
+  while (port->available()) port->read();
+}
+
+bool ModemLink::save() {
+  File f = SPIFFS.open(path, "w");
+  if (!f) return false;
+  Saved s = { link_magic, best, ceiling, clean_boots };
+  bool ok = f.write((const uint8_t *)&s, sizeof(s)) == sizeof(s);
+  f.close();
+  return ok;
+}
@@ -0,0 +1,48 @@
+#ifndef MODEM_LINK_H
+#define MODEM_LINK_H
+
+#include <stdint.h>
+#include <HardwareSerial.h>
+
+// Finds the SIM7000 on its UART and runs the link as fast as the wiring
+// allows. From whatever rate the modem answers at (115200 after power-up)
+// it steps up through the candidate rates with AT+IPR, and checks each new
+// rate with an echo test: lines covering the character set are sent with
+// echo on and the CRC of what comes back must match what went out. A rate
+// that fails is reverted and becomes the ceiling, so the link settles one
+// step below it. The result is saved to SPIFFS, the next cold start goes
+// straight to it and only steps again if it no longer passes. A failure
+// may have been noise, or the wiring has been fixed since, so after a
+// number of cold starts without one the ceiling is lifted and the faster
+// rates are tried again.
+// Shared by the tracker and the diagnostics console.
+class ModemLink {
+ public:
+  // warm is set when resuming from deep sleep with the modem still at the
+  // rate it was left at; returns the rate, 0 if the modem does not answer
+  uint32_t begin(HardwareSerial &port, int8_t rx_pin, int8_t tx_pin, uint32_t max_baud, bool warm,
+                 const char *path = "/link.bin");
+  uint32_t baud() const { return current; }
+
+ private:
+  void setBaud(uint32_t baud);
+  bool probe();
+  bool find();
+  bool stepTo(uint32_t baud);
+  bool echoTest();
+  bool command(const char *cmd, uint32_t timeout_ms);
+  bool expect(const char *reply, uint32_t timeout_ms);
+  void drain();
+  bool save();
+
+  HardwareSerial *port = nullptr;
+  int8_t rx = -1, tx = -1;
+  const char *path = nullptr;
+  bool loaded = false;
+  uint32_t current = 0;
+  uint32_t best = 0;    // fastest rate that passed
+  uint32_t ceiling = 0; // slowest rate that failed, 0 if none
+  uint16_t clean_boots = 0; // cold starts since a rate last failed
+};
+
+#endif
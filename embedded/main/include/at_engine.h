@@ -0,0 +1,89 @@
+#ifndef AT_ENGINE_H
+#define AT_ENGINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <Arduino.h>
+
+#define AT_QUEUE_SIZE 8
+#define AT_COMMAND_SIZE 128
+#define AT_RESPONSE_SIZE 256
+#define AT_LINE_SIZE 256
+
+enum AtStatus {
+  AT_OK,
+  AT_ERROR,   // ERROR, +CME ERROR or +CMS ERROR
+  AT_TIMEOUT, // no final result code in time
+};
+
+// response holds the intermediate lines of the reply joined by '\n'
+typedef void (*AtCallback)(AtStatus status, const char *response, void *ctx);
+// any complete line that does not belong to the command in flight
+typedef void (*UrcHandler)(const char *line, size_t len, void *ctx);
+
+// Non-blocking AT command engine for the modem UART. Commands are queued
+// with a timeout and a completion callback; poll() sends them one at a time
+// and parses the reply a byte at a time as it arrives, so the caller never
+// waits on the UART. Unsolicited result codes are passed to the URC handler
+// whenever they arrive, including in the middle of a reply. After a
+// timeout the engine resyncs with a bare AT before the next command, so a
+// late reply to the timed-out command cannot complete the next one.
+//
+// The blocking FONA driver shares the same UART and must only be used
+// while idle() is true.
+class AtEngine {
+ public:
+  void begin(Stream &port);
+  void onUrc(UrcHandler handler, void *ctx = nullptr);
+
+  // Queues a command (without the trailing CR). If payload is set it is
+  // sent after the modem's '>' prompt and must stay valid until the
+  // callback runs. Returns false if the queue is full.
+  bool send(const char *command, uint32_t timeout_ms, AtCallback cb, void *ctx = nullptr,
+            const uint8_t *payload = nullptr, size_t payload_len = 0);
+
+  // moves bytes in both directions and fires callbacks; call from loop()
+  void poll();
+  bool idle() const { return queued == 0 && !resyncing; }
+  size_t pending() const { return queued; }
+
+ private:
+  struct Command {
+    char text[AT_COMMAND_SIZE];
+    uint32_t timeout_ms;
+    AtCallback cb;
+    void *ctx;
+    const uint8_t *payload;
+    size_t payload_len;
+  };
+
+  void start();
+  void handleLine();
+  void finish(AtStatus status);
+  void resync();
+  static bool isUrc(const char *line);
+
+  Stream *port = nullptr;
+  UrcHandler urc_handler = nullptr;
+  void *urc_ctx = nullptr;
+
+  Command queue[AT_QUEUE_SIZE];
+  size_t head = 0;
+  size_t queued = 0;
+  bool in_flight = false;
+  bool payload_sent = false;
+  uint32_t started_at = 0;
+  // after a timeout: an AT is out and the next command waits for its OK
+  // and a quiet line
+  bool resyncing = false;
+  bool resync_ok = false;
+  uint32_t resync_at = 0;
+  uint32_t last_rx = 0;
+
+  char line[AT_LINE_SIZE];
+  size_t line_len = 0;
+  char response[AT_RESPONSE_SIZE];
+  size_t response_len = 0;
+};
+
+#endif
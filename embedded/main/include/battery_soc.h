@@ -0,0 +1,52 @@
+#ifndef BATTERY_SOC_H
+#define BATTERY_SOC_H
+
+#include <stdint.h>
+#include "power_stats.h"
+
+struct BatteryConfig {
+  float capacity_mah;
+  float internal_resistance; // ohms, cell plus protection and wiring
+  float sleep_current_ma;    // assumed draw while nothing is sampled
+};
+
+// Coulomb-counting state-of-charge estimate. Every INA260 power window is
+// subtracted from the remaining charge, and time spent asleep at the
+// configured sleep current. The open-circuit voltage (the reading plus
+// the I*R drop under load) is looked up in a Li-ion OCV table to seed the
+// estimate and to pull it back slowly whenever the load is light enough
+// for the voltage to be trusted. The state is kept in RTC memory and
+// saved to SPIFFS now and then so it survives resets.
+class BatteryEstimator {
+ public:
+  bool begin(const BatteryConfig &config, const char *path = "/battery.bin");
+
+  // charge used in a power window, including its unsampled time
+  void addUsage(const PowerStats &window);
+  // latest reading, V and A
+  void correct(float voltage, float current);
+  // saves the state if it moved enough since the last save
+  void persist();
+
+  bool valid() const { return initialized; }
+  float percent() const { return soc * 100; }
+  float remainingMah() const { return soc * config.capacity_mah; }
+  // at the recent average draw, -1 if not known yet
+  int32_t minutesRemaining() const;
+
+ private:
+  bool save();
+
+  BatteryConfig config = {};
+  const char *path = nullptr;
+  bool initialized = false;
+  float soc = 0;          // 0..1
+  float average_ma = -1;  // recent average draw including sleep
+  float saved_soc = -1;
+  float since_correction = 0; // hours
+};
+
+// state of charge (0..1) of a resting Li-ion cell at this voltage
+float ocvStateOfCharge(float voltage);
+
+#endif
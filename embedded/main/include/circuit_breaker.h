@@ -0,0 +1,62 @@
+#ifndef CIRCUIT_BREAKER_H
+#define CIRCUIT_BREAKER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// How a failing operation is retried and when it is given up on for a while
+struct RetryPolicy {
+  uint32_t base_ms;     // wait after the first failure, doubled for each one after it
+  uint32_t max_ms;      // cap on that wait
+  uint8_t jitter;       // % of each wait randomised either way
+  uint8_t attempts;     // failures in a row before the breaker opens
+  uint32_t open_ms;     // how long an open breaker parks the subsystem
+  uint32_t open_max_ms; // cap on the open time, doubled for each failed trial
+};
+
+enum BreakerState {
+  BREAKER_CLOSED,    // working, or retrying within the attempt budget
+  BREAKER_OPEN,      // parked until the open time is up
+  BREAKER_HALF_OPEN, // one trial attempt, which closes or reopens it
+};
+
+// Exponential backoff with jitter and a circuit breaker for one subsystem
+// (modem, data, GNSS, MQTT). Each failure pushes the next attempt out by a
+// doubling, randomised wait; once the attempt budget is spent the breaker
+// opens and parks the subsystem for a much longer time, after which a
+// single trial decides whether it closes again or stays open for twice as
+// long. The caller asks allow() before an attempt and reports the outcome,
+// everything else keeps running while a subsystem is parked. The jitter
+// keeps a fleet that lost the same cell tower from retrying in step.
+class CircuitBreaker {
+ public:
+  // name must stay valid; warm keeps the state from before deep sleep
+  void begin(const char *name, const RetryPolicy &policy, bool warm);
+
+  // whether an attempt may be made now; an open breaker whose time is up
+  // lets one trial through
+  bool allow();
+  void success();
+  void failure();
+
+  BreakerState state() const { return current; }
+  // no failure since the last success
+  bool healthy() const { return failures == 0; }
+  int32_t retryAt() const { return retry_at; }
+  const char *name() const { return label; }
+  // "<name>=ok", "<name>=retry <failures>" or "<name>=open <trips>", for
+  // the health status; returns the length written
+  size_t status(char *out, size_t size) const;
+
+ private:
+  uint32_t backoff(uint32_t base, uint32_t max, uint8_t n) const;
+
+  const char *label = "";
+  RetryPolicy policy = {};
+  BreakerState current = BREAKER_CLOSED;
+  uint8_t failures = 0; // in a row
+  uint8_t trips = 0;    // openings since the last success
+  int32_t retry_at = 0; // rtcMillis()
+};
+
+#endif
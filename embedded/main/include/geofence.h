@@ -0,0 +1,109 @@
+#ifndef GEOFENCE_H
+#define GEOFENCE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define GEOFENCE_MAX_FENCES 8
+// shared by all polygons, a circle takes one for its centre
+#define GEOFENCE_MAX_VERTICES 64
+
+#define FENCE_ALERT_VERSION 1
+#define FENCE_ALERT_SIZE 14
+
+// Fence alert published on ALERT_TOPIC, one or more back to back, oldest
+// first. Little-endian; keep decodeFenceAlerts() in
+// frontend/src/components/controller/index.js in sync with this layout.
+//
+//  offset size field
+//   0     1    version (FENCE_ALERT_VERSION)
+//   1     1    fence id
+//   2     4    timestamp, unix seconds
+//   6     4    latitude, degrees * 1e6 (signed)
+//  10     4    longitude, degrees * 1e6 (signed)
+
+enum FenceShape {
+  FENCE_CIRCLE,
+  FENCE_POLYGON,
+};
+
+// degrees * 1e6, like the track
+struct GeoPoint {
+  int32_t latitude;
+  int32_t longitude;
+};
+
+struct Fence {
+  uint8_t id;
+  uint8_t shape;
+  uint8_t first;  // index of the first vertex
+  uint8_t count;  // number of vertices
+  uint32_t radius_m;  // circles only
+  // bounding box, checked before the exact test
+  int32_t min_latitude, max_latitude;
+  int32_t min_longitude, max_longitude;
+};
+
+struct FenceAlert {
+  uint8_t id;
+  uint32_t timestamp;
+  GeoPoint fix;
+};
+
+// Circles and polygons the bike should stay inside. Each fix is checked
+// against every fence's bounding box and, only when inside it, against the
+// exact shape; a fence is breached when a fix is outside it after the
+// previous one was inside. Fences are set with text commands on
+// COMMAND_TOPIC:
+//
+//   fence circle <id> <lat> <lon> <radius m>
+//   fence polygon <id> <lat> <lon> <lat> <lon> <lat> <lon> ...
+//   fence remove <id>
+//   fence clear
+//
+// Polygons use a flat projection, so they must not cross the antimeridian.
+// The fences are kept in RTC memory and saved to SPIFFS on every change.
+class Geofences {
+ public:
+  bool begin(const char *path = "/fences.bin");
+
+  // applies the text after "fence "; false if malformed or out of space
+  bool command(const char *text, size_t len);
+
+  // replaces any fence with the same id
+  bool addCircle(uint8_t id, GeoPoint centre, uint32_t radius_m);
+  bool addPolygon(uint8_t id, const GeoPoint *vertices, size_t n);
+  bool remove(uint8_t id);
+  void clear();
+
+  // checks a fix and stores the ids of the fences it breached in exited;
+  // returns how many
+  size_t check(GeoPoint fix, uint8_t *exited, size_t max_exited);
+
+  size_t size() const { return fence_count; }
+  const Fence &fence(size_t i) const { return fences[i]; }
+
+ private:
+  bool add(const Fence &fence, const GeoPoint *vertices, size_t n);
+  // the fence's slot, or fence_count if there is none with the id
+  size_t find(uint8_t id) const;
+  // takes the fence's vertices out of the pool
+  void releaseVertices(size_t i);
+  bool contains(const Fence &fence, GeoPoint p) const;
+  bool save();
+
+  const char *path = nullptr;
+  bool loaded = false;
+  Fence fences[GEOFENCE_MAX_FENCES] = {};
+  GeoPoint vertices[GEOFENCE_MAX_VERTICES] = {};
+  uint8_t fence_count = 0;
+  uint8_t vertex_count = 0;
+  // per fence slot: its state is known, and the last fix was inside it
+  uint32_t known = 0;
+  uint32_t inside = 0;
+};
+
+// writes exactly FENCE_ALERT_SIZE bytes to out
+size_t encodeFenceAlert(const FenceAlert &alert, uint8_t *out);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef GNSS_INFO_H
+#define GNSS_INFO_H
+
+#include <stdint.h>
+
+// One AT+CGNSINF report
+struct GnssInfo {
+  bool running;
+  bool fix;
+  float latitude, longitude, altitude, speed_kph, heading;
+  uint16_t year;
+  uint8_t month, day, hour, minute;
+  float second;
+  uint8_t satellites_used;
+};
+
+// Parses the "+CGNSINF: ..." line of a response; fields the modem left
+// empty are zero. Returns false if no report was found.
+bool parseGnssInfo(const char *response, GnssInfo &info);
+
+// GPS status in the same terms as Adafruit_FONA::GPSstatus():
+// 0 = off, 1 = no fix, 3 = fix
+int8_t gnssStatus(const GnssInfo &info);
+
+#endif
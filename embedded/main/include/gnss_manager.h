@@ -0,0 +1,138 @@
+#ifndef GNSS_MANAGER_H
+#define GNSS_MANAGER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "Adafruit_FONA.h"
+#include "at_engine.h"
+#include "gnss_info.h"
+
+enum GnssStart {
+  GNSS_HOT,      // ephemeris still valid
+  GNSS_WARM,     // almanac, time and rough position kept by the receiver
+  GNSS_COLD,     // nothing usable
+  GNSS_ASSISTED, // cold, with XTRA orbit predictions loaded
+  GNSS_STARTS
+};
+
+struct GnssConfig {
+  uint32_t poll_interval; // ms between AT+CGNSINF while searching
+  uint32_t fix_timeout;   // ms of searching before giving up on a fix
+  uint32_t hot_age;       // ms after a fix that a hot start still works
+  uint32_t warm_age;      // ms after a fix that a warm start still works
+  uint32_t xtra_interval; // s between XTRA downloads, 0 to not use XTRA
+  const char *xtra_url;
+};
+
+// Keeps the SIM7000's GNSS engine on only while a fix is needed. acquire()
+// powers it up with the best start the receiver can still do, polls
+// AT+CGNSINF until there is a fix or fix_timeout passes and hands that
+// reply to the callback, so a cycle waits exactly as long as the fix takes.
+// release() powers it down again unless the caller keeps it warm, e.g.
+// while the track is sampled.
+//
+// The receiver keeps its ephemeris and almanac while the modem has power,
+// so the age of the last fix decides between a hot, warm and cold start.
+// The time, from the last fix or the network, is kept in RTC memory and
+// schedules XTRA assistance data, downloaded over the data connection at
+// most once per xtra_interval and loaded before a cold start. A failed
+// download is tried again after half an hour, twice as long after every
+// further failure up to xtra_interval; the times of the last download and
+// attempt are also saved on SPIFFS.
+//
+// Time to first fix is measured from power-on for every start and kept per
+// start type.
+class GnssManager {
+ public:
+  // warm is set when resuming from deep sleep with the modem still powered
+  void begin(AtEngine &at, Adafruit_FONA_LTE &fona, const GnssConfig &config, bool warm,
+             const char *path = "/gnss.bin");
+
+  // starts a search; cb gets the first reply with a fix, or the last one
+  // when the search gives up
+  void acquire(AtCallback cb, void *ctx = nullptr);
+  // sends the next query when due; call from loop()
+  void poll();
+  // URC lines from the AT engine, for the XTRA download result
+  void onUrc(const char *line, size_t len);
+  // a fix seen outside acquire(), e.g. while sampling the track
+  void fixed(const GnssInfo &info);
+  // powers the receiver down unless keep_warm; uses the blocking driver, so
+  // only while the AT engine is idle
+  void release(bool keep_warm);
+
+  bool powered() const { return is_powered; }
+  bool searching() const { return stage != STAGE_IDLE; }
+  // rtcMillis() time poll() next has something to do while searching
+  int32_t nextPollAt() const { return next_poll; }
+  void printStats();
+
+ private:
+  enum Stage {
+    STAGE_IDLE,
+    STAGE_CLOCK,     // asking the network for the time
+    STAGE_XTRA,      // downloading assistance data
+    STAGE_STARTING,  // power-on commands queued
+    STAGE_SEARCHING, // polling for a fix
+  };
+
+  GnssStart chooseStart() const;
+  void startCold();
+  void downloadXtra();
+  void powerOn(GnssStart start);
+  void startSearch(bool timed);
+  void finish(AtStatus status, const char *response);
+  void remember(const GnssInfo &info);
+  void setClock(uint32_t unix_time);
+  // unix seconds now, 0 if neither a fix nor the network gave the time
+  uint32_t unixNow() const;
+  bool xtraDue(uint32_t now) const;
+  bool save();
+
+  static void onClock(AtStatus status, const char *response, void *ctx);
+  static void onXtraRequested(AtStatus status, const char *response, void *ctx);
+  static void onXtraCopied(AtStatus status, const char *response, void *ctx);
+  static void onPowered(AtStatus status, const char *response, void *ctx);
+  static void onRestarted(AtStatus status, const char *response, void *ctx);
+  static void onInfo(AtStatus status, const char *response, void *ctx);
+
+  AtEngine *at = nullptr;
+  Adafruit_FONA_LTE *fona = nullptr;
+  GnssConfig config = {};
+  const char *path = nullptr;
+  AtCallback callback = nullptr;
+  void *callback_ctx = nullptr;
+
+  Stage stage = STAGE_IDLE;
+  GnssStart start = GNSS_COLD;
+  bool is_powered = false;
+  bool query_in_flight = false;
+  bool timed = false;            // the search started the receiver
+  int32_t powered_at = 0;        // rtcMillis() of every time below
+  int32_t search_started = 0;
+  int32_t next_poll = 0;
+  int32_t xtra_started = 0;
+
+  // the receiver's memory, lost when the modem loses power
+  bool receiver_fix = false;
+  int32_t receiver_fix_at = 0;
+  // the time from the last fix or the network
+  bool clock_valid = false;
+  uint32_t clock_unix = 0;
+  int32_t clock_at = 0;
+  // what is also saved on SPIFFS
+  bool loaded = false;
+  uint32_t xtra_time = 0;        // unix seconds of the last XTRA download
+  uint32_t xtra_attempt = 0;     // unix seconds of the last attempt
+  uint32_t xtra_failures = 0;    // attempts since the last download
+
+  uint32_t on_ms = 0;
+  uint32_t ttff_count[GNSS_STARTS] = {0};
+  uint32_t ttff_sum[GNSS_STARTS] = {0};
+  uint32_t ttff_max[GNSS_STARTS] = {0};
+  uint32_t timeouts = 0;
+};
+
+const char *gnssStartName(GnssStart start);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+// The sensors share one I2C bus, which the sensor sampler reads from its
+// own core while the loop task arms and disarms the motion wake. Whoever
+// talks to a sensor holds an I2cLock for the whole exchange, so a
+// register write and read-back are never split by the other core.
+class I2cLock {
+ public:
+  I2cLock();
+  ~I2cLock();
+
+ private:
+  I2cLock(const I2cLock &);
+  I2cLock &operator=(const I2cLock &);
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef MODEM_POWER_H
+#define MODEM_POWER_H
+
+#include <stdint.h>
+#include "Adafruit_FONA.h"
+
+enum ModemPowerProfile {
+  MODEM_ALWAYS_ON, // DRX idle, commands arrive immediately
+  MODEM_EDRX,      // extended DRX, commands arrive within one eDRX cycle
+  MODEM_PSM,       // power saving mode, unreachable until the next wake
+};
+
+enum ModemPowerState {
+  MODEM_STATE_ACTIVE, // between wake() and idle()
+  MODEM_STATE_IDLE,
+  MODEM_STATE_EDRX,
+  MODEM_STATE_PSM,
+  MODEM_POWER_STATES
+};
+
+// Chooses and applies the SIM7000 power profile from the battery level and
+// the publish interval, wakes the modem and re-attaches before each cycle,
+// and keeps a per-state time and estimated charge counter.
+class ModemPower {
+ public:
+  // warm is set when resuming from deep sleep with the modem already set up;
+  // otherwise the modem was power-cycled and the next apply() sends the
+  // profile in full
+  void begin(Adafruit_FONA_LTE &fona, uint8_t pwrkey_pin, bool catm_only, bool warm);
+
+  ModemPowerProfile choose(float battery, uint32_t publish_interval_ms) const;
+  // reconfigures the modem if the profile differs from the current one
+  bool apply(ModemPowerProfile profile);
+  ModemPowerProfile profile() const { return current; }
+
+  // brings the modem out of its low-power state ready for AT commands and
+  // makes sure it is registered with a data context
+  bool wake();
+  // the cycle is over, the modem may drop to the profile's idle state
+  void idle();
+
+  uint32_t stateMillis(ModemPowerState s);
+  float stateMilliampHours(ModemPowerState s);
+  void printEnergy();
+
+ private:
+  void enterState(ModemPowerState s);
+  bool waitForModem();
+
+  Adafruit_FONA_LTE *fona = nullptr;
+  uint8_t pwrkey_pin = 0;
+  ModemPowerProfile current = MODEM_ALWAYS_ON;
+  bool applied = false; // the modem has had current since its power-up
+  ModemPowerState state = MODEM_STATE_ACTIVE;
+  int32_t state_since = 0;
+  uint32_t state_ms[MODEM_POWER_STATES] = {0};
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef MOTION_STATE_H
+#define MOTION_STATE_H
+
+#include <stdint.h>
+
+enum MotionState {
+  MOTION_PARKED,
+  MOTION_WALKING,
+  MOTION_RIDING,
+};
+
+struct MotionLimits {
+  float walking_kph;        // at or above this the bike is moving
+  float riding_kph;         // at or above this it is being ridden
+  float turn_degrees;       // heading change between fixes that counts as moving
+  float current_spike_ma;   // INA260 current above the parked baseline, 0 to ignore
+  uint32_t riding_interval;  // ms
+  uint32_t walking_interval; // ms
+  uint32_t parked_interval;  // first interval once parked, ms
+  uint32_t parked_max_interval; // the parked interval doubles up to this, ms
+};
+
+// Picks the publish interval from how the bike is moving. Each cycle's GPS
+// speed and heading (and optionally a current spike, e.g. lights switched
+// on) classify it as parked, walking or riding; moving publishes at a fixed
+// fast rate, parked starts at parked_interval and doubles every cycle.
+class MotionRate {
+ public:
+  void begin(const MotionLimits &limits);
+
+  // feeds one cycle's sample and returns the interval until the next one
+  uint32_t update(bool has_fix, float speed_kph, float heading, float current_ma);
+  // the motion sensor fired; counts like a current spike in the next update()
+  void moved() { motion_seen = true; }
+
+  MotionState state() const { return current; }
+  uint32_t interval() const { return interval_ms; }
+
+ private:
+  MotionState classify(bool has_fix, float speed_kph, float heading, float current_ma);
+
+  MotionLimits limits = {};
+  MotionState current = MOTION_PARKED;
+  uint32_t interval_ms = 0;
+  float last_heading = -1;
+  float baseline_ma = -1;
+  bool motion_seen = false;
+};
+
+const char *motionStateName(MotionState state);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef MOTION_WAKE_H
+#define MOTION_WAKE_H
+
+#include <stdint.h>
+#include "Adafruit_INA260.h"
+#include "Adafruit_MPU6050.h"
+
+enum MotionSensor {
+  MOTION_SENSOR_NONE,
+  MOTION_SENSOR_IMU,      // MPU6050 motion interrupt
+  MOTION_SENSOR_CURRENT,  // INA260 over-current alert
+};
+
+// Wakes a parked tracker when the bike is moved instead of on a timer.
+// Either an MPU6050 on the I2C bus, whose motion interrupt keeps working
+// in its low-power cycle mode, or the INA260's ALERT set to an
+// over-current limit (lights or a hub dynamo switching on) pulls a GPIO
+// low, which PowerScheduler adds as a wake source. The IMU is used when
+// it answers, the INA260 otherwise. Both are only armed while parked, so
+// riding does not wake the chip on every bump.
+class MotionWake {
+ public:
+  // imu_pin: MPU6050 INT, or -1 if not fitted. alert_pin: INA260 ALERT, or
+  // -1; shared_alert when the sensor sampler also uses it for
+  // conversion-ready, which disarm() then restores.
+  MotionSensor begin(Adafruit_INA260 &power, int8_t imu_pin, int8_t alert_pin, bool shared_alert,
+                     float wake_current_ma);
+
+  // arms the interrupt and returns the active-low pin to wake on, -1 if
+  // there is no motion sensor
+  int8_t arm();
+  // back to normal running; returns whether motion was latched meanwhile
+  bool disarm();
+
+  MotionSensor sensor() const { return source; }
+  bool armed() const { return is_armed; }
+
+ private:
+  Adafruit_INA260 *power_sensor = nullptr;
+  Adafruit_MPU6050 imu;
+  MotionSensor source = MOTION_SENSOR_NONE;
+  int8_t pin = -1;
+  bool shared = false;
+  bool is_armed = false;
+  float limit_ma = 0;
+};
+
+const char *motionSensorName(MotionSensor sensor);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef MQTT_PUBLISHER_H
+#define MQTT_PUBLISHER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "at_engine.h"
+
+#define MQTT_QUEUE_SIZE 24
+// publishes handed to the AT engine at once, the rest of its queue is left
+// for other commands
+#define MQTT_MAX_IN_FLIGHT 4
+
+// What a message is decides how it is delivered
+enum MqttClass {
+  MQTT_TELEMETRY, // frequent and superseded by the next one: QoS 0
+  MQTT_BACKLOG,   // telemetry that missed its cycle, dropped once acked: QoS 1
+  MQTT_STATUS,    // informational text: QoS 0
+  MQTT_TRACK,     // the ride's history, not repeated: QoS 1
+  MQTT_ALERT,     // geofence breaches: QoS 1
+  MQTT_ACK,       // command acknowledgements: QoS 1
+  MQTT_HEALTH,    // subsystem health, only sent when it changes: QoS 1
+  MQTT_CLASSES
+};
+
+// Queue of outgoing MQTT messages for one connection window. A cycle
+// queues everything it has, then flush() hands the publishes to the AT
+// engine back to back as it has room, without waiting for a callback
+// between them. QoS comes from the message class: with QoS 0 the modem
+// answers AT+SMPUB as soon as the message is on its way, with QoS 1 only
+// once the broker's PUBACK is in, so only messages that must not be lost
+// wait for the round trip.
+//
+// Payloads are not copied and must stay valid until their callback runs.
+// After a failed publish the session is assumed gone and the messages not
+// yet handed over fail right away instead of each running into a timeout.
+class MqttPublisher {
+ public:
+  void begin(AtEngine &at, uint32_t timeout_ms);
+
+  // queues a message; returns false if the queue is full
+  bool publish(const char *topic, MqttClass cls, const uint8_t *payload, size_t len,
+               AtCallback cb = nullptr, void *ctx = nullptr);
+  // starts sending what is queued, and anything queued until it is empty
+  void flush();
+  // hands queued publishes to the AT engine; call from loop()
+  void poll();
+  // fails everything not yet handed over, e.g. when there is no session
+  void drop();
+
+  bool idle() const { return queued == 0; }
+  uint32_t sent(uint8_t qos) const { return qos ? sent_qos1 : sent_qos0; }
+  uint32_t failed() const { return failures; }
+
+ private:
+  struct Message {
+    const char *topic;
+    uint8_t qos;
+    const uint8_t *payload;
+    size_t len;
+    AtCallback cb;
+    void *ctx;
+  };
+
+  void fail(size_t from);
+  static void onPublished(AtStatus status, const char *response, void *ctx);
+
+  AtEngine *at = nullptr;
+  uint32_t timeout = 0;
+  Message queue[MQTT_QUEUE_SIZE];
+  size_t head = 0;
+  size_t queued = 0;      // waiting and in flight
+  size_t in_flight = 0;   // the oldest ones, handed to the engine
+  bool flushing = false;
+  uint32_t sent_qos0 = 0, sent_qos1 = 0, failures = 0;
+};
+
+uint8_t mqttQos(MqttClass cls);
+
+#endif
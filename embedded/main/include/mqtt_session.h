@@ -0,0 +1,80 @@
+#ifndef MQTT_SESSION_H
+#define MQTT_SESSION_H
+
+#include <stdint.h>
+#include "at_engine.h"
+#include "circuit_breaker.h"
+
+struct MqttSessionConfig {
+  const char *server;
+  uint16_t port;
+  const char *username;
+  const char *password;
+  const char *subscribe_topic; // subscribed once per boot, nullptr for none
+  uint16_t keepalive;          // s
+  RetryPolicy retry;           // for failed connects
+};
+
+typedef void (*MqttReadyCallback)(bool connected, void *ctx);
+
+// Keeps the SIM7000's MQTT session across publish cycles and sleeps. A
+// cycle asks ensure() for a session: if the modem still has one it is
+// reused as is, otherwise the broker settings are sent once per modem
+// power-up and AT+SMCONN connects with a fixed client id and
+// clean session off, so the broker keeps the subscription and queued QoS 1
+// commands for us. The topic is only subscribed after the first connect of
+// a boot, so a broker that expires sessions has to keep them for longer
+// than the tracker can stay offline.
+//
+// Brokers refuse an empty client id without a clean session, so until the
+// IMEI is known the session is a clean one, subscribed on every connect.
+//
+// A failed connect is not retried every cycle: further attempts back off
+// through a CircuitBreaker, and those cycles report no session so their
+// data goes to the backlog. Connect latency, reuse and failures are
+// counted.
+class MqttSession {
+ public:
+  // client_id must stay valid and may be empty until the modem reports its
+  // IMEI; warm is set when resuming from deep sleep
+  void begin(AtEngine &at, const MqttSessionConfig &config, const char *client_id, bool warm);
+
+  // cb runs once the session is up, failed or is backing off
+  void ensure(MqttReadyCallback cb, void *ctx = nullptr);
+  bool connected() const { return is_connected; }
+  const CircuitBreaker &health() const { return breaker; }
+  void printStats();
+
+ private:
+  void configure();
+  void connect();
+  void fail();
+  void done(bool ok);
+  bool persistent() const { return client_id && *client_id; }
+
+  static void onState(AtStatus status, const char *response, void *ctx);
+  static void onConfigured(AtStatus status, const char *response, void *ctx);
+  static void onConnected(AtStatus status, const char *response, void *ctx);
+  static void onSubscribed(AtStatus status, const char *response, void *ctx);
+
+  AtEngine *at = nullptr;
+  MqttSessionConfig config = {};
+  const char *client_id = nullptr;
+  MqttReadyCallback callback = nullptr;
+  void *callback_ctx = nullptr;
+
+  bool busy = false;
+  bool is_connected = false;
+  bool configured = false;  // the modem has the broker settings
+  bool subscribed = false;  // the broker keeps the subscription in our session
+  uint8_t config_step = 0;
+  int32_t connect_started = 0; // rtcMillis()
+  CircuitBreaker breaker;
+
+  uint32_t reused = 0;
+  uint32_t connects = 0;
+  uint32_t connect_failures = 0;
+  uint32_t connect_sum = 0, connect_min = 0, connect_max = 0; // ms
+};
+
+#endif
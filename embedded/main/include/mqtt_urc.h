@@ -0,0 +1,72 @@
+#ifndef MQTT_URC_H
+#define MQTT_URC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Longest +SMSUB record kept: 128 byte topic, 512 byte message and framing
+#define URC_RECORD_SIZE 672
+#define URC_MAX_TOPICS 4
+
+// Non-owning view of a topic or message, only valid inside the handler
+struct TextView {
+  const char *data;
+  size_t len;
+
+  bool equals(const char *s) const;
+};
+
+typedef void (*TopicHandler)(TextView topic, TextView message, void *ctx);
+
+// Streaming parser for the SIM7000's +SMSUB: "topic","message" URCs.
+// Bytes can be fed in any chunking, so a URC split across reads or several
+// packed into one are handled the same way. The record being parsed is
+// kept in a fixed buffer and handlers get views into it, nothing is copied
+// or allocated. The message runs to the closing quote at the end of the
+// line, so it may itself contain quotes and commas. Other lines are skipped.
+class MqttUrcParser {
+ public:
+  // topic is matched exactly and must outlive the parser
+  bool on(const char *topic, TopicHandler handler, void *ctx = nullptr);
+  // messages on topics without a handler
+  void onUnhandled(TopicHandler handler, void *ctx = nullptr);
+
+  void feed(const char *data, size_t len);
+  void feed(char c);
+
+  // records that overflowed the buffer or were malformed
+  uint32_t dropped() const { return discarded; }
+
+ private:
+  enum State {
+    LINE_START,
+    PREFIX,       // matching +SMSUB: "
+    TOPIC,
+    SEPARATOR,    // ","
+    MESSAGE,
+    MESSAGE_QUOTE, // a quote that ends the message if the line ends here
+    SKIP,         // rest of a line that is not an +SMSUB
+  };
+
+  void dispatch();
+  void discard();
+
+  struct Route {
+    const char *topic;
+    TopicHandler handler;
+    void *ctx;
+  };
+  Route routes[URC_MAX_TOPICS];
+  size_t route_count = 0;
+  TopicHandler unhandled = nullptr;
+  void *unhandled_ctx = nullptr;
+
+  State state = LINE_START;
+  char record[URC_RECORD_SIZE];
+  size_t record_len = 0;
+  size_t matched = 0;
+  size_t topic_start = 0, topic_len = 0, message_start = 0;
+  uint32_t discarded = 0;
+};
+
+#endif
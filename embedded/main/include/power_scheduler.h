@@ -0,0 +1,51 @@
+#ifndef POWER_SCHEDULER_H
+#define POWER_SCHEDULER_H
+
+#include <stdint.h>
+#include <esp_attr.h>
+
+enum WakeReason {
+  WAKE_RESET,  // power-on or reset, nothing survived
+  WAKE_TIMER,  // the scheduled wake time was reached
+  WAKE_MODEM,  // the modem had something to say (UART data or RI)
+  WAKE_MOTION, // the motion sensor pulled its pin low
+};
+
+// Puts the ESP32 to sleep between publish cycles. Light sleep keeps RAM and
+// wakes on the timer or on data from the modem UART, so incoming commands
+// are still handled. Deep sleep is only used when the modem's RI line is
+// wired to an RTC GPIO, because that is the only way a command can wake the
+// chip from it; setup() then runs again and RTC_DATA_ATTR state survives.
+// While a motion pin is set it wakes either sleep too; deep sleep then also
+// needs it on an RTC GPIO.
+class PowerScheduler {
+ public:
+  // ri_pin is the RTC-capable GPIO wired to the modem RI pin, or -1
+  void begin(int8_t ri_pin, uint8_t modem_uart);
+
+  // why setup() is running
+  WakeReason bootReason() const { return boot_reason; }
+  bool resumedFromDeepSleep() const { return boot_reason != WAKE_RESET; }
+
+  // active-low pin of an armed motion sensor, -1 to stop waking on it
+  void wakeOnMotion(int8_t pin) { motion_pin = pin; }
+
+  // Sleeps until the given rtcMillis() time or until the modem wakes us,
+  // choosing the deepest sleep that is safe. Returns on light-sleep wake;
+  // a deep sleep restarts the sketch instead.
+  WakeReason idleUntil(int32_t wake_at);
+
+ private:
+  WakeReason lightSleep(uint32_t ms);
+  void deepSleep(uint32_t ms);
+
+  int8_t ri_pin = -1;
+  int8_t motion_pin = -1;
+  uint8_t modem_uart = 1;
+  WakeReason boot_reason = WAKE_RESET;
+};
+
+// milliseconds on the RTC clock, which keeps counting through deep sleep
+int32_t rtcMillis();
+
+#endif
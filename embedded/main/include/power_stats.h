@@ -0,0 +1,57 @@
+#ifndef POWER_STATS_H
+#define POWER_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Running aggregate of INA260 readings. Charge and energy integrate each
+// reading over the time until the next one. Gaps longer than
+// POWER_MAX_GAP_US (the CPU was asleep and nothing was sampled) are only
+// counted as unsampled time: the readings on either side are awake
+// currents and would overstate the sleep by orders of magnitude.
+struct PowerStats {
+  uint32_t samples;
+  uint64_t sampled_us;
+  uint64_t unsampled_us;
+  float voltage_min, voltage_max; // V
+  float current_min, current_max; // A
+  double voltage_sum, current_sum;
+  double charge_mah, energy_mwh;
+
+  void reset();
+  // a reading dt_us after the previous one, which read prev_voltage/prev_current
+  void add(float voltage, float current, uint32_t dt_us, float prev_voltage, float prev_current);
+  void merge(const PowerStats &other);
+  float voltageMean() const { return samples ? voltage_sum / samples : 0; }
+  float currentMean() const { return samples ? current_sum / samples : 0; }
+};
+
+// Binary power summary published on POWER_TOPIC, little-endian like the
+// telemetry frame; keep decodePowerStats() in
+// frontend/src/components/controller/index.js in sync with this layout.
+//
+//  offset size field
+//   0     1    version (POWER_STATS_VERSION)
+//   1     2    sequence number
+//   3     4    sampled time, ms
+//   7     4    unsampled time, ms
+//  11     4    samples
+//  15     2    voltage min, mV
+//  17     2    voltage mean, mV
+//  19     2    voltage max, mV
+//  21     2    current min, mA (signed)
+//  23     2    current mean, mA (signed)
+//  25     2    current max, mA (signed)
+//  27     4    charge, uAh
+//  31     4    energy, uWh
+//  35     2    battery time remaining, minutes (0xffff if unknown)
+#define POWER_STATS_VERSION 2
+#define POWER_STATS_SIZE 37
+
+// readings further apart than this are a gap in the sampling
+#define POWER_MAX_GAP_US 50000
+
+// writes exactly POWER_STATS_SIZE bytes to out
+size_t encodePowerStats(const PowerStats &stats, uint16_t sequence, int32_t minutes_remaining, uint8_t *out);
+
+#endif
@@ -5,13 +5,11 @@
 #define MQTT_PASSWORD   "MQTT_PASSWORD"
 
 // MQTT topics
-#define GPS_TOPIC       "location"
-#define TEMP_TOPIC      "temperature"
-#define PRESSURE_TOPIC  "pressure"
-#define ALTITUDE_TOPIC  "altitude"
-#define HUMIDITY_TOPIC  "humidity"
-#define VOLTAGE_TOPIC   "voltage"
-#define CURRENT_TOPIC   "current"
+#define TELEMETRY_TOPIC "telemetry"
 #define POWER_TOPIC     "power"
-#define BATT_TOPIC      "battery"
+#define ERROR_TOPIC     "error"
+#define TRACK_TOPIC     "track"
+#define ALERT_TOPIC     "alert"
+#define ACK_TOPIC       "ack"
+#define HEALTH_TOPIC    "health"
 #define COMMAND_TOPIC   "command"
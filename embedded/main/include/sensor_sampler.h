@@ -0,0 +1,73 @@
+#ifndef SENSOR_SAMPLER_H
+#define SENSOR_SAMPLER_H
+
+#include <stdint.h>
+#include <esp_attr.h>
+#include "Adafruit_BME280.h"
+#include "Adafruit_INA260.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "spsc_queue.h"
+#include "power_stats.h"
+
+// queued samples; the publisher drains every loop pass, so this only has
+// to cover the blocking modem calls in setup and PSM wake
+#define SAMPLE_QUEUE_SIZE 16
+
+struct SensorSample {
+  uint32_t timestamp; // millis() when read
+  float voltage, current, power; // V, A, W, the latest power reading
+  bool weather;
+  float temperature, pressure, humidity; // *C, hPa, %
+  PowerStats power_window; // every power reading since the previous sample
+};
+
+// Reads the I2C sensors from a FreeRTOS task pinned to its own core, at a
+// fixed period and whenever the publisher asks, and hands timestamped
+// samples over through a lock-free queue. The loop task only touches I2C
+// to arm the motion wake, under the same I2cLock, so sample timing does
+// not depend on the modem and the publish path never waits on a sensor.
+//
+// In between, the task reads the INA260 after every conversion (about
+// 1 kHz with 4 x 140 us averaging) and aggregates the readings into each
+// sample's power window, so short transmit bursts are counted. With the
+// ALERT pin wired it is woken by conversion-ready, otherwise it polls
+// every tick.
+class SensorSampler {
+ public:
+  // weather may be null when no BME280 is fitted, alert_pin -1 to poll
+  bool begin(Adafruit_INA260 &power, Adafruit_BME280 *weather, uint32_t period_ms, int core,
+             int8_t alert_pin = -1);
+
+  // asks for a sample now, without waiting for it
+  void request();
+  bool pop(SensorSample &sample) { return queue.pop(sample); }
+  // samples dropped because the queue was full
+  uint32_t overruns() const { return dropped; }
+  // the least free stack the task has had, in bytes; 0 before begin()
+  uint32_t stackFree() const { return handle ? uxTaskGetStackHighWaterMark(handle) : 0; }
+
+ private:
+  static void task(void *self);
+  static void IRAM_ATTR conversionReady();
+  void readPower();
+  void sample();
+
+  Adafruit_INA260 *power_sensor = nullptr;
+  Adafruit_BME280 *weather_sensor = nullptr;
+  uint32_t period = 1000;
+  int8_t alert = -1;
+  TaskHandle_t handle = nullptr;
+  SpscQueue<SensorSample, SAMPLE_QUEUE_SIZE> queue;
+  volatile bool requested = false;
+  volatile uint32_t dropped = 0;
+
+  // only touched by the task
+  uint32_t last_sample = 0;
+  uint32_t last_read_us = 0;
+  bool have_reading = false;
+  float voltage = 0, current = 0;
+  PowerStats window;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+
+// Lock-free queue for exactly one producer and one consumer, which may run
+// on different cores. Each index is only written by one side and published
+// with release ordering, so neither side ever blocks or takes a lock.
+// Holds N - 1 items; N must be a power of two.
+template <typename T, size_t N>
+class SpscQueue {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+ public:
+  // producer side, false when full
+  bool push(const T &item) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t next = (t + 1) & (N - 1);
+    if (next == head.load(std::memory_order_acquire)) return false;
+    items[t] = item;
+    tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side, false when empty
+  bool pop(T &item) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) return false;
+    item = items[h];
+    head.store((h + 1) & (N - 1), std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+  }
+
+ private:
+  T items[N];
+  std::atomic<size_t> head{0}; // next to pop, written by the consumer
+  std::atomic<size_t> tail{0}; // next to push, written by the producer
+};
+
+#endif
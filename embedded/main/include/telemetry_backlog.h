@@ -0,0 +1,46 @@
+#ifndef TELEMETRY_BACKLOG_H
+#define TELEMETRY_BACKLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetry_frame.h"
+
+// Number of frames kept while the link is down, oldest are evicted first.
+// 2048 frames is about 70 kB of the SPIFFS partition.
+#ifndef BACKLOG_SLOTS
+#define BACKLOG_SLOTS 2048
+#endif
+
+// The SIM7000 accepts at most 512 bytes per MQTT publish
+#define BACKLOG_MAX_BATCH (512 / TELEMETRY_FRAME_SIZE)
+
+// Persistent ring buffer of telemetry frames stored in a fixed-size file on
+// SPIFFS. Every sampled frame goes through it, so nothing is lost while the
+// modem is offline or across a reset, and the backlog is drained several
+// frames per publish once the broker is reachable again.
+class TelemetryBacklog {
+ public:
+  bool begin(const char *path = "/backlog.bin");
+
+  // appends a frame, evicting the oldest one when full
+  bool push(const uint8_t *frame);
+  // copies up to max_frames of the oldest frames into out without removing them
+  size_t peek(uint8_t *out, size_t max_frames);
+  // drops the n oldest frames once they have been delivered
+  bool pop(size_t n);
+
+  size_t size() const { return count; }
+  uint32_t dropped() const { return evicted; }
+
+ private:
+  bool writeHeader();
+  bool reset();
+
+  const char *path = nullptr;
+  bool ready = false;
+  uint32_t head = 0;  // slot of the oldest frame
+  uint32_t count = 0;
+  uint32_t evicted = 0;
+};
+
+#endif
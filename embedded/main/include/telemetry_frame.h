@@ -0,0 +1,55 @@
+#ifndef TELEMETRY_FRAME_H
+#define TELEMETRY_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Fixed-layout binary telemetry frame published on TELEMETRY_TOPIC. All
+// fields are little-endian scaled integers; keep decodeTelemetry() in
+// frontend/src/components/controller/index.js in sync with this layout.
+//
+//  offset size field
+//   0     1    version (TELEMETRY_FRAME_VERSION)
+//   1     1    flags (TELEMETRY_FLAG_*)
+//   2     2    sequence number
+//   4     4    timestamp, unix seconds (0 if unknown)
+//   8     4    latitude, degrees * 1e6 (signed)
+//  12     4    longitude, degrees * 1e6 (signed)
+//  16     2    speed, km/h * 10
+//  18     2    heading, degrees * 10
+//  20     2    gps altitude, m (signed)
+//  22     2    voltage, mV
+//  24     2    current, mA (signed)
+//  26     2    power, mW
+//  28     1    battery, %
+//  29     2    temperature, C * 100 (signed)
+//  31     2    pressure, hPa * 10
+//  33     2    humidity, % * 100
+#define TELEMETRY_FRAME_VERSION 1
+#define TELEMETRY_FRAME_SIZE 35
+// the same fields as fixed-point text, comma separated, with the terminator
+#define TELEMETRY_TEXT_SIZE 160
+
+#define TELEMETRY_FLAG_FIX 0x01     // location fields are valid
+#define TELEMETRY_FLAG_WEATHER 0x02 // temperature/pressure/humidity are valid
+#define TELEMETRY_FLAG_TIME 0x04    // timestamp is valid
+
+struct TelemetrySample {
+  uint8_t flags;
+  uint32_t timestamp;
+  float latitude, longitude, speed_kph, heading, altitude;
+  float voltage, current, power, battery; // V, A, W, %
+  float temperature, pressure, humidity;  // C, hPa, %
+};
+
+// writes exactly TELEMETRY_FRAME_SIZE bytes to out
+size_t encodeTelemetryFrame(const TelemetrySample &sample, uint16_t sequence, uint8_t *out);
+
+// writes the frame's fields as text, for logging; out must hold
+// TELEMETRY_TEXT_SIZE bytes. Returns the length.
+size_t formatTelemetry(const TelemetrySample &sample, uint16_t sequence, char *out);
+
+// seconds since the unix epoch for a UTC calendar date and time
+uint32_t unixTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef TRACK_CODEC_H
+#define TRACK_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "track_compressor.h"
+
+#define TRACK_FORMAT_VERSION 1
+// a point never takes more than four 5-byte varints
+#define TRACK_MAX_POINT_BYTES 20
+
+// Batched track encoding, decoded by frontend/src/components/controller/track.js
+//
+//   byte 0     TRACK_FORMAT_VERSION
+//   then per point, as zigzag varints of the difference to the previous
+//   point (the first point is relative to zero, so it is sent in full):
+//              latitude  (degrees * 1e6)
+//              longitude (degrees * 1e6)
+//              altitude  (metres * 10)
+//              timestamp (unix seconds)
+//
+// A minute of riding moves a few hundred metres, so most deltas take one
+// or two bytes and a point is typically 5-7 bytes.
+
+// Encodes as many points as fit in max_len bytes and returns the encoded
+// length; the number of points written is stored in *encoded.
+size_t encodeTrack(const TrackPoint *points, size_t n, uint8_t *out, size_t max_len, size_t *encoded);
+
+// Decodes up to max_points points; returns false on a malformed message.
+bool decodeTrack(const uint8_t *data, size_t len, TrackPoint *points, size_t max_points, size_t *decoded);
+
+#endif
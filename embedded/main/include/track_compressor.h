@@ -0,0 +1,58 @@
+#ifndef TRACK_COMPRESSOR_H
+#define TRACK_COMPRESSOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// fixes since the last kept point that are checked against the tolerance;
+// a straight run longer than this is cut into pieces of this length
+#define TRACK_WINDOW 64
+// kept points waiting to be published, the oldest are evicted when full
+#define TRACK_MAX_POINTS 64
+
+struct TrackPoint {
+  int32_t latitude;  // degrees * 1e6
+  int32_t longitude; // degrees * 1e6
+  int32_t altitude;  // metres * 10
+  uint32_t timestamp; // unix seconds
+};
+
+// Streaming line simplification for the GPS track (the "opening window"
+// form of Douglas-Peucker). Fixes are buffered from the last kept point
+// until one of them would be further than the tolerance from the straight
+// line to the newest fix; the fix before that is kept and starts the next
+// window. Joining the kept points with straight lines then reproduces
+// every fix to within the tolerance, so a straight road costs two points
+// and a turn keeps its full resolution. Memory is fixed.
+class TrackCompressor {
+ public:
+  void begin(float tolerance_m);
+
+  void add(const TrackPoint &fix);
+  // keeps the newest fix, so the published track reaches the current position
+  void flush();
+
+  // copies up to max_points of the oldest kept points without removing them
+  size_t peek(TrackPoint *out, size_t max_points) const;
+  void pop(size_t n);
+
+  size_t size() const { return count; }
+  uint32_t dropped() const { return evicted; }
+
+ private:
+  bool fits(const TrackPoint &end) const;
+  void keep(const TrackPoint &p);
+
+  float tolerance = 10;
+  bool anchored = false;
+  TrackPoint anchor = {};
+  TrackPoint window[TRACK_WINDOW] = {};
+  size_t window_len = 0;
+
+  TrackPoint kept[TRACK_MAX_POINTS] = {};
+  size_t head = 0;
+  size_t count = 0;
+  uint32_t evicted = 0;
+};
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef WIRE_FORMAT_H
+#define WIRE_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+// Compile-time described fixed-point record layouts. A layout is a list of
+// field descriptors; encode() takes exactly one value per field (checked
+// at compile time) and writes them as little-endian scaled integers, or
+// format() writes the same fixed-point values as comma separated text.
+// Both go straight into the caller's buffer, with no heap and no
+// intermediate strings, and the sizes are compile-time constants so
+// buffers can be checked against them.
+//
+//   typedef wire::Layout<wire::Fixed<int32_t, 6>, wire::Fixed<uint16_t, 1> > Fix;
+//   uint8_t buf[Fix::size];
+//   Fix::encode(buf, latitude, speed_kph);
+
+namespace wire {
+
+template <int N>
+struct Pow10 {
+  static const int64_t value = 10 * Pow10<N - 1>::value;
+};
+
+template <>
+struct Pow10<0> {
+  static const int64_t value = 1;
+};
+
+// A value stored as Wire, scaled by 10^Decimals and clamped to [Lo, Hi].
+// Floating point values are scaled in their own precision, like the
+// roundf() they replace; integers are scaled exactly.
+template <typename Wire, int Decimals, long long Lo = std::numeric_limits<Wire>::min(),
+          long long Hi = std::numeric_limits<Wire>::max()>
+struct Fixed {
+  static_assert(std::numeric_limits<Wire>::is_integer && sizeof(Wire) <= 4,
+                "wire type must be an integer of at most 32 bits");
+  static_assert(Decimals >= 0 && Decimals <= 6, "at most 6 decimals");
+  static_assert(Lo >= (long long)std::numeric_limits<Wire>::min() &&
+                Hi <= (long long)std::numeric_limits<Wire>::max() && Lo <= Hi,
+                "range must fit the wire type");
+
+  typedef Wire wire_type;
+  static const size_t size = sizeof(Wire);
+  // digits of the widest value; format() pads small ones to one digit
+  // before the point, e.g. 0.000001
+  static const size_t wire_digits = sizeof(Wire) == 1 ? 3 : sizeof(Wire) == 2 ? 5 : 10;
+  // sign, digits and decimal point
+  static const size_t text_size = 1 + (wire_digits > Decimals ? wire_digits : Decimals + 1) + 1;
+
+  template <typename T>
+  static typename std::enable_if<std::is_floating_point<T>::value, int64_t>::type scaled(T value) {
+    T v = std::round(value * (T)Pow10<Decimals>::value);
+    if (!(v > (T)Lo)) return Lo; // also catches NaN
+    if (v >= (T)Hi) return Hi;
+    return (int64_t)v;
+  }
+
+  template <typename T>
+  static typename std::enable_if<std::is_integral<T>::value, int64_t>::type scaled(T value) {
+    int64_t v = (int64_t)value * Pow10<Decimals>::value;
+    if (v < Lo) return Lo;
+    if (v > Hi) return Hi;
+    return v;
+  }
+
+  template <typename T>
+  static uint8_t *write(uint8_t *p, T value) {
+    uint32_t v = (uint32_t)(Wire)scaled(value);
+    for (size_t i = 0; i < size; i++) {
+      *p++ = v & 0xff;
+      v >>= 8;
+    }
+    return p;
+  }
+
+  template <typename T>
+  static char *format(char *p, T value) {
+    int64_t v = scaled(value);
+    if (v < 0) {
+      *p++ = '-';
+      v = -v;
+    }
+    // digits are produced backwards into a scratch buffer
+    char digits[24];
+    int n = 0;
+    do {
+      digits[n++] = '0' + (char)(v % 10);
+      v /= 10;
+    } while (v > 0 || n <= Decimals);
+    while (n > 0) {
+      if (n == Decimals) *p++ = '.';
+      *p++ = digits[--n];
+    }
+    return p;
+  }
+};
+
+template <typename... Fields>
+struct Layout;
+
+template <>
+struct Layout<> {
+  static const size_t size = 0;
+  static const size_t fields = 0;
+  static const size_t text_size = 1; // the terminator
+
+  static uint8_t *encodeFields(uint8_t *p) { return p; }
+  static char *formatFields(char *p) { return p; }
+};
+
+template <typename Field, typename... Rest>
+struct Layout<Field, Rest...> {
+  static const size_t size = Field::size + Layout<Rest...>::size;
+  static const size_t fields = 1 + sizeof...(Rest);
+  // every field at its widest, with separators and the terminator
+  static const size_t text_size = Field::text_size + 1 + Layout<Rest...>::text_size;
+
+  // writes exactly size bytes and returns size
+  template <typename... Values>
+  static size_t encode(uint8_t *out, Values... values) {
+    static_assert(sizeof...(Values) == fields, "one value per field");
+    return encodeFields(out, values...) - out;
+  }
+
+  // writes the comma separated text, at most text_size bytes including the
+  // terminator, and returns its length
+  template <typename... Values>
+  static size_t format(char *out, Values... values) {
+    static_assert(sizeof...(Values) == fields, "one value per field");
+    char *end = formatFields(out, values...);
+    *end = 0;
+    return end - out;
+  }
+
+  template <typename Value, typename... Values>
+  static uint8_t *encodeFields(uint8_t *p, Value value, Values... values) {
+    return Layout<Rest...>::encodeFields(Field::write(p, value), values...);
+  }
+
+  template <typename Value, typename... Values>
+  static char *formatFields(char *p, Value value, Values... values) {
+    p = Field::format(p, value);
+    if (sizeof...(Rest) > 0) *p++ = ',';
+    return Layout<Rest...>::formatFields(p, values...);
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,23 @@
+// BME280 stand-in reporting the simulated environment. Each read costs the
+// I2C transfer time of the real part.
+
+#ifndef SIM_ADAFRUIT_BME280_H
+#define SIM_ADAFRUIT_BME280_H
+
+#include <math.h>
+#include "Arduino.h"
+#include "Adafruit_Sensor.h"
+
+class Adafruit_BME280 {
+ public:
+  bool begin(uint8_t addr = 0x77) { (void)addr; return true; }
+  float readTemperature() { delayMicroseconds(300); return sim::env().temperature_c; }
+  float readPressure() { delayMicroseconds(300); return sim::env().pressure_pa; }
+  float readHumidity() { delayMicroseconds(300); return sim::env().humidity_pct; }
+  float readAltitude(float seaLevel) {
+    float atmospheric = readPressure() / 100.0F;
+    return 44330.0 * (1.0 - pow(atmospheric / seaLevel, 0.1903));
+  }
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include "Adafruit_FONA.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+// the real driver gives up on a reply after roughly this long
+const unsigned long reply_timeout_ms = 500;
+
+bool contains(const std::string &s, const char *what) { return s.find(what) != std::string::npos; }
+}
+
+std::string Adafruit_FONA::transact(const std::string &cmd) {
+  std::string reply = sim::modem().transact(cmd);
+  if (reply.empty()) delay(reply_timeout_ms);
+  return reply;
+}
+
+bool Adafruit_FONA::checkReply(const std::string &cmd, const char *expect) {
+  return contains(transact(cmd), expect);
+}
+
+bool Adafruit_FONA::begin(Stream &port) {
+  port_ = &port;
+  bool ok = false;
+  for (int tries = 0; tries < 7 && !ok; tries++) {
+    ok = checkReply("AT");
+    if (!ok) delay(100);
+  }
+  if (!ok) return false;
+  checkReply("ATE0");
+  std::string info = transact("ATI");
+  if (contains(info, "SIM7000A")) type_ = SIM7000A;
+  else if (contains(info, "SIM7000C")) type_ = SIM7000C;
+  else if (contains(info, "SIM7000E")) type_ = SIM7000E;
+  else if (contains(info, "SIM7000G")) type_ = SIM7000G;
+  else if (contains(info, "SIM7500A")) type_ = SIM7500A;
+  else if (contains(info, "SIM7500E")) type_ = SIM7500E;
+  return true;
+}
+
+bool Adafruit_FONA::sendCheckReply(char *send, char *reply, uint16_t timeout) {
+  (void)timeout;
+  return checkReply(send, reply);
+}
+
+bool Adafruit_FONA::sendCheckReply(FONAFlashStringPtr send, FONAFlashStringPtr reply, uint16_t timeout) {
+  (void)timeout;
+  return checkReply(reinterpret_cast<const char *>(send), reinterpret_cast<const char *>(reply));
+}
+
+uint8_t Adafruit_FONA::getIMEI(char *imei) {
+  std::string reply = transact("AT+GSN");
+  size_t n = 0;
+  for (size_t i = 0; i < reply.size() && n < 15; i++)
+    if (isdigit((unsigned char)reply[i])) imei[n++] = reply[i];
+  imei[n] = 0;
+  return (uint8_t)n;
+}
+
+bool Adafruit_FONA::setFunctionality(uint8_t option) {
+  char cmd[16];
+  sprintf(cmd, "AT+CFUN=%u", option);
+  return checkReply(cmd);
+}
+
+bool Adafruit_FONA::setNetworkSettings(FONAFlashStringPtr apn, FONAFlashStringPtr username, FONAFlashStringPtr password) {
+  (void)username; (void)password;
+  apn_ = reinterpret_cast<const char *>(apn);
+  return checkReply("AT+CGDCONT=1,\"IP\",\"" + apn_ + "\"");
+}
+
+bool Adafruit_FONA::setNetLED(bool onoff, uint8_t mode, uint16_t timer_on, uint16_t timer_off) {
+  if (!checkReply(onoff ? "AT+CNETLIGHT=1" : "AT+CNETLIGHT=0")) return false;
+  if (!onoff || mode == 0) return true;
+  char cmd[32];
+  sprintf(cmd, "AT+SLEDS=%u,%u,%u", mode, timer_on, timer_off);
+  return checkReply(cmd);
+}
+
+bool Adafruit_FONA::setPreferredMode(uint8_t mode) {
+  char cmd[16];
+  sprintf(cmd, "AT+CNMP=%u", mode);
+  return checkReply(cmd);
+}
+
+bool Adafruit_FONA::setPreferredLTEMode(uint8_t mode) {
+  char cmd[16];
+  sprintf(cmd, "AT+CMNB=%u", mode);
+  return checkReply(cmd);
+}
+
+bool Adafruit_FONA::enableRTC(uint8_t i) {
+  return checkReply(i ? "AT+CLTS=1" : "AT+CLTS=0");
+}
+
+bool Adafruit_FONA::enableSleepMode(bool onoff) {
+  return checkReply(onoff ? "AT+CSCLK=1" : "AT+CSCLK=0");
+}
+
+bool Adafruit_FONA::set_eDRX(uint8_t mode, uint8_t connType, char *eDRX_val) {
+  char cmd[40];
+  sprintf(cmd, "AT+CEDRXS=%u,%u,\"%s\"", mode, connType, eDRX_val);
+  return checkReply(cmd);
+}
+
+bool Adafruit_FONA::enablePSM(bool onoff) {
+  return checkReply(onoff ? "AT+CPSMS=1" : "AT+CPSMS=0");
+}
+
+bool Adafruit_FONA::getTime(char *buff, uint16_t maxlen) {
+  std::string reply = transact("AT+CCLK?");
+  size_t q = reply.find('"');
+  if (q == std::string::npos || maxlen == 0) return false;
+  size_t e = reply.find('"', q + 1);
+  std::string t = reply.substr(q, e == std::string::npos ? std::string::npos : e - q + 1);
+  strncpy(buff, t.c_str(), maxlen - 1);
+  buff[maxlen - 1] = 0;
+  return true;
+}
+
+uint8_t Adafruit_FONA::getRSSI() {
+  std::string reply = transact("AT+CSQ");
+  size_t p = reply.find("+CSQ: ");
+  return p == std::string::npos ? 99 : (uint8_t)atoi(reply.c_str() + p + 6);
+}
+
+uint8_t Adafruit_FONA::getNetworkStatus() {
+  std::string reply = transact("AT+CGREG?");
+  size_t p = reply.find(',');
+  return p == std::string::npos ? 4 : (uint8_t)atoi(reply.c_str() + p + 1);
+}
+
+bool Adafruit_FONA::enableGPS(bool onoff) {
+  return checkReply(onoff ? "AT+CGNSPWR=1" : "AT+CGNSPWR=0");
+}
+
+int8_t Adafruit_FONA::GPSstatus() {
+  std::string reply = transact("AT+CGNSINF");
+  size_t p = reply.find("+CGNSINF: ");
+  if (p == std::string::npos) return -1;
+  int run = 0, fix = 0;
+  if (sscanf(reply.c_str() + p + 10, "%d,%d", &run, &fix) < 1) return -1;
+  if (!run) return 0;
+  return fix ? 3 : 1;
+}
+
+bool Adafruit_FONA::getGPS(float *lat, float *lon, float *speed_kph, float *heading, float *altitude,
+                           uint16_t *year, uint8_t *month, uint8_t *day, uint8_t *hour,
+                           uint8_t *min, float *sec) {
+  // +CGNSINF: <run>,<fix>,<utc yyyyMMddhhmmss.sss>,<lat>,<lon>,<alt>,<speed>,<course>,...
+  std::string reply = transact("AT+CGNSINF");
+  size_t p = reply.find("+CGNSINF: ");
+  if (p == std::string::npos) return false;
+  int run, fix;
+  char utc[24];
+  float la, lo, alt, spd, crs;
+  if (sscanf(reply.c_str() + p + 10, "%d,%d,%23[^,],%f,%f,%f,%f,%f",
+             &run, &fix, utc, &la, &lo, &alt, &spd, &crs) != 8 || !fix)
+    return false;
+  *lat = la;
+  *lon = lo;
+  if (speed_kph) *speed_kph = spd;
+  if (heading) *heading = crs;
+  if (altitude) *altitude = alt;
+  int y, mo, d, h, mi;
+  float s;
+  if (sscanf(utc, "%4d%2d%2d%2d%2d%f", &y, &mo, &d, &h, &mi, &s) == 6) {
+    if (year) *year = y;
+    if (month) *month = mo;
+    if (day) *day = d;
+    if (hour) *hour = h;
+    if (min) *min = mi;
+    if (sec) *sec = s;
+  }
+  return true;
+}
+
+bool Adafruit_FONA::enableGPRS(bool onoff) {
+  if (!onoff) return checkReply("AT+CNACT=0");
+  if (!checkReply("AT+CGATT=1")) return false;
+  return checkReply("AT+CNACT=1,\"" + apn_ + "\"");
+}
+
+bool Adafruit_FONA::setHTTPSRedirect(bool onoff) {
+  return checkReply(onoff ? "AT+HTTPPARA=\"REDIR\",1" : "AT+HTTPPARA=\"REDIR\",0");
+}
+
+bool Adafruit_FONA::MQTT_setParameter(const char *paramTag, const char *paramValue, uint16_t port) {
+  char cmd[160];
+  if (port) snprintf(cmd, sizeof(cmd), "AT+SMCONF=\"%s\",\"%s\",\"%u\"", paramTag, paramValue, port);
+  else snprintf(cmd, sizeof(cmd), "AT+SMCONF=\"%s\",\"%s\"", paramTag, paramValue);
+  return checkReply(cmd);
+}
+
+bool Adafruit_FONA::MQTT_connect(bool yesno) {
+  return checkReply(yesno ? "AT+SMCONN" : "AT+SMDISC");
+}
+
+bool Adafruit_FONA::MQTT_connectionStatus() {
+  return contains(transact("AT+SMSTATE?"), "+SMSTATE: 1");
+}
+
+bool Adafruit_FONA::MQTT_subscribe(const char *topic, byte QoS) {
+  char cmd[80];
+  snprintf(cmd, sizeof(cmd), "AT+SMSUB=\"%s\",%u", topic, QoS);
+  return checkReply(cmd);
+}
+
+bool Adafruit_FONA::MQTT_unsubscribe(const char *topic) {
+  char cmd[80];
+  snprintf(cmd, sizeof(cmd), "AT+SMUNSUB=\"%s\"", topic);
+  return checkReply(cmd);
+}
+
+bool Adafruit_FONA::MQTT_publish(const char *topic, const char *message, uint16_t contentLength, byte QoS, byte retain) {
+  char cmd[80];
+  snprintf(cmd, sizeof(cmd), "AT+SMPUB=\"%s\",%u,%u,%u", topic, contentLength, QoS, retain);
+  if (!checkReply(cmd, ">")) return false;
+  std::string reply = sim::modem().sendPayload(message, contentLength);
+  if (reply.empty()) delay(reply_timeout_ms);
+  return contains(reply, "OK");
+}
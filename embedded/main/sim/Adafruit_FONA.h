@@ -0,0 +1,88 @@
+// Stand-in for the Botletics SIMCom driver. Each call sends the same AT
+// command the real driver would and interprets the scripted reply, so the
+// cost of every call is whatever the loaded modem script says it is.
+
+#ifndef SIM_ADAFRUIT_FONA_H
+#define SIM_ADAFRUIT_FONA_H
+
+#include <string>
+#include "Arduino.h"
+
+#define SIM800L 1
+#define SIM800H 2
+#define SIM808_V1 3
+#define SIM808_V2 4
+#define SIM5320A 5
+#define SIM5320E 6
+#define SIM7000A 7
+#define SIM7000C 8
+#define SIM7000E 9
+#define SIM7000G 10
+#define SIM7500A 11
+#define SIM7500E 12
+
+typedef const __FlashStringHelper *FONAFlashStringPtr;
+
+class Adafruit_FONA : public Stream {
+ public:
+  Adafruit_FONA() {}
+  bool begin(Stream &port);
+  uint8_t type() { return type_; }
+
+  int available() override { return port_ ? port_->available() : 0; }
+  int read() override { return port_ ? port_->read() : -1; }
+  int peek() override { return port_ ? port_->peek() : -1; }
+  size_t write(uint8_t c) override { return port_ ? port_->write(c) : 0; }
+  using Print::write;
+
+  bool sendCheckReply(char *send, char *reply, uint16_t timeout = 500);
+  bool sendCheckReply(FONAFlashStringPtr send, FONAFlashStringPtr reply, uint16_t timeout = 500);
+
+  uint8_t getIMEI(char *imei);
+  bool setFunctionality(uint8_t option);
+  bool setNetworkSettings(FONAFlashStringPtr apn, FONAFlashStringPtr username = 0, FONAFlashStringPtr password = 0);
+  bool setNetLED(bool onoff, uint8_t mode = 0, uint16_t timer_on = 64, uint16_t timer_off = 3000);
+  bool setPreferredMode(uint8_t mode);
+  bool setPreferredLTEMode(uint8_t mode);
+  bool enableRTC(uint8_t i);
+  bool enableSleepMode(bool onoff);
+  bool set_eDRX(uint8_t mode, uint8_t connType, char *eDRX_val);
+  bool enablePSM(bool onoff);
+  bool getTime(char *buff, uint16_t maxlen);
+  uint8_t getRSSI();
+  uint8_t getNetworkStatus();
+
+  // GPS
+  bool enableGPS(bool onoff);
+  int8_t GPSstatus();
+  bool getGPS(float *lat, float *lon, float *speed_kph = 0, float *heading = 0, float *altitude = 0,
+              uint16_t *year = NULL, uint8_t *month = NULL, uint8_t *day = NULL, uint8_t *hour = NULL,
+              uint8_t *min = NULL, float *sec = NULL);
+
+  // data
+  bool enableGPRS(bool onoff);
+  bool setHTTPSRedirect(bool onoff);
+
+  // MQTT
+  bool MQTT_setParameter(const char *paramTag, const char *paramValue, uint16_t port = 0);
+  bool MQTT_connect(bool yesno);
+  bool MQTT_connectionStatus();
+  bool MQTT_subscribe(const char *topic, byte QoS);
+  bool MQTT_unsubscribe(const char *topic);
+  bool MQTT_publish(const char *topic, const char *message, uint16_t contentLength, byte QoS, byte retain);
+
+ protected:
+  std::string transact(const std::string &cmd);
+  bool checkReply(const std::string &cmd, const char *expect = "OK");
+
+  Stream *port_ = NULL;
+  uint8_t type_ = 0;
+  std::string apn_;
+};
+
+class Adafruit_FONA_LTE : public Adafruit_FONA {
+ public:
+  Adafruit_FONA_LTE() {}
+};
+
+#endif
@@ -0,0 +1,103 @@
+// INA260 stand-in. Like the real library it reports mV, mA and mW. The
+// current is the scripted board load plus what the simulated modem draws
+// at that moment, so transmit bursts show up, and move_current_ma while
+// the bike moves. The ALERT pin itself is not modelled: conversionReady()
+// is always true, and the over-current flag is computed when it is read.
+
+#ifndef SIM_ADAFRUIT_INA260_H
+#define SIM_ADAFRUIT_INA260_H
+
+#include "Arduino.h"
+
+typedef enum _count {
+  INA260_COUNT_1,
+  INA260_COUNT_4,
+  INA260_COUNT_16,
+  INA260_COUNT_64,
+  INA260_COUNT_128,
+  INA260_COUNT_256,
+  INA260_COUNT_512,
+  INA260_COUNT_1024,
+} INA260_AveragingCount;
+
+typedef enum _conversion_time {
+  INA260_TIME_140_us,
+  INA260_TIME_204_us,
+  INA260_TIME_332_us,
+  INA260_TIME_588_us,
+  INA260_TIME_1_1_ms,
+  INA260_TIME_2_116_ms,
+  INA260_TIME_4_156_ms,
+  INA260_TIME_8_244_ms,
+} INA260_ConversionTime;
+
+typedef enum _mode {
+  INA260_MODE_SHUTDOWN = 0x00,
+  INA260_MODE_TRIGGERED = 0x03,
+  INA260_MODE_CONTINUOUS = 0x07,
+} INA260_MeasurementMode;
+
+typedef enum _alert_type {
+  INA260_ALERT_CONVERSION_READY = 0x1,
+  INA260_ALERT_OVERPOWER = 0x2,
+  INA260_ALERT_UNDERVOLTAGE = 0x4,
+  INA260_ALERT_OVERVOLTAGE = 0x8,
+  INA260_ALERT_UNDERCURRENT = 0x10,
+  INA260_ALERT_OVERCURRENT = 0x20,
+  INA260_ALERT_NONE = 0x0,
+} INA260_AlertType;
+
+typedef enum _alert_polarity {
+  INA260_ALERT_POLARITY_NORMAL = 0x0,
+  INA260_ALERT_POLARITY_INVERTED = 0x1,
+} INA260_AlertPolarity;
+
+typedef enum _alert_latch {
+  INA260_ALERT_LATCH_ENABLED = 0x1,
+  INA260_ALERT_LATCH_TRANSPARENT = 0x0,
+} INA260_AlertLatch;
+
+class Adafruit_INA260 {
+ public:
+  bool begin(uint8_t addr = 0x40) { (void)addr; return true; }
+  void setAveragingCount(INA260_AveragingCount count) { (void)count; }
+  void setVoltageConversionTime(INA260_ConversionTime time) { (void)time; }
+  void setCurrentConversionTime(INA260_ConversionTime time) { (void)time; }
+  void setMode(INA260_MeasurementMode mode) { (void)mode; }
+  void setAlertType(INA260_AlertType type) {
+    alert_type_ = type;
+    alert_since_us_ = sim::clock::micros();
+  }
+  void setAlertLimit(float limit) { alert_limit_ = limit; }
+  void setAlertPolarity(INA260_AlertPolarity polarity) { (void)polarity; }
+  void setAlertLatch(INA260_AlertLatch latch) { (void)latch; }
+  bool conversionReady() { delayMicroseconds(200); return true; }
+  // over-current since the alert was set, counting only scripted movement
+  bool alertFunctionFlag() {
+    delayMicroseconds(200);
+    uint64_t now = sim::clock::micros();
+    bool moved = sim::motion().movedBetween(alert_since_us_, now);
+    alert_since_us_ = now;
+    return alert_type_ == INA260_ALERT_OVERCURRENT && moved &&
+           sim::env().current_ma + sim::env().move_current_ma > alert_limit_;
+  }
+  float readBusVoltage() { delayMicroseconds(200); return sim::env().bus_voltage_mv; }
+  float readCurrent() { delayMicroseconds(200); return draw(); }
+  float readPower() {
+    delayMicroseconds(200);
+    return sim::env().bus_voltage_mv * draw() / 1000.0F;
+  }
+
+ private:
+  float draw() {
+    float ma = sim::env().current_ma + sim::modem().currentMa();
+    if (sim::motion().moving(sim::clock::micros())) ma += sim::env().move_current_ma;
+    return ma;
+  }
+
+  INA260_AlertType alert_type_ = INA260_ALERT_NONE;
+  float alert_limit_ = 0;
+  uint64_t alert_since_us_ = 0;
+};
+
+#endif
@@ -0,0 +1,55 @@
+// MPU6050 stand-in, only the motion interrupt the tracker uses to wake.
+// The interrupt latches when the scripted bike moves (sim::motion())
+// while it is enabled; its threshold and timing are not modelled.
+
+#ifndef SIM_ADAFRUIT_MPU6050_H
+#define SIM_ADAFRUIT_MPU6050_H
+
+#include "Arduino.h"
+
+typedef enum {
+  MPU6050_HIGHPASS_DISABLE,
+  MPU6050_HIGHPASS_5_HZ,
+  MPU6050_HIGHPASS_2_5_HZ,
+  MPU6050_HIGHPASS_1_25_HZ,
+  MPU6050_HIGHPASS_0_63_HZ,
+  MPU6050_HIGHPASS_UNUSED,
+  MPU6050_HIGHPASS_HOLD,
+} mpu6050_highpass_t;
+
+typedef enum {
+  MPU6050_CYCLE_1_25_HZ,
+  MPU6050_CYCLE_5_HZ,
+  MPU6050_CYCLE_20_HZ,
+  MPU6050_CYCLE_40_HZ,
+} mpu6050_cycle_rate_t;
+
+class Adafruit_MPU6050 {
+ public:
+  bool begin(uint8_t addr = 0x68) { (void)addr; enabled_ = false; return true; }
+  void setHighPassFilter(mpu6050_highpass_t bandwidth) { (void)bandwidth; }
+  void setMotionDetectionThreshold(uint8_t thr) { (void)thr; }
+  void setMotionDetectionDuration(uint8_t dur) { (void)dur; }
+  void setInterruptPinPolarity(bool active_low) { (void)active_low; }
+  void setInterruptPinLatch(bool held) { (void)held; }
+  void setCycleRate(mpu6050_cycle_rate_t rate) { (void)rate; }
+  void enableSleep(bool enable) { (void)enable; }
+  void enableCycle(bool enable) { (void)enable; }
+  void setMotionInterrupt(bool active) {
+    enabled_ = active;
+    since_us_ = sim::clock::micros();
+  }
+  // reading the status clears the latch
+  bool getMotionInterruptStatus() {
+    uint64_t now = sim::clock::micros();
+    bool moved = enabled_ && sim::motion().movedBetween(since_us_, now);
+    since_us_ = now;
+    return moved;
+  }
+
+ private:
+  bool enabled_ = false;
+  uint64_t since_us_ = 0;
+};
+
+#endif
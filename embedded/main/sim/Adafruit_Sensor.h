@@ -0,0 +1,6 @@
+#ifndef SIM_ADAFRUIT_SENSOR_H
+#define SIM_ADAFRUIT_SENSOR_H
+
+#define SENSORS_PRESSURE_SEALEVELHPA (1013.25F)
+
+#endif
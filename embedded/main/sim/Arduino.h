@@ -0,0 +1,144 @@
+// Host-side stand-in for the Arduino core, just enough for src/main.cpp to
+// build with the native PlatformIO environment. Time comes from the
+// simulated clock in sim.h, so delay() returns immediately but moves millis().
+
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <string>
+
+#include "sim.h"
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x02
+#define INPUT_PULLUP 0x05
+
+#define DEC 10
+#define HEX 16
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+inline unsigned long millis() { return (unsigned long)(sim::clock::sinceBoot() / 1000); }
+inline unsigned long micros() { return (unsigned long)sim::clock::sinceBoot(); }
+inline void delay(unsigned long ms) { sim::clock::advance(ms * 1000ULL); }
+inline void delayMicroseconds(unsigned int us) { sim::clock::advance(us); }
+inline void yield() {}
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+// interrupts are never raised in the simulation
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+#define digitalPinToInterrupt(p) (p)
+inline void attachInterrupt(uint8_t pin, void (*isr)(void), int mode) { (void)pin; (void)isr; (void)mode; }
+int analogRead(uint8_t pin);
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+// deterministic, so runs repeat
+inline long random(long howbig) { return howbig > 0 ? rand() % howbig : 0; }
+inline long random(long howsmall, long howbig) { return howsmall + random(howbig - howsmall); }
+
+char *dtostrf(double val, signed char width, unsigned char prec, char *sout);
+
+// ESP32 core: the firmware turns Bluetooth off during setup()
+inline bool btStop() { return true; }
+
+class String {
+ public:
+  String() {}
+  String(const char *s) : s_(s ? s : "") {}
+  String(const std::string &s) : s_(s) {}
+  String &operator=(const char *s) { s_ = s ? s : ""; return *this; }
+  const char *c_str() const { return s_.c_str(); }
+  unsigned int length() const { return (unsigned int)s_.size(); }
+  int indexOf(const char *s) const {
+    size_t i = s_.find(s);
+    return i == std::string::npos ? -1 : (int)i;
+  }
+  String substring(unsigned int from) const {
+    return from >= s_.size() ? String() : String(s_.substr(from));
+  }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) { unsigned int t = from; from = to; to = t; }
+    if (from >= s_.size()) return String();
+    return String(s_.substr(from, to - from));
+  }
+  bool operator==(const char *s) const { return s_ == s; }
+  bool operator!=(const char *s) const { return s_ != s; }
+
+ private:
+  std::string s_;
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+  }
+  size_t write(const char *str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+  size_t write(char c) { return write((uint8_t)c); }
+
+  size_t print(const __FlashStringHelper *s) { return write(reinterpret_cast<const char *>(s)); }
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(const char *s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+
+  size_t println() { return write("\r\n"); }
+  template <typename T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+  template <typename T> size_t println(const T &v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual void flush() {}
+  size_t readBytes(char *buffer, size_t length);
+};
+
+// Serial is the console; output goes to stdout unless the harness is quiet
+class SimConsole : public Stream {
+ public:
+  void begin(unsigned long baud) { (void)baud; }
+  void flush() override { fflush(stdout); }
+  operator bool() const { return true; }
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t c) override;
+  using Print::write;
+};
+
+extern SimConsole Serial;
+
+#endif
@@ -0,0 +1,35 @@
+// ESP32 HardwareSerial stand-in. UART 1 is wired to the simulated modem,
+// every other port is a sink.
+
+#ifndef SIM_HARDWARESERIAL_H
+#define SIM_HARDWARESERIAL_H
+
+#include "Arduino.h"
+
+#define SERIAL_8N1 0x800001c
+
+class HardwareSerial : public Stream {
+ public:
+  explicit HardwareSerial(int uart_nr) : uart_nr_(uart_nr) {}
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1) {
+    (void)config; (void)rxPin; (void)txPin;
+    baud_ = baud;
+    if (uart_nr_ == 1) sim::modem().setBaud(baud);
+  }
+  void end() {}
+  unsigned long baudRate() const { return baud_; }
+  int available() override { return uart_nr_ == 1 ? sim::modem().available() : 0; }
+  int read() override { return uart_nr_ == 1 ? sim::modem().read() : -1; }
+  int peek() override { return uart_nr_ == 1 ? sim::modem().peek() : -1; }
+  size_t write(uint8_t c) override {
+    if (uart_nr_ == 1) sim::modem().write(c);
+    return 1;
+  }
+  using Print::write;
+
+ private:
+  int uart_nr_;
+  unsigned long baud_ = 0;
+};
+
+#endif
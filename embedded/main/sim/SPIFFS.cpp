@@ -0,0 +1,55 @@
+#include "SPIFFS.h"
+
+fs::FS SPIFFS;
+
+namespace fs {
+
+namespace {
+// rough SPIFFS cost per page-sized access on the ESP32's external flash
+const uint32_t page_size = 256;
+const uint32_t page_read_us = 60;
+const uint32_t page_write_us = 600;
+
+uint32_t pages(size_t bytes) { return (uint32_t)((bytes + page_size - 1) / page_size); }
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  if (!data_) return false;
+  size_t base = mode == SeekSet ? 0 : mode == SeekCur ? pos_ : data_->size();
+  if (base + pos > data_->size()) return false;
+  pos_ = base + pos;
+  return true;
+}
+
+size_t File::read(uint8_t *buf, size_t size) {
+  if (!data_) return 0;
+  size_t n = data_->size() - pos_ < size ? data_->size() - pos_ : size;
+  memcpy(buf, data_->data() + pos_, n);
+  pos_ += n;
+  delayMicroseconds(pages(n) * page_read_us);
+  return n;
+}
+
+size_t File::write(const uint8_t *buf, size_t size) {
+  if (!data_ || !writable_) return 0;
+  if (pos_ + size > data_->size()) data_->resize(pos_ + size);
+  memcpy(data_->data() + pos_, buf, size);
+  pos_ += size;
+  delayMicroseconds(pages(size) * page_write_us);
+  return size;
+}
+
+File FS::open(const char *path, const char *mode) {
+  std::string m = mode;
+  std::shared_ptr<std::vector<uint8_t> > &data = files_[path];
+  if (m[0] == 'r' && !data) {
+    files_.erase(path);
+    return File();
+  }
+  if (m[0] == 'w' || !data) data = std::make_shared<std::vector<uint8_t> >();
+  File f(data, m[0] != 'r' || m.find('+') != std::string::npos);
+  if (m[0] == 'a') f.seek(0, SeekEnd);
+  return f;
+}
+
+}
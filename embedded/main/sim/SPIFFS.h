@@ -0,0 +1,53 @@
+// In-memory stand-in for the ESP32 SPIFFS partition. Files live for the
+// lifetime of the simulation process.
+
+#ifndef SIM_SPIFFS_H
+#define SIM_SPIFFS_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+class File {
+ public:
+  File() {}
+  File(std::shared_ptr<std::vector<uint8_t> > data, bool writable) : data_(data), writable_(writable) {}
+  operator bool() const { return (bool)data_; }
+  size_t size() const { return data_ ? data_->size() : 0; }
+  size_t position() const { return pos_; }
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t read(uint8_t *buf, size_t size);
+  size_t write(const uint8_t *buf, size_t size);
+  void close() { data_.reset(); }
+
+ private:
+  std::shared_ptr<std::vector<uint8_t> > data_;
+  bool writable_ = false;
+  size_t pos_ = 0;
+};
+
+class FS {
+ public:
+  bool begin(bool formatOnFail = false) { (void)formatOnFail; return true; }
+  File open(const char *path, const char *mode = "r");
+  bool exists(const char *path) const { return files_.count(path) != 0; }
+  bool remove(const char *path) { return files_.erase(path) != 0; }
+  size_t totalBytes() const { return 1472 * 1024; }
+
+ private:
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t> > > files_;
+};
+
+}
+
+using fs::File;
+
+extern fs::FS SPIFFS;
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef SIM_WIFI_H
+#define SIM_WIFI_H
+
+#include "Arduino.h"
+
+#define WIFI_OFF 0
+#define WIFI_STA 1
+
+class SimWiFi {
+ public:
+  bool mode(int m) { (void)m; return true; }
+};
+
+extern SimWiFi WiFi;
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef SIM_WIRE_H
+#define SIM_WIRE_H
+
+#include "Arduino.h"
+
+class TwoWire {
+ public:
+  bool begin() { return true; }
+};
+
+extern TwoWire Wire;
+
+#endif
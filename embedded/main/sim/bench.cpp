@@ -0,0 +1,116 @@
+// Serializer microbenchmark for the native build (`program -b frames`):
+// times one telemetry frame through the text chain the firmware used to
+// publish (dtostrf per field, then sprintf of the pieces), through the
+// binary encoder, and through the same layout formatted as text. Reports
+// wall-clock ns and, on x86, TSC cycles per frame. Host numbers, so only
+// the ratios carry over to the ESP32.
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include "Arduino.h"
+#include "telemetry_frame.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_TSC 1
+#endif
+
+namespace {
+
+const size_t bench_samples = 64;
+
+TelemetrySample samples[bench_samples];
+
+// keeps the optimizer from dropping the work
+volatile uint32_t sink;
+
+void makeSamples() {
+  for (size_t i = 0; i < bench_samples; i++) {
+    TelemetrySample &s = samples[i];
+    s.flags = TELEMETRY_FLAG_FIX | TELEMETRY_FLAG_WEATHER | TELEMETRY_FLAG_TIME;
+    s.timestamp = 1700000000 + i;
+    s.latitude = 40.742702 + i * 1e-5;
+    s.longitude = -74.026983 - i * 1e-5;
+    s.speed_kph = 18.5 + i % 7;
+    s.heading = (i * 37) % 360;
+    s.altitude = 12 + i % 5;
+    s.voltage = 3.95 - i * 1e-3;
+    s.current = 0.085 + i * 1e-3;
+    s.power = s.voltage * s.current;
+    s.battery = 80 - i % 3;
+    s.temperature = 21.37 + i * 0.01;
+    s.pressure = 1013.2 - i * 0.1;
+    s.humidity = 45.5 + i % 11;
+  }
+}
+
+// the location, weather and battery messages as main.cpp built them
+size_t legacyText(const TelemetrySample &s, char *out) {
+  char latBuff[12], longBuff[12], speedBuff[12], headBuff[12], altBuff[12];
+  char tempBuff[12], pressureBuff[12], humidityBuff[12];
+  char voltageBuff[12], currentBuff[12], powerBuff[12], battBuff[12];
+  char locBuff[64], weatherBuff[48], batteryBuff[48];
+  dtostrf(s.latitude, 1, 6, latBuff);
+  dtostrf(s.longitude, 1, 6, longBuff);
+  dtostrf(s.speed_kph, 1, 0, speedBuff);
+  dtostrf(s.heading, 1, 0, headBuff);
+  dtostrf(s.altitude, 1, 1, altBuff);
+  sprintf(locBuff, "%s,%s,%s,%s,%s", speedBuff, latBuff, longBuff, altBuff, headBuff);
+  dtostrf(s.temperature, 1, 2, tempBuff);
+  dtostrf(s.pressure, 1, 2, pressureBuff);
+  dtostrf(s.humidity, 1, 2, humidityBuff);
+  sprintf(weatherBuff, "%s,%s,%s", tempBuff, pressureBuff, humidityBuff);
+  dtostrf(s.voltage, 1, 2, voltageBuff);
+  dtostrf(s.current, 1, 2, currentBuff);
+  dtostrf(s.power, 1, 2, powerBuff);
+  dtostrf(s.battery, 1, 2, battBuff);
+  sprintf(batteryBuff, "%s,%s,%s,%s", voltageBuff, currentBuff, powerBuff, battBuff);
+  return sprintf(out, "%s;%s;%s", locBuff, weatherBuff, batteryBuff);
+}
+
+size_t binaryFrame(const TelemetrySample &s, char *out) {
+  return encodeTelemetryFrame(s, (uint16_t)s.timestamp, (uint8_t *)out);
+}
+
+size_t textFrame(const TelemetrySample &s, char *out) {
+  return formatTelemetry(s, (uint16_t)s.timestamp, out);
+}
+
+void run(const char *name, size_t (*encode)(const TelemetrySample &, char *), unsigned frames) {
+  char out[256];
+  size_t len = encode(samples[0], out);
+  uint32_t total = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#ifdef BENCH_TSC
+  uint64_t tsc = __rdtsc();
+#endif
+  for (unsigned i = 0; i < frames; i++) {
+    total += encode(samples[i % bench_samples], out);
+    total += (uint8_t)out[0];
+  }
+#ifdef BENCH_TSC
+  tsc = __rdtsc() - tsc;
+#endif
+  std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+  sink = total;
+  double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / (double)frames;
+#ifdef BENCH_TSC
+  printf("%-16s %4zu bytes %10.1f ns/frame %10.1f cycles/frame\n", name, len, ns, tsc / (double)frames);
+#else
+  printf("%-16s %4zu bytes %10.1f ns/frame\n", name, len, ns);
+#endif
+}
+
+}
+
+int runBenchmark(unsigned frames) {
+  if (frames == 0) return 2;
+  makeSamples();
+  printf("%u frames\n", frames);
+  run("dtostrf+sprintf", legacyText, frames);
+  run("wire binary", binaryFrame, frames);
+  run("wire text", textFrame, frames);
+  return 0;
+}
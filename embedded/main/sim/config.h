@@ -0,0 +1,3 @@
+// Native builds always use the sample configuration; the simulated broker
+// needs no real credentials
+#include "sampleconfig.h"
@@ -0,0 +1,26 @@
+#ifndef SIM_DRIVER_GPIO_H
+#define SIM_DRIVER_GPIO_H
+
+#include "esp_sleep.h"
+
+typedef enum {
+  GPIO_INTR_DISABLE,
+  GPIO_INTR_POSEDGE,
+  GPIO_INTR_NEGEDGE,
+  GPIO_INTR_ANYEDGE,
+  GPIO_INTR_LOW_LEVEL,
+  GPIO_INTR_HIGH_LEVEL,
+} gpio_int_type_t;
+
+// light sleep GPIO wakeup, see esp_sleep_enable_gpio_wakeup()
+inline int gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+  (void)gpio_num; (void)intr_type;
+  return 0;
+}
+
+inline int gpio_wakeup_disable(gpio_num_t gpio_num) {
+  (void)gpio_num;
+  return 0;
+}
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef SIM_DRIVER_UART_H
+#define SIM_DRIVER_UART_H
+
+typedef int uart_port_t;
+#define UART_NUM_0 0
+#define UART_NUM_1 1
+#define UART_NUM_2 2
+
+inline int uart_set_wakeup_threshold(uart_port_t uart_num, int threshold) {
+  (void)uart_num; (void)threshold;
+  return 0;
+}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef SIM_ESP_ATTR_H
+#define SIM_ESP_ATTR_H
+
+// RTC memory is kept through a simulated deep sleep, the rest of the
+// firmware's RAM is not, see sim::ram
+#define RTC_DATA_ATTR __attribute__((section("rtc_data")))
+#define RTC_NOINIT_ATTR __attribute__((section("rtc_data")))
+#define IRAM_ATTR
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef SIM_ESP_CLK_H
+#define SIM_ESP_CLK_H
+
+#include <stdint.h>
+#include "sim.h"
+
+// the RTC clock keeps running through (simulated) deep sleep
+inline uint64_t esp_clk_rtc_time() { return sim::clock::micros(); }
+
+#endif
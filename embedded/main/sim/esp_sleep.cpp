@@ -0,0 +1,148 @@
+#include "esp_sleep.h"
+
+#include <vector>
+#include "Arduino.h"
+
+// placed by sim/firmware.ld, missing when a build does not link with it
+extern "C" char __firmware_ram_start[] __attribute__((weak));
+extern "C" char __firmware_ram_end[] __attribute__((weak));
+typedef void (*Constructor)();
+extern "C" Constructor __firmware_init_start[] __attribute__((weak));
+extern "C" Constructor __firmware_init_end[] __attribute__((weak));
+
+namespace {
+std::vector<char> power_up_ram;
+
+// AddressSanitizer keeps redzones between the globals, so the firmware's
+// RAM is copied uninstrumented and a byte at a time, never as a memcpy()
+__attribute__((no_sanitize_address)) void copyRam(char *to, const char *from, size_t n) {
+  volatile char *t = to;
+  while (n--) *t++ = *from++;
+}
+
+// what the ESP32 does at every boot, before setup()
+void construct() {
+  if (!__firmware_init_start || !__firmware_init_end) return;
+  for (Constructor *c = __firmware_init_start; c < __firmware_init_end; c++) (*c)();
+}
+
+uint64_t timer_us = 0;
+bool timer_enabled = false;
+bool uart_enabled = false;
+bool ext0_enabled = false;
+bool ext1_enabled = false;
+bool gpio_enabled = false;
+esp_sleep_wakeup_cause_t cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+
+// fast-forwards to the first enabled wake source, returns what fired
+esp_sleep_wakeup_cause_t sleepUntilWake(sim::CpuState state, bool modem_wakes, bool motion_wakes) {
+  uint64_t now = sim::clock::micros();
+  uint64_t wake = UINT64_MAX;
+  esp_sleep_wakeup_cause_t why = ESP_SLEEP_WAKEUP_UNDEFINED;
+  if (timer_enabled) {
+    wake = now + timer_us;
+    why = ESP_SLEEP_WAKEUP_TIMER;
+  }
+  uint64_t rx = sim::modem().nextRxUs();
+  if (modem_wakes && rx < wake) {
+    wake = rx > now ? rx : now;
+    why = uart_enabled ? ESP_SLEEP_WAKEUP_UART : ESP_SLEEP_WAKEUP_EXT0;
+  }
+  uint64_t moved = motion_wakes ? sim::motion().nextStartUs(now) : UINT64_MAX;
+  if (moved < wake) {
+    wake = moved;
+    why = state == sim::CPU_DEEP_SLEEP ? ESP_SLEEP_WAKEUP_EXT1 : ESP_SLEEP_WAKEUP_GPIO;
+  }
+  if (wake == UINT64_MAX) {
+    fprintf(stderr, "sleeping with no wake source\n");
+    exit(1);
+  }
+  sim::power().setCpu(state);
+  sim::clock::advance(wake - now);
+  sim::power().setCpu(sim::CPU_ACTIVE);
+  return why;
+}
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us) {
+  timer_us = time_in_us;
+  timer_enabled = true;
+  return 0;
+}
+
+esp_err_t esp_sleep_enable_uart_wakeup(int uart_num) {
+  uart_enabled = uart_num == 1; // only the modem UART is simulated
+  return 0;
+}
+
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t gpio_num, int level) {
+  (void)gpio_num; (void)level;
+  ext0_enabled = true;
+  return 0;
+}
+
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t mask, esp_sleep_ext1_wakeup_mode_t mode) {
+  (void)mode;
+  ext1_enabled = mask != 0;
+  return 0;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup() {
+  gpio_enabled = true;
+  return 0;
+}
+
+bool esp_sleep_is_valid_wakeup_gpio(gpio_num_t gpio_num) {
+  // the ESP32's RTC GPIOs
+  static const int rtc_gpios[] = { 0, 2, 4, 12, 13, 14, 15, 25, 26, 27, 32, 33, 34, 35, 36, 37, 38, 39 };
+  for (size_t i = 0; i < sizeof(rtc_gpios) / sizeof(rtc_gpios[0]); i++) {
+    if (rtc_gpios[i] == gpio_num) return true;
+  }
+  return false;
+}
+
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_source_t source) {
+  if (source == ESP_SLEEP_WAKEUP_ALL || source == ESP_SLEEP_WAKEUP_TIMER) timer_enabled = false;
+  if (source == ESP_SLEEP_WAKEUP_ALL || source == ESP_SLEEP_WAKEUP_UART) uart_enabled = false;
+  if (source == ESP_SLEEP_WAKEUP_ALL || source == ESP_SLEEP_WAKEUP_EXT0) ext0_enabled = false;
+  if (source == ESP_SLEEP_WAKEUP_ALL || source == ESP_SLEEP_WAKEUP_EXT1) ext1_enabled = false;
+  if (source == ESP_SLEEP_WAKEUP_ALL || source == ESP_SLEEP_WAKEUP_GPIO) gpio_enabled = false;
+  return 0;
+}
+
+esp_err_t esp_light_sleep_start() {
+  cause = sleepUntilWake(sim::CPU_LIGHT_SLEEP, uart_enabled, gpio_enabled);
+  return 0;
+}
+
+void esp_deep_sleep_start() {
+  // the UART is off in deep sleep, only RI (ext0) can report modem activity
+  uart_enabled = false;
+  cause = sleepUntilWake(sim::CPU_DEEP_SLEEP, ext0_enabled, ext1_enabled);
+  timer_enabled = ext0_enabled = ext1_enabled = gpio_enabled = false;
+  sim::clock::reboot();
+  throw sim::DeepSleepReset();
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+  return cause;
+}
+
+namespace sim {
+namespace ram {
+void snapshot() {
+  construct();
+  if (!__firmware_ram_start || !__firmware_ram_end) {
+    fprintf(stderr, "firmware RAM is not linked apart (sim/firmware.ld), it survives deep sleep\n");
+    return;
+  }
+  power_up_ram.resize(__firmware_ram_end - __firmware_ram_start);
+  copyRam(power_up_ram.data(), __firmware_ram_start, power_up_ram.size());
+}
+
+void powerDown() {
+  if (!power_up_ram.empty()) copyRam(__firmware_ram_start, power_up_ram.data(), power_up_ram.size());
+  construct();
+}
+}
+}
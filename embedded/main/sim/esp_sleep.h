@@ -0,0 +1,48 @@
+// ESP32 sleep API on top of the simulated clock. Light sleep fast-forwards
+// to the timer or to the next byte the modem sends; deep sleep does the same
+// and then restarts the sketch by throwing sim::DeepSleepReset, which the
+// runner catches to reset the firmware's RAM outside RTC memory and call
+// setup() again.
+
+#ifndef SIM_ESP_SLEEP_H
+#define SIM_ESP_SLEEP_H
+
+#include <stdint.h>
+#include "sim.h"
+
+typedef int gpio_num_t;
+
+typedef enum {
+  ESP_SLEEP_WAKEUP_UNDEFINED,
+  ESP_SLEEP_WAKEUP_ALL,
+  ESP_SLEEP_WAKEUP_EXT0,
+  ESP_SLEEP_WAKEUP_EXT1,
+  ESP_SLEEP_WAKEUP_TIMER,
+  ESP_SLEEP_WAKEUP_TOUCHPAD,
+  ESP_SLEEP_WAKEUP_ULP,
+  ESP_SLEEP_WAKEUP_GPIO,
+  ESP_SLEEP_WAKEUP_UART,
+} esp_sleep_source_t;
+
+typedef esp_sleep_source_t esp_sleep_wakeup_cause_t;
+
+typedef enum {
+  ESP_EXT1_WAKEUP_ALL_LOW = 0,
+  ESP_EXT1_WAKEUP_ANY_HIGH = 1,
+} esp_sleep_ext1_wakeup_mode_t;
+typedef int esp_err_t;
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us);
+esp_err_t esp_sleep_enable_uart_wakeup(int uart_num);
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t gpio_num, int level);
+// the motion pins: ext1 in deep sleep, GPIO in light sleep. Both fire when
+// the scripted bike moves, see sim::motion().
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t mask, esp_sleep_ext1_wakeup_mode_t mode);
+esp_err_t esp_sleep_enable_gpio_wakeup();
+bool esp_sleep_is_valid_wakeup_gpio(gpio_num_t gpio_num);
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_source_t source);
+esp_err_t esp_light_sleep_start();
+void esp_deep_sleep_start();
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+
+#endif
@@ -0,0 +1,177 @@
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+#include <vector>
+#include "sim.h"
+
+struct SimTask {
+  ucontext_t context;
+  std::vector<char> stack;
+  TaskFunction_t fn;
+  void *param;
+  uint64_t wake_us;      // UINT64_MAX while only a notification can wake it
+  bool waiting_notify;
+  uint32_t notified;
+  bool done;
+};
+
+struct SimMutex {
+  bool taken;
+};
+
+namespace {
+
+ucontext_t runner;
+std::vector<SimTask *> all;
+std::vector<SimMutex *> mutexes;
+SimTask *current = nullptr;
+
+// the host stack is generous compared to the ESP32's
+const size_t stack_size = 256 * 1024;
+// fills a new stack so the deepest use can be found afterwards
+const char stack_paint = (char)0xa5;
+
+void trampoline() {
+  current->fn(current->param);
+  current->done = true;
+  swapcontext(&current->context, &runner);
+}
+
+// hands control back to the runner until woken
+void block(uint64_t wake_us, bool on_notify) {
+  SimTask *t = current;
+  t->wake_us = wake_us;
+  t->waiting_notify = on_notify;
+  swapcontext(&t->context, &runner);
+}
+
+bool ready(const SimTask *t, uint64_t now) {
+  if (t->done) return false;
+  if (t->waiting_notify && t->notified) return true;
+  return t->wake_us <= now;
+}
+
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core) {
+  (void)name; (void)stack_depth; (void)priority; (void)core;
+  SimTask *t = new SimTask();
+  t->stack.assign(stack_size, stack_paint);
+  getcontext(&t->context);
+  t->context.uc_stack.ss_sp = t->stack.data();
+  t->context.uc_stack.ss_size = t->stack.size();
+  t->context.uc_link = nullptr;
+  makecontext(&t->context, trampoline, 0);
+  t->fn = fn;
+  t->param = param;
+  t->wake_us = sim::clock::micros(); // starts on the next run()
+  t->waiting_notify = false;
+  t->notified = 0;
+  t->done = false;
+  all.push_back(t);
+  if (handle) *handle = t;
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  SimTask *t = task ? task : current;
+  t->done = true;
+  if (t == current) swapcontext(&t->context, &runner);
+}
+
+void vTaskDelay(TickType_t ticks) {
+  block(sim::clock::micros() + (uint64_t)ticks * portTICK_PERIOD_MS * 1000, false);
+}
+
+TickType_t xTaskGetTickCount() {
+  return (TickType_t)(sim::clock::sinceBoot() / 1000 / portTICK_PERIOD_MS);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+  SimTask *t = current;
+  if (!t->notified && ticks_to_wait > 0) {
+    uint64_t wake = ticks_to_wait == portMAX_DELAY
+                        ? UINT64_MAX
+                        : sim::clock::micros() + (uint64_t)ticks_to_wait * portTICK_PERIOD_MS * 1000;
+    block(wake, true);
+  }
+  uint32_t n = t->notified;
+  if (clear_on_exit) t->notified = 0;
+  else if (n) t->notified--;
+  return n;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  task->notified++;
+  return pdPASS;
+}
+
+// AddressSanitizer poisons the redzones of the frames still on the stack,
+// so it is read uninstrumented
+__attribute__((no_sanitize_address)) UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  // the stack grows down, from the end of the buffer
+  const volatile char *p = task->stack.data();
+  UBaseType_t untouched = 0;
+  while (untouched < task->stack.size() && p[untouched] == stack_paint) untouched++;
+  return untouched;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_woken) {
+  task->notified++;
+  if (higher_priority_woken) *higher_priority_woken = pdTRUE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  SimMutex *m = new SimMutex();
+  m->taken = false;
+  mutexes.push_back(m);
+  return m;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks_to_wait) {
+  (void)ticks_to_wait;
+  if (mutex->taken) {
+    fprintf(stderr, "sim: mutex taken twice, this deadlocks on the ESP32\n");
+    abort();
+  }
+  mutex->taken = true;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex) {
+  if (!mutex->taken) return pdFALSE;
+  mutex->taken = false;
+  return pdTRUE;
+}
+
+namespace sim {
+namespace tasks {
+
+void run() {
+  uint64_t now = clock::micros();
+  for (size_t i = 0; i < all.size(); i++) {
+    SimTask *t = all[i];
+    if (!ready(t, now)) continue;
+    // a task only runs between passes of loop(), so it is late by up to a
+    // pass; after a sleep it wakes once, like with the tick suspended
+    current = t;
+    clock::enterTask(now);
+    swapcontext(&runner, &t->context);
+    clock::leaveTask();
+    current = nullptr;
+  }
+}
+
+void reset() {
+  for (size_t i = 0; i < all.size(); i++) delete all[i];
+  all.clear();
+  for (size_t i = 0; i < mutexes.size(); i++) delete mutexes[i];
+  mutexes.clear();
+}
+
+}
+}
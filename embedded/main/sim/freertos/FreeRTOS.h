@@ -0,0 +1,20 @@
+// Minimal FreeRTOS types for the host build, see sim/freertos.cpp.
+
+#ifndef SIM_FREERTOS_H
+#define SIM_FREERTOS_H
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#endif
@@ -0,0 +1,18 @@
+// FreeRTOS mutexes for the host build. Tasks never preempt loop() or each
+// other (see sim/freertos/task.h), so a mutex is always free when taken
+// between blocking calls; taking one twice would deadlock on the ESP32
+// and aborts here instead.
+
+#ifndef SIM_FREERTOS_SEMPHR_H
+#define SIM_FREERTOS_SEMPHR_H
+
+#include "freertos/FreeRTOS.h"
+
+struct SimMutex;
+typedef SimMutex *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks_to_wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex);
+
+#endif
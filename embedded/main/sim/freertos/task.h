@@ -0,0 +1,29 @@
+// FreeRTOS tasks for the host build. Tasks are coroutines that the runner
+// resumes between passes of loop() whenever they are due or notified (see
+// sim::tasks::run()); they keep their own time while running, as if on
+// the second core. Only the calls the firmware uses are provided.
+
+#ifndef SIM_FREERTOS_TASK_H
+#define SIM_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+struct SimTask;
+typedef SimTask *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_woken);
+// in bytes like on the ESP32, but of the much larger host stack
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+// no other task to switch to, but still a statement like the real one
+#define portYIELD_FROM_ISR() do {} while (0)
+
+#endif
@@ -0,0 +1,575 @@
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+
+#include "Arduino.h"
+
+namespace sim {
+
+bool quiet = false;
+
+namespace {
+uint64_t now_us = 0;
+uint64_t boot_us = 0;
+// T3324 and the LTE-M eDRX cycle ("0010" = 20.48 s)
+uint64_t psm_active_timer_us = 10000000;
+uint64_t edrx_cycle_us = 20480000;
+// AT+SMPUB with QoS 0 answers once the message is sent, without the PUBACK
+// round trip a scripted QoS 1 latency includes
+uint32_t qos0_publish_ms = 80;
+// GNSS time to first fix per start, and how long ephemeris stays usable
+enum { GNSS_HOT, GNSS_WARM, GNSS_COLD };
+uint64_t gnss_hot_ttff_us = 2000000;
+uint64_t gnss_warm_ttff_us = 28000000;
+uint64_t gnss_cold_ttff_us = 40000000;
+uint64_t gnss_assisted_ttff_us = 12000000;
+uint64_t gnss_ephemeris_us = 4ULL * 3600 * 1000000;
+// fastest rate the wiring to the modem carries cleanly, above it every
+// wire_error_interval-th byte from the modem arrives garbled
+uint32_t uart_max_baud = 921600;
+const uint32_t wire_error_interval = 50;
+std::map<std::string, size_t> rule_uses;
+
+std::string trim(const std::string &s) {
+  size_t b = s.find_first_not_of(" \t\r\n");
+  if (b == std::string::npos) return "";
+  size_t e = s.find_last_not_of(" \t\r\n");
+  return s.substr(b, e - b + 1);
+}
+
+// expand \r, \n, \\ and \" escapes used in script replies
+std::string unescape(const std::string &s) {
+  std::string out;
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '\\' && i + 1 < s.size()) {
+      char n = s[++i];
+      if (n == 'r') out += '\r';
+      else if (n == 'n') out += '\n';
+      else out += n;
+    } else {
+      out += s[i];
+    }
+  }
+  return out;
+}
+
+bool setEnv(const std::string &name, float value) {
+  Environment &e = env();
+  if (name == "temperature_c") e.temperature_c = value;
+  else if (name == "pressure_pa") e.pressure_pa = value;
+  else if (name == "humidity_pct") e.humidity_pct = value;
+  else if (name == "bus_voltage_mv") e.bus_voltage_mv = value;
+  else if (name == "current_ma") e.current_ma = value;
+  else if (name == "move_current_ma") e.move_current_ma = value;
+  else if (name == "cpu_active_ma") currents().cpu_active_ma = value;
+  else if (name == "cpu_light_sleep_ma") currents().cpu_light_sleep_ma = value;
+  else if (name == "cpu_deep_sleep_ma") currents().cpu_deep_sleep_ma = value;
+  else if (name == "modem_active_ma") currents().modem_active_ma = value;
+  else if (name == "modem_idle_ma") currents().modem_idle_ma = value;
+  else if (name == "modem_edrx_ma") currents().modem_edrx_ma = value;
+  else if (name == "modem_psm_ma") currents().modem_psm_ma = value;
+  else if (name == "gnss_ma") currents().gnss_ma = value;
+  else if (name == "gnss_hot_ttff_ms") gnss_hot_ttff_us = (uint64_t)value * 1000;
+  else if (name == "gnss_warm_ttff_ms") gnss_warm_ttff_us = (uint64_t)value * 1000;
+  else if (name == "gnss_cold_ttff_ms") gnss_cold_ttff_us = (uint64_t)value * 1000;
+  else if (name == "gnss_assisted_ttff_ms") gnss_assisted_ttff_us = (uint64_t)value * 1000;
+  else if (name == "psm_active_timer_ms") psm_active_timer_us = (uint64_t)value * 1000;
+  else if (name == "edrx_cycle_ms") edrx_cycle_us = (uint64_t)value * 1000;
+  else if (name == "qos0_publish_ms") qos0_publish_ms = (uint32_t)value;
+  else if (name == "uart_max_baud") uart_max_baud = (uint32_t)value;
+  else return false;
+  return true;
+}
+}
+
+namespace clock {
+bool in_task = false;
+uint64_t task_us = 0;
+
+uint64_t micros() { return in_task ? task_us : now_us; }
+void advance(uint64_t us) {
+  if (in_task) task_us += us;
+  else now_us += us;
+}
+uint64_t sinceBoot() { return micros() - boot_us; }
+void reboot() { boot_us = now_us; }
+void enterTask(uint64_t us) {
+  in_task = true;
+  task_us = us;
+}
+void leaveTask() { in_task = false; }
+}
+
+CurrentModel &currents() {
+  static CurrentModel c;
+  return c;
+}
+
+void PowerMeter::settle() {
+  cpu_us_[cpu_] += now_us - since_us_;
+  since_us_ = now_us;
+}
+
+void PowerMeter::setCpu(CpuState s) {
+  settle();
+  cpu_ = s;
+}
+
+PowerMeter &power() {
+  static PowerMeter p;
+  return p;
+}
+
+Environment &env() {
+  static Environment e;
+  return e;
+}
+
+Modem &modem() {
+  static Modem m;
+  return m;
+}
+
+Motion &motion() {
+  static Motion m;
+  return m;
+}
+
+void Motion::add(uint64_t from_us, uint64_t to_us) {
+  Span s = { from_us, to_us };
+  spans_.push_back(s);
+}
+
+bool Motion::moving(uint64_t at_us) const {
+  return movedBetween(at_us, at_us);
+}
+
+bool Motion::movedBetween(uint64_t from_us, uint64_t to_us) const {
+  for (size_t i = 0; i < spans_.size(); i++) {
+    if (spans_[i].from_us <= to_us && spans_[i].to_us >= from_us) return true;
+  }
+  return false;
+}
+
+uint64_t Motion::nextStartUs(uint64_t at_us) const {
+  uint64_t next = UINT64_MAX;
+  for (size_t i = 0; i < spans_.size(); i++) {
+    if (spans_[i].to_us < at_us) continue;
+    uint64_t start = spans_[i].from_us > at_us ? spans_[i].from_us : at_us;
+    if (start < next) next = start;
+  }
+  return next;
+}
+
+// Script format, one entry per line ('#' starts a comment):
+//   <command prefix> | <latency ms> | <reply>   scripted reply, repeated
+//                                               entries for the same prefix
+//                                               play in order, the last repeats
+//   @<ms> | <text>                              unsolicited result code
+//   set <name> <value>                          sensor environment value
+//   move <from ms> <to ms>                      the bike is moved
+bool Modem::load(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) return false;
+  char buf[512];
+  int lineno = 0;
+  while (fgets(buf, sizeof(buf), f)) {
+    lineno++;
+    std::string line = trim(buf);
+    if (line.empty() || line[0] == '#') continue;
+    if (line.compare(0, 4, "set ") == 0) {
+      char name[64];
+      float value;
+      if (sscanf(line.c_str() + 4, "%63s %f", name, &value) != 2 || !setEnv(name, value))
+        fprintf(stderr, "%s:%d: bad set line\n", path, lineno);
+      continue;
+    }
+    if (line.compare(0, 5, "move ") == 0) {
+      unsigned long long from_ms, to_ms;
+      if (sscanf(line.c_str() + 5, "%llu %llu", &from_ms, &to_ms) != 2 || to_ms < from_ms)
+        fprintf(stderr, "%s:%d: bad move line\n", path, lineno);
+      else
+        motion().add(from_ms * 1000ULL, to_ms * 1000ULL);
+      continue;
+    }
+    size_t bar1 = line.find('|');
+    if (bar1 == std::string::npos) {
+      fprintf(stderr, "%s:%d: missing '|'\n", path, lineno);
+      continue;
+    }
+    if (line[0] == '@') {
+      Urc u;
+      u.at_us = strtoull(line.c_str() + 1, NULL, 10) * 1000ULL;
+      u.text = unescape(trim(line.substr(bar1 + 1)));
+      urcs_.push_back(u);
+      continue;
+    }
+    size_t bar2 = line.find('|', bar1 + 1);
+    if (bar2 == std::string::npos) {
+      fprintf(stderr, "%s:%d: missing reply\n", path, lineno);
+      continue;
+    }
+    Rule r;
+    r.prefix = trim(line.substr(0, bar1));
+    r.latency_ms = (uint32_t)strtoul(trim(line.substr(bar1 + 1, bar2 - bar1 - 1)).c_str(), NULL, 10);
+    r.reply = unescape(trim(line.substr(bar2 + 1)));
+    rules_.push_back(r);
+  }
+  fclose(f);
+  return true;
+}
+
+const Modem::Rule *Modem::match(const std::string &cmd) {
+  // the longest matching prefix wins; its entries are replayed in order
+  size_t best_len = 0;
+  std::string best;
+  for (size_t i = 0; i < rules_.size(); i++) {
+    const std::string &p = rules_[i].prefix;
+    if (p.size() >= best_len && cmd.compare(0, p.size(), p) == 0) {
+      best_len = p.size();
+      best = p;
+    }
+  }
+  if (best_len == 0) return NULL;
+  size_t n = rule_uses[best]++;
+  const Rule *last = NULL;
+  for (size_t i = 0; i < rules_.size(); i++) {
+    if (rules_[i].prefix != best) continue;
+    last = &rules_[i];
+    if (n-- == 0) break;
+  }
+  return last;
+}
+
+uint64_t Modem::psmEntryUs() const {
+  if (!psm_enabled_) return UINT64_MAX;
+  if (asleep_) return idle_since_us_;
+  uint64_t quiet = busy_until_us_ > idle_since_us_ ? busy_until_us_ : idle_since_us_;
+  return quiet + psm_active_timer_us;
+}
+
+uint64_t Modem::urcDeliveryUs(uint64_t at_us) const {
+  // in PSM nothing is delivered until the host wakes the modem
+  if (at_us >= psmEntryUs()) return UINT64_MAX;
+  if (edrx_enabled_ && at_us > busy_until_us_)
+    at_us = (at_us + edrx_cycle_us - 1) / edrx_cycle_us * edrx_cycle_us;
+  return at_us;
+}
+
+void Modem::settle(uint64_t upto_us) {
+  if (upto_us <= idle_since_us_) return;
+  ModemState idle = edrx_enabled_ ? MODEM_EDRX : MODEM_IDLE;
+  uint64_t psm_at = psmEntryUs();
+  if (psm_at < upto_us) {
+    if (psm_at > idle_since_us_) state_us_[idle] += psm_at - idle_since_us_;
+    state_us_[MODEM_PSM] += upto_us - (psm_at > idle_since_us_ ? psm_at : idle_since_us_);
+    if (!asleep_) session_lost_ = true;
+    asleep_ = true;
+  } else {
+    state_us_[idle] += upto_us - idle_since_us_;
+  }
+  idle_since_us_ = upto_us;
+}
+
+void Modem::pwrKeyPulse() {
+  settle(now_us);
+  asleep_ = false;
+}
+
+uint64_t Modem::stateUs(ModemState s) {
+  settle(now_us);
+  return state_us_[s];
+}
+
+float Modem::currentMa() {
+  settle(now_us);
+  const CurrentModel &c = currents();
+  float gnss = gnss_on_ ? c.gnss_ma : 0;
+  if (now_us < busy_until_us_) return c.modem_active_ma + gnss;
+  if (asleep_) return c.modem_psm_ma + gnss;
+  return (edrx_enabled_ ? c.modem_edrx_ma : c.modem_idle_ma) + gnss;
+}
+
+void Modem::releaseUrcs() {
+  settle(now_us);
+  while (!urcs_.empty() && urcDeliveryUs(urcs_.front().at_us) <= now_us) {
+    std::string text = "\r\n" + urcs_.front().text + "\r\n";
+    uint64_t at = urcDeliveryUs(urcs_.front().at_us);
+    uint64_t t = busy_until_us_ > at ? busy_until_us_ : at;
+    for (size_t i = 0; i < text.size(); i++) {
+      t += byteTimeUs();
+      Pending p = { t, onWire(text[i]), true };
+      rx_.push_back(p);
+    }
+    markBusy(t);
+    stats_.bytes_rx += text.size();
+    urcs_.pop_front();
+  }
+}
+
+bool Modem::gnssFixed() const {
+  return gnss_on_ && now_us >= gnss_fix_at_us_;
+}
+
+void Modem::gnssPower(bool on) {
+  if (on == gnss_on_) return;
+  if (on) {
+    gnss_on_ = true;
+    gnss_on_since_us_ = now_us;
+    // resumes with whatever the receiver remembers
+    gnssRestart(GNSS_HOT);
+    return;
+  }
+  if (gnssFixed()) {
+    gnss_memory_ = true;
+    gnss_last_fix_us_ = now_us;
+  }
+  gnss_on_us_ += now_us - gnss_on_since_us_;
+  gnss_on_ = false;
+}
+
+void Modem::gnssRestart(int best) {
+  if (!gnss_on_) return;
+  // a start can use no more than the receiver still has
+  int start = GNSS_COLD;
+  if (gnss_memory_) start = now_us - gnss_last_fix_us_ < gnss_ephemeris_us ? GNSS_HOT : GNSS_WARM;
+  if (best > start) start = best;
+  uint64_t ttff = start == GNSS_HOT ? gnss_hot_ttff_us : start == GNSS_WARM ? gnss_warm_ttff_us
+                : gnss_xtra_ ? gnss_assisted_ttff_us : gnss_cold_ttff_us;
+  gnss_fix_at_us_ = now_us + ttff;
+}
+
+uint64_t Modem::gnssOnUs() const {
+  return gnss_on_us_ + (gnss_on_ ? now_us - gnss_on_since_us_ : 0);
+}
+
+void Modem::execute(const std::string &cmd, size_t payload_len) {
+  static const Rule fallback = { "", 10, "OK" };
+  static const Rule gnss_off = { "", 50, "+CGNSINF: 0,,,,,,,,,,,,,,,,,,,,\r\n\r\nOK" };
+  static const Rule gnss_searching = { "", 50, "+CGNSINF: 1,0,,,,,,,,,,,,,,,,,,,\r\n\r\nOK" };
+  if (payload_len == 0) stats_.commands++;
+  if (cmd.compare(0, 9, "AT+SMPUB=") == 0 && payload_len == 0) {
+    // publish: prompt for the payload now, the scripted reply follows it
+    int len = 0;
+    const char *comma = strchr(cmd.c_str(), ',');
+    if (comma) len = atoi(comma + 1);
+    if (len > 0) {
+      payload_left_ = len;
+      publish_cmd_ = cmd;
+      std::string prompt = "\r\n>";
+      uint64_t t = busy_until_us_ > now_us ? busy_until_us_ : now_us;
+      for (size_t i = 0; i < prompt.size(); i++) {
+        t += byteTimeUs();
+        Pending p = { t, onWire(prompt[i]), false };
+        rx_.push_back(p);
+      }
+      markBusy(t);
+      stats_.bytes_rx += prompt.size();
+      return;
+    }
+  }
+  const Rule *r = NULL;
+  if (cmd == "AT+CGNSINF") {
+    // the scripted fixes only play once the receiver has one
+    if (!gnss_on_) r = &gnss_off;
+    else if (!gnssFixed()) r = &gnss_searching;
+    else {
+      gnss_memory_ = true;
+      gnss_last_fix_us_ = now_us;
+    }
+  }
+  if (!r) r = match(cmd);
+  if (!r) r = &fallback;
+  if (cmd.compare(0, 9, "AT+SMPUB=") == 0) stats_.publishes++;
+  if (cmd.compare(0, 7, "AT+IPR=") == 0) modem_baud_ = (uint32_t)atol(cmd.c_str() + 7);
+  if (cmd == "ATE0" || cmd == "ATE1") echo_ = cmd[3] == '1';
+  if (cmd.compare(0, 9, "AT+CPSMS=") == 0) psm_enabled_ = cmd[9] == '1';
+  if (cmd.compare(0, 10, "AT+CEDRXS=") == 0) edrx_enabled_ = cmd[10] == '1';
+  if (cmd.compare(0, 11, "AT+CGNSPWR=") == 0) gnssPower(cmd[11] == '1');
+  if (cmd == "AT+CGNSXTRA=1") gnss_xtra_ = true;
+  if (cmd == "AT+CGNSHOT") gnssRestart(GNSS_HOT);
+  if (cmd == "AT+CGNSWARM") gnssRestart(GNSS_WARM);
+  if (cmd == "AT+CGNSCOLD") gnssRestart(GNSS_COLD);
+
+  uint32_t latency_ms = r->latency_ms;
+  if (cmd.compare(0, 9, "AT+SMPUB=") == 0) {
+    // "topic",length,qos,retain
+    size_t retain = cmd.rfind(',');
+    size_t qos = retain == std::string::npos ? retain : cmd.rfind(',', retain - 1);
+    if (qos != std::string::npos && cmd[qos + 1] == '0' && latency_ms > qos0_publish_ms) latency_ms = qos0_publish_ms;
+  }
+  std::string reply = r->reply;
+  if (cmd == "AT+SMSTATE?" && session_lost_) reply = "+SMSTATE: 0\r\n\r\nOK";
+  if (cmd == "AT+SMCONN" && reply.find("OK") != std::string::npos) session_lost_ = false;
+  std::string text = "\r\n" + reply + "\r\n";
+  uint64_t start = busy_until_us_ > now_us ? busy_until_us_ : now_us;
+  uint64_t t = start + latency_ms * 1000ULL;
+  for (size_t i = 0; i < text.size(); i++) {
+    t += byteTimeUs();
+    Pending p = { t, onWire(text[i]), false };
+    rx_.push_back(p);
+  }
+  markBusy(t);
+  stats_.bytes_rx += text.size();
+}
+
+char Modem::onWire(char c) {
+  if (modem_baud_ <= uart_max_baud) return c;
+  return ++wire_bytes_ % wire_error_interval == 0 ? c ^ 0x08 : c;
+}
+
+void Modem::markBusy(uint64_t until_us) {
+  // overlapping exchanges only count once towards the active time
+  uint64_t from = busy_until_us_ > now_us ? busy_until_us_ : now_us;
+  settle(from);
+  if (until_us > from) {
+    stats_.active_us += until_us - from;
+    state_us_[MODEM_ACTIVE] += until_us - from;
+  }
+  busy_until_us_ = until_us;
+  if (until_us > idle_since_us_) idle_since_us_ = until_us;
+}
+
+void Modem::write(uint8_t c) {
+  stats_.bytes_tx++;
+  settle(now_us);
+  if (asleep_) return;
+  // the modem only understands us when both ends agree on the baud rate
+  if (baud_ != modem_baud_) return;
+  if (payload_left_ > 0) {
+    if (--payload_left_ == 0) execute(publish_cmd_, 1);
+    return;
+  }
+  if (echo_) {
+    uint64_t t = (busy_until_us_ > now_us ? busy_until_us_ : now_us) + byteTimeUs();
+    Pending p = { t, onWire((char)c), false };
+    rx_.push_back(p);
+    markBusy(t);
+    stats_.bytes_rx++;
+  }
+  if (c == '\r' || c == '\n') {
+    if (!line_.empty()) execute(line_, 0);
+    line_.clear();
+  } else {
+    line_ += (char)c;
+  }
+}
+
+uint64_t Modem::nextRxUs() const {
+  uint64_t t = UINT64_MAX;
+  if (!rx_.empty()) t = rx_.front().ready_us;
+  if (!urcs_.empty() && urcDeliveryUs(urcs_.front().at_us) < t) t = urcDeliveryUs(urcs_.front().at_us);
+  return t;
+}
+
+int Modem::available() {
+  releaseUrcs();
+  int n = 0;
+  for (size_t i = 0; i < rx_.size() && rx_[i].ready_us <= now_us; i++) n++;
+  return n;
+}
+
+int Modem::peek() {
+  if (!available()) return -1;
+  return (uint8_t)rx_.front().c;
+}
+
+int Modem::read() {
+  if (!available()) return -1;
+  char c = rx_.front().c;
+  rx_.pop_front();
+  return (uint8_t)c;
+}
+
+std::string Modem::collectReply() {
+  // block until the reply to the last command has fully arrived
+  uint64_t end = now_us;
+  for (size_t i = 0; i < rx_.size(); i++)
+    if (!rx_[i].urc && rx_[i].ready_us > end) end = rx_[i].ready_us;
+  clock::advance(end - now_us);
+  releaseUrcs();
+  std::string reply;
+  std::deque<Pending> keep;
+  for (size_t i = 0; i < rx_.size(); i++) {
+    if (rx_[i].urc) keep.push_back(rx_[i]);
+    else reply += rx_[i].c;
+  }
+  rx_.swap(keep);
+  return trim(reply);
+}
+
+std::string Modem::transact(const std::string &cmd) {
+  for (size_t i = 0; i < cmd.size(); i++) write((uint8_t)cmd[i]);
+  write('\r');
+  clock::advance((cmd.size() + 1) * byteTimeUs());
+  return collectReply();
+}
+
+std::string Modem::sendPayload(const char *data, size_t len) {
+  for (size_t i = 0; i < len; i++) write((uint8_t)data[i]);
+  clock::advance(len * byteTimeUs());
+  return collectReply();
+}
+
+}
+
+/***** Arduino core *****/
+
+SimConsole Serial;
+
+namespace {
+uint8_t pin_state[64];
+}
+
+void pinMode(uint8_t pin, uint8_t mode) { (void)pin; (void)mode; }
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin >= 64) return;
+  if (pin == sim::modem_pwrkey_pin && pin_state[pin] == LOW && val == HIGH) sim::modem().pwrKeyPulse();
+  pin_state[pin] = val;
+}
+int digitalRead(uint8_t pin) { return pin < 64 ? pin_state[pin] : LOW; }
+int analogRead(uint8_t pin) { (void)pin; return 0; }
+
+char *dtostrf(double val, signed char width, unsigned char prec, char *sout) {
+  sprintf(sout, "%*.*f", width, prec, val);
+  return sout;
+}
+
+size_t Print::print(long n, int base) {
+  char buf[24];
+  if (base == HEX) snprintf(buf, sizeof(buf), "%lX", n);
+  else snprintf(buf, sizeof(buf), "%ld", n);
+  return write(buf);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  char buf[24];
+  if (base == HEX) snprintf(buf, sizeof(buf), "%lX", n);
+  else snprintf(buf, sizeof(buf), "%lu", n);
+  return write(buf);
+}
+
+size_t Print::print(double n, int digits) {
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return write(buf);
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t n = 0;
+  while (n < length && available()) buffer[n++] = (char)read();
+  return n;
+}
+
+// the console has no input in the simulation
+int SimConsole::available() { return 0; }
+int SimConsole::read() { return -1; }
+int SimConsole::peek() { return -1; }
+
+size_t SimConsole::write(uint8_t c) {
+  if (!sim::quiet && c != '\r') putchar(c);
+  return 1;
+}
@@ -0,0 +1,250 @@
+// Simulation harness shared by the host-side fakes. Everything the firmware
+// would normally get from hardware (time, modem, sensors) is owned here so a
+// run is fully deterministic for a given script.
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+namespace clock {
+// time since the simulation started, the RTC clock
+uint64_t micros();
+void advance(uint64_t us);
+// time since the last (simulated) reset, what millis() reports
+uint64_t sinceBoot();
+void reboot();
+// While a FreeRTOS task runs it keeps its own time on the other core, so
+// its I2C waits do not hold up the main loop's timeline
+void enterTask(uint64_t us);
+void leaveTask();
+}
+
+namespace tasks {
+// runs every task that is due or notified until it blocks again
+void run();
+// drops all tasks and mutexes, for a simulated reset
+void reset();
+}
+
+namespace ram {
+// Runs the firmware's global constructors (see sim/firmware.ld) and
+// takes its RAM outside RTC memory as they left it, before setup() runs
+// for the first time
+void snapshot();
+// what a deep sleep does to it: everything but RTC memory goes back to
+// the snapshot and the constructors run again, as when the chip wakes;
+// they write RTC memory too
+void powerDown();
+}
+
+// Thrown by esp_deep_sleep_start(); the runner restarts the sketch
+struct DeepSleepReset {};
+
+// Current draw assumptions, settable from a script with "set <name> <value>"
+struct CurrentModel {
+  float cpu_active_ma = 40;
+  float cpu_light_sleep_ma = 0.8;
+  float cpu_deep_sleep_ma = 0.15;
+  float modem_active_ma = 100;
+  float modem_idle_ma = 9;
+  float modem_edrx_ma = 1.0;
+  float modem_psm_ma = 0.01;
+  float gnss_ma = 30; // on top of the modem state while the engine runs
+};
+
+CurrentModel &currents();
+
+enum CpuState { CPU_ACTIVE, CPU_LIGHT_SLEEP, CPU_DEEP_SLEEP, CPU_STATES };
+
+// Integrates time spent in each CPU state
+class PowerMeter {
+ public:
+  void setCpu(CpuState s);
+  CpuState cpu() const { return cpu_; }
+  // closes the current interval so the totals are up to date
+  void settle();
+  uint64_t cpuUs(CpuState s) const { return cpu_us_[s]; }
+
+ private:
+  CpuState cpu_ = CPU_ACTIVE;
+  uint64_t since_us_ = 0;
+  uint64_t cpu_us_[CPU_STATES] = {0};
+};
+
+PowerMeter &power();
+
+// Environment values the fake sensors report, settable from a script with
+// "set <name> <value>"
+struct Environment {
+  float temperature_c = 21.5;
+  float pressure_pa = 101325;
+  float humidity_pct = 45;
+  float bus_voltage_mv = 4000;
+  float current_ma = 60; // everything but the modem, see Adafruit_INA260.h
+  float move_current_ma = 0; // added while the bike moves, e.g. dynamo lights
+};
+
+Environment &env();
+
+// When the bike is moved, from script lines "move <from ms> <to ms>". The
+// fake MPU6050 reports it, and the fake INA260 through move_current_ma.
+class Motion {
+ public:
+  void add(uint64_t from_us, uint64_t to_us);
+  bool moving(uint64_t at_us) const;
+  // whether it moved at any time in [from_us, to_us]
+  bool movedBetween(uint64_t from_us, uint64_t to_us) const;
+  // at_us if moving then, else the start of the next movement, UINT64_MAX
+  // if there is none
+  uint64_t nextStartUs(uint64_t at_us) const;
+
+ private:
+  struct Span {
+    uint64_t from_us, to_us;
+  };
+  std::vector<Span> spans_;
+};
+
+Motion &motion();
+
+// GPIO wired to the modem's PWRKEY (FONA_PWRKEY in src/main.cpp)
+const uint8_t modem_pwrkey_pin = 18;
+
+enum ModemState { MODEM_ACTIVE, MODEM_IDLE, MODEM_EDRX, MODEM_PSM, MODEM_STATES };
+
+// Scripted SIM7000 stand-in. Commands written to the modem UART are matched
+// by prefix against the loaded rules; the reply is released byte by byte once
+// the rule latency plus the UART transfer time at the current baud has passed.
+//
+// Power states follow AT+CPSMS / AT+CEDRXS: with PSM enabled the modem
+// drops into PSM once it has been idle for the active timer (T3324), stops
+// answering until PWRKEY is pulsed, holds back URCs and loses its MQTT
+// session. With eDRX, URCs are only delivered at paging occasions.
+// AT+SMPUB with QoS 0 skips the PUBACK wait that the scripted latency
+// includes and answers after at most qos0_publish_ms.
+//
+// GNSS follows AT+CGNSPWR and the AT+CGNSHOT/WARM/COLD restarts: AT+CGNSINF
+// reports the engine off, then no fix until the time to first fix of the
+// start the receiver can do has passed, and only then plays the scripted
+// replies. The receiver remembers its last fix, a hot start needs one from
+// the last few hours; AT+CGNSXTRA=1 speeds up a cold start.
+//
+// Commands are echoed until ATE0, as after power-up. Above the script's
+// uart_max_baud some of the bytes from the modem arrive garbled, so the
+// firmware's link test has something to catch.
+class Modem {
+ public:
+  struct Rule {
+    std::string prefix;
+    uint32_t latency_ms;
+    std::string reply;
+  };
+
+  struct Stats {
+    uint32_t commands = 0;
+    uint32_t publishes = 0;
+    uint64_t bytes_tx = 0;
+    uint64_t bytes_rx = 0;
+    uint64_t active_us = 0; // from command issued until reply fully received
+  };
+
+  bool load(const char *path);
+  void setBaud(uint32_t baud) { baud_ = baud; }
+  uint32_t baud() const { return baud_; }
+
+  // byte-level UART interface used by HardwareSerial(1)
+  void write(uint8_t c);
+  int available();
+  int read();
+  int peek();
+
+  // blocking exchange used by the fake FONA driver: sends the command,
+  // advances the clock until the reply has arrived and returns it
+  std::string transact(const std::string &cmd);
+  // payload phase of commands such as AT+SMPUB that prompt with '>'
+  std::string sendPayload(const char *data, size_t len);
+
+  // PWRKEY was pulsed low and released
+  void pwrKeyPulse();
+  // time spent in each power state so far
+  uint64_t stateUs(ModemState s);
+  // what the modem draws right now, from the current model
+  float currentMa();
+
+  // time the GNSS engine has been on so far
+  uint64_t gnssOnUs() const;
+
+  const Stats &stats() const { return stats_; }
+  // when the modem next puts a byte on the UART, UINT64_MAX if never
+  uint64_t nextRxUs() const;
+
+ private:
+  struct Pending {
+    uint64_t ready_us;
+    char c;
+    bool urc;
+  };
+  struct Urc {
+    uint64_t at_us;
+    std::string text;
+  };
+
+  const Rule *match(const std::string &cmd);
+  void execute(const std::string &cmd, size_t payload_len);
+  void gnssPower(bool on);
+  void gnssRestart(int best);
+  bool gnssFixed() const;
+  void releaseUrcs();
+  void markBusy(uint64_t until_us);
+  void settle(uint64_t upto_us);
+  uint64_t psmEntryUs() const;
+  uint64_t urcDeliveryUs(uint64_t at_us) const;
+  std::string collectReply();
+  // a byte from the modem as it arrives over the wiring at the current rate
+  char onWire(char c);
+  uint64_t byteTimeUs() const { return 10000000ULL / baud_; }
+
+  std::vector<Rule> rules_;
+  std::deque<Urc> urcs_;
+  std::deque<Pending> rx_;
+  std::string line_;
+  uint64_t busy_until_us_ = 0;
+  uint32_t baud_ = 115200;      // host side, set by HardwareSerial::begin
+  uint32_t modem_baud_ = 115200; // modem side, changed with AT+IPR
+  bool echo_ = true;             // ATE1, the power-up default
+  uint32_t wire_bytes_ = 0;      // sent above uart_max_baud
+  std::string publish_cmd_;
+
+  bool psm_enabled_ = false;
+  bool edrx_enabled_ = false;
+  bool asleep_ = false;        // in PSM
+  bool session_lost_ = false;  // MQTT session dropped while in PSM
+  uint64_t idle_since_us_ = 0; // end of the last exchange
+  uint64_t state_us_[MODEM_STATES] = {0};
+  size_t payload_left_ = 0;
+  Stats stats_;
+
+  bool gnss_on_ = false;
+  bool gnss_xtra_ = false;
+  bool gnss_memory_ = false;     // a fix since the modem powered up
+  uint64_t gnss_last_fix_us_ = 0;
+  uint64_t gnss_fix_at_us_ = 0;  // when the running search gets its fix
+  uint64_t gnss_on_since_us_ = 0;
+  uint64_t gnss_on_us_ = 0;
+};
+
+Modem &modem();
+
+// when set, Serial output from the firmware is discarded
+extern bool quiet;
+
+}
+
+#endif
@@ -0,0 +1,146 @@
+// Entry point of the native build: runs the unmodified setup()/loop() of
+// src/main.cpp against the simulated clock and the scripted modem, then
+// reports how long each publish cycle kept the modem busy. With -b it
+// only runs the serializer benchmark in sim/bench.cpp.
+//
+//   program [-s script] [-t seconds] [-q]
+//   program -b frames
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
+
+#include "Arduino.h"
+#include "WiFi.h"
+#include "Wire.h"
+
+SimWiFi WiFi;
+TwoWire Wire;
+
+void setup();
+void loop();
+int runBenchmark(unsigned frames);
+
+namespace {
+// simulated cost of one pass through loop() that does not touch the modem
+const uint64_t loop_overhead_us = 1000;
+
+double mAh(uint64_t us, float ma) { return us / 3.6e9 * ma; }
+}
+
+int main(int argc, char **argv) {
+  const char *script = "sim/scripts/default.txt";
+  double duration_s = 3600;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:t:qb:")) != -1) {
+    switch (opt) {
+      case 's': script = optarg; break;
+      case 't': duration_s = atof(optarg); break;
+      case 'q': sim::quiet = true; break;
+      case 'b': return runBenchmark(strtoul(optarg, NULL, 10));
+      default:
+        fprintf(stderr, "usage: %s [-s script] [-t seconds] [-q] | -b frames\n", argv[0]);
+        return 2;
+    }
+  }
+  if (!sim::modem().load(script)) {
+    fprintf(stderr, "could not read modem script %s\n", script);
+    return 1;
+  }
+
+  sim::ram::snapshot();
+  setup();
+  uint64_t setup_us = sim::clock::micros();
+  uint64_t setup_active_us = sim::modem().stats().active_us;
+
+  // a cycle runs from the first modem command after a sleep until loop()
+  // goes back to sleep; with the AT engine it spans many passes
+  std::vector<uint64_t> cycles_us;
+  bool in_cycle = false;
+  uint64_t cycle_start = 0;
+  unsigned deep_sleeps = 0;
+  const uint64_t end_us = (uint64_t)(duration_s * 1e6);
+  while (sim::clock::micros() < end_us) {
+    uint64_t start = sim::clock::micros();
+    sim::power().settle();
+    uint64_t awake = sim::power().cpuUs(sim::CPU_ACTIVE);
+    uint64_t asleep = sim::power().cpuUs(sim::CPU_LIGHT_SLEEP) + sim::power().cpuUs(sim::CPU_DEEP_SLEEP);
+    uint32_t commands = sim::modem().stats().commands;
+    bool slept = false;
+    try {
+      loop();
+    } catch (const sim::DeepSleepReset &) {
+      deep_sleeps++;
+      slept = true;
+      sim::tasks::reset();
+      sim::ram::powerDown();
+      setup();
+    }
+    sim::tasks::run();
+    sim::power().settle();
+    if (!in_cycle && sim::modem().stats().commands != commands) {
+      in_cycle = true;
+      cycle_start = awake;
+    }
+    slept |= sim::power().cpuUs(sim::CPU_LIGHT_SLEEP) + sim::power().cpuUs(sim::CPU_DEEP_SLEEP) != asleep;
+    if (in_cycle && slept) {
+      // only the awake part counts, not the sleep that ends the cycle
+      cycles_us.push_back(sim::power().cpuUs(sim::CPU_ACTIVE) - cycle_start);
+      in_cycle = false;
+    }
+    if (sim::clock::micros() == start) {
+      sim::clock::advance(loop_overhead_us);
+      sim::power().settle();
+    }
+  }
+
+  const sim::Modem::Stats &st = sim::modem().stats();
+  uint64_t total_us = sim::clock::micros();
+  fprintf(stderr, "\n==== simulation report ====\n");
+  fprintf(stderr, "simulated time     %.1f s\n", total_us / 1e6);
+  fprintf(stderr, "setup              %.1f ms (modem active %.1f ms)\n", setup_us / 1e3, setup_active_us / 1e3);
+  fprintf(stderr, "modem cycles       %zu\n", cycles_us.size());
+  if (!cycles_us.empty()) {
+    std::sort(cycles_us.begin(), cycles_us.end());
+    uint64_t sum = 0;
+    for (size_t i = 0; i < cycles_us.size(); i++) sum += cycles_us[i];
+    fprintf(stderr, "cycle time         min %.1f / median %.1f / mean %.1f / max %.1f ms\n",
+            cycles_us.front() / 1e3, cycles_us[cycles_us.size() / 2] / 1e3,
+            sum / 1e3 / cycles_us.size(), cycles_us.back() / 1e3);
+  }
+  fprintf(stderr, "AT commands        %u (%u publishes)\n", st.commands, st.publishes);
+  fprintf(stderr, "UART bytes         %llu tx / %llu rx\n",
+          (unsigned long long)st.bytes_tx, (unsigned long long)st.bytes_rx);
+  fprintf(stderr, "modem active       %.1f ms (%.2f%% of run)\n",
+          st.active_us / 1e3, total_us ? 100.0 * st.active_us / total_us : 0.0);
+
+  static const char *cpu_names[] = { "active", "light sleep", "deep sleep" };
+  const sim::CurrentModel &cur = sim::currents();
+  const float cpu_ma[] = { cur.cpu_active_ma, cur.cpu_light_sleep_ma, cur.cpu_deep_sleep_ma };
+  sim::power().settle();
+  double total_mAh = 0;
+  for (int s = 0; s < sim::CPU_STATES; s++) {
+    uint64_t us = sim::power().cpuUs((sim::CpuState)s);
+    double q = mAh(us, cpu_ma[s]);
+    total_mAh += q;
+    fprintf(stderr, "cpu %-14s %10.1f s %9.3f mAh\n", cpu_names[s], us / 1e6, q);
+  }
+  static const char *modem_names[] = { "active", "idle", "eDRX", "PSM" };
+  const float modem_ma[] = { cur.modem_active_ma, cur.modem_idle_ma, cur.modem_edrx_ma, cur.modem_psm_ma };
+  for (int s = 0; s < sim::MODEM_STATES; s++) {
+    uint64_t us = sim::modem().stateUs((sim::ModemState)s);
+    double q = mAh(us, modem_ma[s]);
+    total_mAh += q;
+    fprintf(stderr, "modem %-12s %10.1f s %9.3f mAh\n", modem_names[s], us / 1e6, q);
+  }
+  uint64_t gnss_us = sim::modem().gnssOnUs();
+  double gnss_q = mAh(gnss_us, cur.gnss_ma);
+  total_mAh += gnss_q;
+  fprintf(stderr, "gnss on            %10.1f s %9.3f mAh\n", gnss_us / 1e6, gnss_q);
+  fprintf(stderr, "deep sleeps        %u\n", deep_sleeps);
+  fprintf(stderr, "charge used        %.3f mAh (%.2f mA average)\n",
+          total_mAh, total_us ? total_mAh * 3.6e9 / total_us : 0.0);
+  return 0;
+}
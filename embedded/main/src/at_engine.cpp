@@ -0,0 +1,162 @@
+#include "at_engine.h"
+
+#include <string.h>
+
+namespace {
+
+// unsolicited result codes the SIM7000 can emit while a command is running
+const char *const urc_prefixes[] = {
+  "+SMSUB:",
+  "+SMSTATE:",
+  "+APP PDP:",
+  "+CPSMSTATUS:",
+  "+CPIN:",
+  "+HTTPTOFS:",
+  "RDY",
+};
+
+// how long to wait for the resync AT's OK before sending it again
+const uint32_t resync_timeout = 1000; // ms
+// no bytes for this long after the OK, so any late reply is in
+const uint32_t resync_quiet = 50;     // ms
+
+bool startsWith(const char *s, const char *prefix) {
+  return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+}
+
+void AtEngine::begin(Stream &p) {
+  port = &p;
+}
+
+void AtEngine::onUrc(UrcHandler handler, void *ctx) {
+  urc_handler = handler;
+  urc_ctx = ctx;
+}
+
+bool AtEngine::send(const char *command, uint32_t timeout_ms, AtCallback cb, void *ctx,
+                    const uint8_t *payload, size_t payload_len) {
+  if (queued == AT_QUEUE_SIZE || strlen(command) >= AT_COMMAND_SIZE) return false;
+  Command &c = queue[(head + queued) % AT_QUEUE_SIZE];
+  strcpy(c.text, command);
+  c.timeout_ms = timeout_ms;
+  c.cb = cb;
+  c.ctx = ctx;
+  c.payload = payload;
+  c.payload_len = payload_len;
+  queued++;
+  return true;
+}
+
+bool AtEngine::isUrc(const char *l) {
+  for (size_t i = 0; i < sizeof(urc_prefixes) / sizeof(urc_prefixes[0]); i++)
+    if (startsWith(l, urc_prefixes[i])) return true;
+  return false;
+}
+
+void AtEngine::start() {
+  Command &c = queue[head];
+  response_len = 0;
+  response[0] = 0;
+  payload_sent = false;
+  port->write((const uint8_t *)c.text, strlen(c.text));
+  port->write('\r');
+  started_at = millis();
+  in_flight = true;
+}
+
+void AtEngine::finish(AtStatus status) {
+  // pop first so the callback can queue follow-up commands
+  Command c = queue[head];
+  head = (head + 1) % AT_QUEUE_SIZE;
+  queued--;
+  in_flight = false;
+  if (c.cb) c.cb(status, response, c.ctx);
+}
+
+void AtEngine::resync() {
+  port->write((const uint8_t *)"AT\r", 3);
+  resync_at = millis();
+  resync_ok = false;
+  resyncing = true;
+}
+
+void AtEngine::handleLine() {
+  line[line_len] = 0;
+  size_t len = line_len;
+  line_len = 0;
+  if (len == 0) return;
+
+  if (in_flight) {
+    // a command's own reply can look like a URC (AT+SMSTATE?), so only treat
+    // it as one when the command did not ask for it. A received message,
+    // +SMSUB: "topic",..., never is: AT+SMSUB= only answers OK, and a
+    // command can arrive while the subscription is in flight
+    const char *cmd = queue[head].text + 2; // skip "AT"
+    bool own = false;
+    if (line[0] == '+' && !startsWith(line, "+SMSUB: \"")) {
+      const char *colon = strchr(line, ':');
+      size_t n = colon ? (size_t)(colon - line) : len;
+      own = strncmp(cmd, line, n) == 0;
+    }
+    if (!own && isUrc(line)) {
+      if (urc_handler) urc_handler(line, len, urc_ctx);
+      return;
+    }
+    if (strcmp(line, "OK") == 0) {
+      finish(AT_OK);
+    } else if (strcmp(line, "ERROR") == 0 || startsWith(line, "+CME ERROR") || startsWith(line, "+CMS ERROR")) {
+      finish(AT_ERROR);
+    } else if (response_len + len + 2 <= AT_RESPONSE_SIZE) {
+      if (response_len) response[response_len++] = '\n';
+      memcpy(response + response_len, line, len + 1);
+      response_len += len;
+    }
+    return;
+  }
+  if (resyncing && !isUrc(line)) {
+    // the late reply to the timed-out command, the AT's echo and its OK
+    if (strcmp(line, "OK") == 0) resync_ok = true;
+    return;
+  }
+  if (urc_handler) urc_handler(line, len, urc_ctx);
+}
+
+void AtEngine::poll() {
+  if (!port) return;
+  if (!in_flight && !resyncing && queued) start();
+
+  while (port->available()) {
+    char c = port->read();
+    last_rx = millis();
+    if (c == '\n') {
+      handleLine();
+      if (!in_flight && !resyncing && queued) start();
+      continue;
+    }
+    if (c == '\r') continue;
+    // the payload prompt is not followed by a line ending
+    if (c == '>' && line_len == 0 && in_flight && queue[head].payload && !payload_sent) {
+      port->write(queue[head].payload, queue[head].payload_len);
+      payload_sent = true;
+      continue;
+    }
+    // overlong lines are truncated rather than overrunning the buffer
+    if (line_len < AT_LINE_SIZE - 1) line[line_len++] = c;
+  }
+
+  if (resyncing) {
+    if (resync_ok && millis() - last_rx >= resync_quiet) {
+      resyncing = false;
+      if (queued) start();
+    } else if (!resync_ok && millis() - resync_at > resync_timeout) {
+      resync();
+    }
+  } else if (in_flight && millis() - started_at > queue[head].timeout_ms) {
+    line_len = 0;
+    // before the callback, which may queue the next command
+    resync();
+    finish(AT_TIMEOUT);
+  }
+}
@@ -0,0 +1,117 @@
+#include "battery_soc.h"
+
+#include <math.h>
+#include <SPIFFS.h>
+
+namespace {
+
+const uint32_t soc_magic = 0x534f4331; // "SOC1"
+
+struct Saved {
+  uint32_t magic;
+  float soc;
+  float average_ma;
+};
+
+// typical Li-ion open-circuit voltage every 10 %, 0 to 100 %
+const float ocv_table[] = { 3.00, 3.68, 3.74, 3.77, 3.80, 3.84, 3.89, 3.95, 4.02, 4.08, 4.18 };
+const int ocv_points = sizeof(ocv_table) / sizeof(ocv_table[0]);
+
+// the voltage is only trusted below this load; above it the I*R estimate
+// and the cell's recovery make it too uncertain
+const float rest_current = 0.15; // A
+// time constant of the pull towards the OCV estimate while at rest; the
+// coulomb count is trusted over hours, the voltage over days
+const float ocv_hours = 10;
+// a saved state further than this from the OCV estimate is stale, the
+// battery was probably charged or swapped while off
+const float stale_soc = 0.2;
+// the time-remaining average follows roughly the last hour
+const float average_hours = 1;
+// saved when the estimate moved this far
+const float save_step = 0.005;
+
+float clampSoc(float s) {
+  return s < 0 ? 0 : (s > 1 ? 1 : s);
+}
+
+}
+
+float ocvStateOfCharge(float voltage) {
+  if (voltage <= ocv_table[0]) return 0;
+  for (int i = 1; i < ocv_points; i++) {
+    if (voltage < ocv_table[i]) {
+      float f = (voltage - ocv_table[i - 1]) / (ocv_table[i] - ocv_table[i - 1]);
+      return (i - 1 + f) / (ocv_points - 1);
+    }
+  }
+  return 1;
+}
+
+bool BatteryEstimator::begin(const BatteryConfig &c, const char *file_path) {
+  config = c;
+  path = file_path;
+  // still valid in RTC memory after deep sleep
+  if (initialized) return true;
+  File f = SPIFFS.open(path, "r");
+  if (!f) return false;
+  Saved s;
+  bool ok = f.read((uint8_t *)&s, sizeof(s)) == sizeof(s) && s.magic == soc_magic && s.soc >= 0 && s.soc <= 1;
+  f.close();
+  if (!ok) return false;
+  // checked against the voltage on the first correct()
+  soc = saved_soc = s.soc;
+  average_ma = s.average_ma;
+  return true;
+}
+
+void BatteryEstimator::addUsage(const PowerStats &w) {
+  if (!initialized) return;
+  double hours = (w.sampled_us + w.unsampled_us) / 3.6e9;
+  if (hours <= 0) return;
+  double used = w.charge_mah + config.sleep_current_ma * (w.unsampled_us / 3.6e9);
+  soc = clampSoc(soc - used / config.capacity_mah);
+  since_correction += hours;
+  float ma = used / hours;
+  if (average_ma < 0) {
+    average_ma = ma;
+  } else {
+    float a = hours / (hours + average_hours);
+    average_ma += a * (ma - average_ma);
+  }
+}
+
+void BatteryEstimator::correct(float voltage, float current) {
+  float ocv = ocvStateOfCharge(voltage + current * config.internal_resistance);
+  if (!initialized) {
+    // first reading after a full reset: the saved state if it is plausible
+    if (saved_soc < 0 || fabsf(saved_soc - ocv) > stale_soc) soc = ocv;
+    initialized = true;
+    return;
+  }
+  // weighted by the time since the last correction, so it does not matter
+  // how often readings come in
+  float w = since_correction / ocv_hours;
+  since_correction = 0;
+  if (w > 1) w = 1;
+  if (fabsf(current) < rest_current) soc = clampSoc(soc + w * (ocv - soc));
+}
+
+int32_t BatteryEstimator::minutesRemaining() const {
+  if (!initialized || average_ma <= 0) return -1;
+  return (int32_t)(remainingMah() / average_ma * 60);
+}
+
+void BatteryEstimator::persist() {
+  if (initialized && fabsf(soc - saved_soc) >= save_step) save();
+}
+
+bool BatteryEstimator::save() {
+  File f = SPIFFS.open(path, "w");
+  if (!f) return false;
+  Saved s = { soc_magic, soc, average_ma };
+  bool ok = f.write((const uint8_t *)&s, sizeof(s)) == sizeof(s);
+  f.close();
+  if (ok) saved_soc = soc;
+  return ok;
+}
@@ -0,0 +1,65 @@
+#include "circuit_breaker.h"
+
+#include <Arduino.h>
+#include <stdio.h>
+#include "power_scheduler.h"
+
+void CircuitBreaker::begin(const char *name, const RetryPolicy &p, bool warm) {
+  label = name;
+  policy = p;
+  if (warm) return;
+  current = BREAKER_CLOSED;
+  failures = 0;
+  trips = 0;
+}
+
+bool CircuitBreaker::allow() {
+  if (failures > 0 && rtcMillis() - retry_at < 0) return false;
+  if (current == BREAKER_OPEN) {
+    current = BREAKER_HALF_OPEN;
+    Serial.print(label); Serial.println(F(": trying again"));
+  }
+  return true;
+}
+
+void CircuitBreaker::success() {
+  if (current != BREAKER_CLOSED || failures > 0) {
+    Serial.print(label); Serial.println(F(": recovered"));
+  }
+  current = BREAKER_CLOSED;
+  failures = 0;
+  trips = 0;
+}
+
+void CircuitBreaker::failure() {
+  if (failures < 255) failures++;
+  uint32_t wait;
+  if (current == BREAKER_HALF_OPEN || failures >= policy.attempts) {
+    // out of attempts, or the trial failed too: park it
+    current = BREAKER_OPEN;
+    wait = backoff(policy.open_ms, policy.open_max_ms, trips);
+    if (trips < 255) trips++;
+    Serial.print(label); Serial.print(F(": giving up for "));
+    Serial.print(wait / 1000); Serial.println(F(" s"));
+  } else {
+    wait = backoff(policy.base_ms, policy.max_ms, failures - 1);
+  }
+  retry_at = rtcMillis() + wait;
+}
+
+uint32_t CircuitBreaker::backoff(uint32_t base, uint32_t max, uint8_t n) const {
+  uint32_t wait = n < 16 && base <= (max >> n) ? base << n : max;
+  if (policy.jitter == 0 || wait == 0) return wait;
+  // spread evenly over wait +- jitter %
+  uint32_t spread = (uint64_t)wait * policy.jitter / 100;
+  return wait - spread + (uint32_t)random(2 * spread + 1);
+}
+
+size_t CircuitBreaker::status(char *out, size_t size) const {
+  int n;
+  if (current != BREAKER_CLOSED) n = snprintf(out, size, "%s=open %u", label, trips);
+  else if (failures > 0) n = snprintf(out, size, "%s=retry %u", label, failures);
+  else n = snprintf(out, size, "%s=ok", label);
+  if (n < 0) return 0;
+  return (size_t)n < size ? n : size - 1;
+}
@@ -0,0 +1,312 @@
+#include "geofence.h"
+
+#include <math.h>
+#include <string.h>
+#include <SPIFFS.h>
+#include "wire_format.h"
+
+namespace {
+
+const uint32_t fence_magic = 0x46454e31; // "FEN1"
+
+struct SavedHeader {
+  uint32_t magic;
+  uint8_t fence_count;
+  uint8_t vertex_count;
+};
+
+// metres per microdegree of latitude; longitude is scaled by cos(latitude)
+const float metres_per_e6 = 0.111195;
+
+using wire::Fixed;
+
+typedef wire::Layout<
+  Fixed<uint8_t, 0>,   // version
+  Fixed<uint8_t, 0>,   // fence id
+  Fixed<uint32_t, 0>,  // timestamp
+  Fixed<int32_t, 0>,   // latitude
+  Fixed<int32_t, 0>    // longitude
+> AlertLayout;
+
+static_assert(AlertLayout::size == FENCE_ALERT_SIZE, "alert layout does not match FENCE_ALERT_SIZE");
+
+float longitudeScale(int32_t latitude) {
+  // never quite zero, the box around a circle near a pole stays finite
+  float c = cosf(latitude * 1e-6f * (float)M_PI / 180);
+  return c < 0.01f ? 0.01f : c;
+}
+
+int32_t clampE6(float v) {
+  if (v < -180000000.0f) return -180000000;
+  if (v > 180000000.0f) return 180000000;
+  return (int32_t)v;
+}
+
+bool matches(const char *s, size_t n, const char *word) {
+  return n == strlen(word) && memcmp(s, word, n) == 0;
+}
+
+// Tokens of a command, without copying it
+struct Tokens {
+  const char *p;
+  const char *end;
+
+  bool next(const char *&start, size_t &len) {
+    while (p < end && (*p == ' ' || *p == ',')) p++;
+    start = p;
+    while (p < end && *p != ' ' && *p != ',') p++;
+    len = p - start;
+    return len > 0;
+  }
+
+  bool number(uint32_t &v, uint32_t max) {
+    const char *s;
+    size_t n;
+    if (!next(s, n)) return false;
+    v = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (s[i] < '0' || s[i] > '9') return false;
+      v = v * 10 + (s[i] - '0');
+      if (v > max) return false;
+    }
+    return true;
+  }
+
+  // decimal degrees as degrees * 1e6; digits past the sixth are ignored
+  bool degrees(int32_t &v, int32_t max) {
+    const char *s;
+    size_t n;
+    if (!next(s, n)) return false;
+    size_t i = 0;
+    bool negative = s[0] == '-';
+    if (negative) i++;
+    int64_t e6 = 0;
+    int decimals = -1;
+    bool digits = false;
+    for (; i < n; i++) {
+      if (s[i] == '.' && decimals < 0) {
+        decimals = 0;
+      } else if (s[i] >= '0' && s[i] <= '9') {
+        digits = true;
+        if (decimals >= 6) continue;
+        e6 = e6 * 10 + (s[i] - '0');
+        if (decimals >= 0) decimals++;
+        if (e6 > (int64_t)max * 1000000) return false;
+      } else {
+        return false;
+      }
+    }
+    if (!digits) return false;
+    for (int d = decimals < 0 ? 0 : decimals; d < 6; d++) e6 *= 10;
+    if (e6 > max) return false;
+    v = (int32_t)(negative ? -e6 : e6);
+    return true;
+  }
+
+  bool point(GeoPoint &g) {
+    return degrees(g.latitude, 90000000) && degrees(g.longitude, 180000000);
+  }
+
+  // only separators left
+  bool done() {
+    while (p < end && (*p == ' ' || *p == ',')) p++;
+    return p == end;
+  }
+};
+
+}
+
+bool Geofences::begin(const char *file_path) {
+  path = file_path;
+  // still valid in RTC memory after deep sleep
+  if (loaded) return true;
+  loaded = true;
+  File f = SPIFFS.open(path, "r");
+  if (!f) return false;
+  SavedHeader h;
+  bool ok = f.read((uint8_t *)&h, sizeof(h)) == sizeof(h) && h.magic == fence_magic &&
+            h.fence_count <= GEOFENCE_MAX_FENCES && h.vertex_count <= GEOFENCE_MAX_VERTICES &&
+            f.read((uint8_t *)fences, h.fence_count * sizeof(Fence)) == h.fence_count * sizeof(Fence) &&
+            f.read((uint8_t *)vertices, h.vertex_count * sizeof(GeoPoint)) == h.vertex_count * sizeof(GeoPoint);
+  f.close();
+  fence_count = ok ? h.fence_count : 0;
+  vertex_count = ok ? h.vertex_count : 0;
+  known = inside = 0;
+  return ok;
+}
+
+bool Geofences::save() {
+  if (!path) return false;
+  File f = SPIFFS.open(path, "w");
+  if (!f) return false;
+  SavedHeader h = { fence_magic, fence_count, vertex_count };
+  bool ok = f.write((const uint8_t *)&h, sizeof(h)) == sizeof(h) &&
+            f.write((const uint8_t *)fences, fence_count * sizeof(Fence)) == fence_count * sizeof(Fence) &&
+            f.write((const uint8_t *)vertices, vertex_count * sizeof(GeoPoint)) == vertex_count * sizeof(GeoPoint);
+  f.close();
+  return ok;
+}
+
+bool Geofences::command(const char *text, size_t len) {
+  Tokens t = { text, text + len };
+  const char *verb;
+  size_t verb_len;
+  if (!t.next(verb, verb_len)) return false;
+  uint32_t id;
+  if (matches(verb, verb_len, "clear")) {
+    if (!t.done()) return false;
+    clear();
+    return true;
+  }
+  if (!t.number(id, 255)) return false;
+  if (matches(verb, verb_len, "remove")) {
+    return t.done() && remove((uint8_t)id);
+  }
+  if (matches(verb, verb_len, "circle")) {
+    GeoPoint centre;
+    uint32_t radius;
+    if (!t.point(centre) || !t.number(radius, 100000) || radius == 0 || !t.done()) return false;
+    return addCircle((uint8_t)id, centre, radius);
+  }
+  if (matches(verb, verb_len, "polygon")) {
+    GeoPoint points[GEOFENCE_MAX_VERTICES];
+    size_t n = 0;
+    while (!t.done()) {
+      if (n == GEOFENCE_MAX_VERTICES) return false;
+      if (!t.point(points[n++])) return false;
+    }
+    return addPolygon((uint8_t)id, points, n);
+  }
+  return false;
+}
+
+bool Geofences::addCircle(uint8_t id, GeoPoint centre, uint32_t radius_m) {
+  Fence f;
+  f.id = id;
+  f.shape = FENCE_CIRCLE;
+  f.radius_m = radius_m;
+  float dlat = radius_m / metres_per_e6;
+  float dlon = dlat / longitudeScale(centre.latitude);
+  f.min_latitude = clampE6(centre.latitude - dlat);
+  f.max_latitude = clampE6(centre.latitude + dlat);
+  f.min_longitude = clampE6(centre.longitude - dlon);
+  f.max_longitude = clampE6(centre.longitude + dlon);
+  return add(f, &centre, 1);
+}
+
+bool Geofences::addPolygon(uint8_t id, const GeoPoint *points, size_t n) {
+  if (n < 3) return false;
+  Fence f;
+  f.id = id;
+  f.shape = FENCE_POLYGON;
+  f.radius_m = 0;
+  f.min_latitude = f.max_latitude = points[0].latitude;
+  f.min_longitude = f.max_longitude = points[0].longitude;
+  for (size_t i = 1; i < n; i++) {
+    if (points[i].latitude < f.min_latitude) f.min_latitude = points[i].latitude;
+    if (points[i].latitude > f.max_latitude) f.max_latitude = points[i].latitude;
+    if (points[i].longitude < f.min_longitude) f.min_longitude = points[i].longitude;
+    if (points[i].longitude > f.max_longitude) f.max_longitude = points[i].longitude;
+  }
+  return add(f, points, n);
+}
+
+bool Geofences::add(const Fence &f, const GeoPoint *points, size_t n) {
+  // check the space first, a fence that does not fit leaves the old one
+  size_t i = find(f.id);
+  size_t freed = i < fence_count ? fences[i].count : 0;
+  if (i == GEOFENCE_MAX_FENCES || vertex_count - freed + n > GEOFENCE_MAX_VERTICES) return false;
+  // a replaced fence keeps its slot, its vertices move to the end of the pool
+  if (i < fence_count) releaseVertices(i);
+  else fence_count++;
+  Fence &slot = fences[i];
+  slot = f;
+  slot.first = vertex_count;
+  slot.count = (uint8_t)n;
+  memcpy(vertices + vertex_count, points, n * sizeof(GeoPoint));
+  vertex_count += n;
+  // unknown until the next fix, so adding a fence never alerts by itself
+  known &= ~(1u << i);
+  save();
+  return true;
+}
+
+bool Geofences::remove(uint8_t id) {
+  size_t i = find(id);
+  if (i >= fence_count) return false;
+  // close the gap in the vertex pool, then in the fences and their state bits
+  releaseVertices(i);
+  memmove(fences + i, fences + i + 1, (fence_count - i - 1) * sizeof(Fence));
+  fence_count--;
+  uint32_t low = (1u << i) - 1;
+  known = (known & low) | ((known >> 1) & ~low);
+  inside = (inside & low) | ((inside >> 1) & ~low);
+  save();
+  return true;
+}
+
+size_t Geofences::find(uint8_t id) const {
+  size_t i = 0;
+  while (i < fence_count && fences[i].id != id) i++;
+  return i;
+}
+
+void Geofences::releaseVertices(size_t i) {
+  uint8_t first = fences[i].first, count = fences[i].count;
+  memmove(vertices + first, vertices + first + count, (vertex_count - first - count) * sizeof(GeoPoint));
+  vertex_count -= count;
+  for (size_t j = 0; j < fence_count; j++) {
+    if (fences[j].first > first) fences[j].first -= count;
+  }
+  fences[i].count = 0;
+}
+
+void Geofences::clear() {
+  fence_count = vertex_count = 0;
+  known = inside = 0;
+  save();
+}
+
+bool Geofences::contains(const Fence &f, GeoPoint p) const {
+  if (p.latitude < f.min_latitude || p.latitude > f.max_latitude ||
+      p.longitude < f.min_longitude || p.longitude > f.max_longitude) {
+    return false;
+  }
+  const GeoPoint *v = vertices + f.first;
+  if (f.shape == FENCE_CIRCLE) {
+    // flat projection around the centre, fine up to tens of kilometres
+    float kx = metres_per_e6 * longitudeScale(v[0].latitude);
+    float dx = (p.longitude - v[0].longitude) * kx;
+    float dy = (p.latitude - v[0].latitude) * metres_per_e6;
+    return dx * dx + dy * dy <= (float)f.radius_m * f.radius_m;
+  }
+  // even-odd ray casting towards increasing longitude, exact in 64 bits
+  bool in = false;
+  for (size_t i = 0, j = f.count - 1; i < f.count; j = i++) {
+    const GeoPoint &a = v[j];
+    const GeoPoint &b = v[i];
+    if ((a.latitude > p.latitude) == (b.latitude > p.latitude)) continue;
+    int64_t lhs = (int64_t)(p.longitude - a.longitude) * (b.latitude - a.latitude);
+    int64_t rhs = (int64_t)(p.latitude - a.latitude) * (b.longitude - a.longitude);
+    if (b.latitude > a.latitude ? lhs < rhs : lhs > rhs) in = !in;
+  }
+  return in;
+}
+
+size_t Geofences::check(GeoPoint fix, uint8_t *exited, size_t max_exited) {
+  size_t n = 0;
+  for (size_t i = 0; i < fence_count; i++) {
+    uint32_t bit = 1u << i;
+    bool in = contains(fences[i], fix);
+    if ((known & bit) && (inside & bit) && !in && n < max_exited) exited[n++] = fences[i].id;
+    known |= bit;
+    if (in) inside |= bit;
+    else inside &= ~bit;
+  }
+  return n;
+}
+
+size_t encodeFenceAlert(const FenceAlert &a, uint8_t *out) {
+  return AlertLayout::encode(out, (uint8_t)FENCE_ALERT_VERSION, a.id, a.timestamp,
+                             a.fix.latitude, a.fix.longitude);
+}
@@ -0,0 +1,67 @@
+#include "gnss_info.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+// field positions in +CGNSINF: run,fix,utc,lat,lon,alt,speed,course,fixmode,
+// reserved,hdop,pdop,vdop,reserved,in view,used,...
+enum {
+  FIELD_RUN, FIELD_FIX, FIELD_UTC, FIELD_LAT, FIELD_LON, FIELD_ALT, FIELD_SPEED, FIELD_COURSE,
+  FIELD_USED = 15,
+  FIELD_COUNT
+};
+
+int digits(const char *s, int n) {
+  int v = 0;
+  for (int i = 0; i < n; i++) {
+    if (s[i] < '0' || s[i] > '9') return 0;
+    v = v * 10 + (s[i] - '0');
+  }
+  return v;
+}
+
+}
+
+bool parseGnssInfo(const char *response, GnssInfo &info) {
+  const char *p = strstr(response, "+CGNSINF: ");
+  if (!p) return false;
+  p += 10;
+  memset(&info, 0, sizeof(info));
+  for (int field = 0; field < FIELD_COUNT && *p && *p != '\n'; field++) {
+    const char *end = p;
+    while (*end && *end != ',' && *end != '\n') end++;
+    if (end != p) {
+      switch (field) {
+        case FIELD_RUN: info.running = *p == '1'; break;
+        case FIELD_FIX: info.fix = *p == '1'; break;
+        case FIELD_UTC:
+          // yyyyMMddhhmmss.sss
+          if (end - p >= 14) {
+            info.year = digits(p, 4);
+            info.month = digits(p + 4, 2);
+            info.day = digits(p + 6, 2);
+            info.hour = digits(p + 8, 2);
+            info.minute = digits(p + 10, 2);
+            info.second = atof(p + 12);
+          }
+          break;
+        case FIELD_LAT: info.latitude = atof(p); break;
+        case FIELD_LON: info.longitude = atof(p); break;
+        case FIELD_ALT: info.altitude = atof(p); break;
+        case FIELD_SPEED: info.speed_kph = atof(p); break;
+        case FIELD_COURSE: info.heading = atof(p); break;
+        case FIELD_USED: info.satellites_used = atoi(p); break;
+      }
+    }
+    if (*end != ',') break;
+    p = end + 1;
+  }
+  return true;
+}
+
+int8_t gnssStatus(const GnssInfo &info) {
+  if (!info.running) return 0;
+  return info.fix ? 3 : 1;
+}
@@ -0,0 +1,315 @@
+#include "gnss_manager.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SPIFFS.h>
+#include "power_scheduler.h"
+#include "telemetry_frame.h"
+
+namespace {
+
+const uint32_t gnss_magic = 0x474e5333; // "GNS3"
+
+struct Saved {
+  uint32_t magic;
+  uint32_t xtra_time;
+  uint32_t xtra_attempt;
+  uint32_t xtra_failures;
+};
+
+// where the modem keeps the download; AT+CGNSCPY copies it from here
+const char xtra_file[] = "/customer/Xtra3.bin";
+// XTRA3 predictions are good for three days after the download
+const uint32_t xtra_valid = 3UL * 24 * 60 * 60; // s
+// the download itself, from AT+HTTPTOFS to its +HTTPTOFS result
+const uint32_t xtra_timeout = 60000; // ms
+// wait after the first failed download, doubled for every further one
+const uint32_t xtra_retry = 30UL * 60; // s
+const uint32_t command_timeout = 2000; // ms
+
+const char *const start_name[GNSS_STARTS] = { "hot", "warm", "cold", "assisted" };
+
+}
+
+const char *gnssStartName(GnssStart s) {
+  return s < GNSS_STARTS ? start_name[s] : "?";
+}
+
+void GnssManager::begin(AtEngine &a, Adafruit_FONA_LTE &f, const GnssConfig &c, bool warm,
+                        const char *file_path) {
+  at = &a;
+  fona = &f;
+  config = c;
+  path = file_path;
+  // a search cannot survive a restart, its callback is gone
+  stage = STAGE_IDLE;
+  callback = nullptr;
+  query_in_flight = false;
+  if (!warm) {
+    is_powered = false;
+    receiver_fix = false;
+    clock_valid = false;
+  }
+  // still valid in RTC memory after deep sleep
+  if (loaded) return;
+  loaded = true;
+  File file = SPIFFS.open(path, "r");
+  if (!file) return;
+  Saved s;
+  bool ok = file.read((uint8_t *)&s, sizeof(s)) == sizeof(s) && s.magic == gnss_magic;
+  file.close();
+  if (!ok) return;
+  xtra_time = s.xtra_time;
+  xtra_attempt = s.xtra_attempt;
+  xtra_failures = s.xtra_failures;
+}
+
+GnssStart GnssManager::chooseStart() const {
+  if (!receiver_fix) return GNSS_COLD;
+  int32_t age = rtcMillis() - receiver_fix_at;
+  if (age < (int32_t)config.hot_age) return GNSS_HOT;
+  if (age < (int32_t)config.warm_age) return GNSS_WARM;
+  return GNSS_COLD;
+}
+
+void GnssManager::acquire(AtCallback cb, void *ctx) {
+  callback = cb;
+  callback_ctx = ctx;
+  // a search under way reports to the new callback
+  if (stage != STAGE_IDLE) return;
+  if (is_powered) {
+    // kept warm since the last cycle, it normally still has the fix
+    startSearch(false);
+    return;
+  }
+  GnssStart s = chooseStart();
+  if (s != GNSS_COLD || config.xtra_interval == 0) {
+    powerOn(s);
+  } else if (unixNow() == 0) {
+    // XTRA needs the date, ask the network before deciding
+    stage = STAGE_CLOCK;
+    if (!at->send("AT+CCLK?", command_timeout, onClock, this)) startCold();
+  } else {
+    startCold();
+  }
+}
+
+void GnssManager::startCold() {
+  uint32_t now = unixNow();
+  if (config.xtra_interval && config.xtra_url && now && xtraDue(now)) {
+    downloadXtra();
+  } else if (xtra_time && now && now - xtra_time < xtra_valid) {
+    powerOn(GNSS_ASSISTED);
+  } else {
+    powerOn(GNSS_COLD);
+  }
+}
+
+void GnssManager::downloadXtra() {
+  char command[AT_COMMAND_SIZE];
+  snprintf(command, sizeof(command), "AT+HTTPTOFS=\"%s\",\"%s\"", config.xtra_url, xtra_file);
+  Serial.println(F("Downloading GNSS assistance data"));
+  stage = STAGE_XTRA;
+  // counted as failed until the result says otherwise, so a reset during
+  // the download backs off too
+  xtra_attempt = unixNow();
+  xtra_failures++;
+  save();
+  xtra_started = rtcMillis();
+  next_poll = xtra_started + config.poll_interval;
+  if (!at->send(command, xtra_timeout, onXtraRequested, this)) powerOn(GNSS_COLD);
+}
+
+void GnssManager::powerOn(GnssStart s) {
+  start = s;
+  stage = STAGE_STARTING;
+  // loaded into the engine while it is still off; without room in the
+  // queue for both commands it is a plain cold start
+  if (s == GNSS_ASSISTED && !(at->send("AT+CGNSCPY", command_timeout, onXtraCopied, this) &&
+                              at->send("AT+CGNSXTRA=1", command_timeout, nullptr))) {
+    start = s = GNSS_COLD;
+  }
+  if (!at->send("AT+CGNSPWR=1", command_timeout, onPowered, this)) {
+    finish(AT_ERROR, "");
+    return;
+  }
+  // the engine resumes with whatever it remembers; below a hot start that
+  // includes ephemeris too old to use, so it is told to drop it
+  if (s == GNSS_WARM) at->send("AT+CGNSWARM", command_timeout, onRestarted, this);
+  if (s == GNSS_COLD || s == GNSS_ASSISTED) at->send("AT+CGNSCOLD", command_timeout, onRestarted, this);
+}
+
+void GnssManager::startSearch(bool t) {
+  stage = STAGE_SEARCHING;
+  timed = t;
+  search_started = rtcMillis();
+  if (t) powered_at = search_started;
+  // a warm receiver already has the fix, a fresh one needs at least a poll
+  next_poll = t ? search_started + config.poll_interval : search_started;
+}
+
+void GnssManager::poll() {
+  if (stage == STAGE_XTRA) {
+    int32_t now = rtcMillis();
+    if (now - xtra_started >= (int32_t)xtra_timeout) {
+      Serial.println(F("GNSS assistance download timed out"));
+      powerOn(GNSS_COLD);
+    } else {
+      next_poll = now + config.poll_interval;
+    }
+    return;
+  }
+  if (stage != STAGE_SEARCHING || query_in_flight || rtcMillis() - next_poll < 0) return;
+  query_in_flight = at->send("AT+CGNSINF", command_timeout, onInfo, this);
+}
+
+void GnssManager::onUrc(const char *line, size_t len) {
+  const char prefix[] = "+HTTPTOFS: ";
+  if (stage != STAGE_XTRA || len < sizeof(prefix) - 1 || memcmp(line, prefix, sizeof(prefix) - 1) != 0) return;
+  // +HTTPTOFS: <http status>,<length>
+  int status = atoi(line + sizeof(prefix) - 1);
+  if (status != 200) {
+    Serial.print(F("GNSS assistance download failed: ")); Serial.println(status);
+    powerOn(GNSS_COLD);
+    return;
+  }
+  xtra_time = unixNow();
+  xtra_failures = 0;
+  save();
+  powerOn(GNSS_ASSISTED);
+}
+
+void GnssManager::fixed(const GnssInfo &info) {
+  if (info.fix) remember(info);
+}
+
+void GnssManager::remember(const GnssInfo &info) {
+  receiver_fix = true;
+  receiver_fix_at = rtcMillis();
+  setClock(unixTime(info.year, info.month, info.day, info.hour, info.minute, (uint8_t)info.second));
+}
+
+void GnssManager::setClock(uint32_t unix_time) {
+  clock_valid = true;
+  clock_unix = unix_time;
+  clock_at = rtcMillis();
+}
+
+uint32_t GnssManager::unixNow() const {
+  if (!clock_valid) return 0;
+  return clock_unix + (uint32_t)(rtcMillis() - clock_at) / 1000;
+}
+
+void GnssManager::release(bool keep_warm) {
+  if (!is_powered || keep_warm || stage != STAGE_IDLE) return;
+  if (!fona->enableGPS(false)) return;
+  is_powered = false;
+  on_ms += rtcMillis() - powered_at;
+}
+
+void GnssManager::finish(AtStatus status, const char *response) {
+  stage = STAGE_IDLE;
+  AtCallback cb = callback;
+  callback = nullptr;
+  if (cb) cb(status, response, callback_ctx);
+}
+
+void GnssManager::onClock(AtStatus status, const char *response, void *ctx) {
+  GnssManager &g = *(GnssManager *)ctx;
+  // +CCLK: "yy/MM/dd,hh:mm:ss±zz", the zone in quarter hours; the modem
+  // reports 1980 until the network has sent the time
+  const char *p = strstr(response, "+CCLK: \"");
+  int y, mo, d, h, mi, s, zone;
+  if (status == AT_OK && p && sscanf(p + 8, "%d/%d/%d,%d:%d:%d%d", &y, &mo, &d, &h, &mi, &s, &zone) == 7 &&
+      y >= 19 && y < 80) {
+    g.setClock(unixTime(2000 + y, mo, d, h, mi, s) - zone * 15 * 60);
+  }
+  g.startCold();
+}
+
+void GnssManager::onXtraRequested(AtStatus status, const char *, void *ctx) {
+  GnssManager &g = *(GnssManager *)ctx;
+  // the result follows as a +HTTPTOFS URC
+  if (status != AT_OK && g.stage == STAGE_XTRA) {
+    Serial.println(F("GNSS assistance download failed"));
+    g.powerOn(GNSS_COLD);
+  }
+}
+
+void GnssManager::onXtraCopied(AtStatus status, const char *, void *ctx) {
+  // without the file it is a plain cold start, and counted as one
+  if (status != AT_OK) ((GnssManager *)ctx)->start = GNSS_COLD;
+}
+
+void GnssManager::onPowered(AtStatus status, const char *response, void *ctx) {
+  GnssManager &g = *(GnssManager *)ctx;
+  if (status != AT_OK) {
+    Serial.println(F("Failed to turn on gps"));
+    g.finish(status, response);
+    return;
+  }
+  g.is_powered = true;
+  if (g.start == GNSS_HOT) g.startSearch(true);
+}
+
+void GnssManager::onRestarted(AtStatus, const char *, void *ctx) {
+  GnssManager &g = *(GnssManager *)ctx;
+  // the engine runs either way, only the start may not be what was asked
+  if (g.stage == STAGE_STARTING && g.is_powered) g.startSearch(true);
+}
+
+void GnssManager::onInfo(AtStatus status, const char *response, void *ctx) {
+  GnssManager &g = *(GnssManager *)ctx;
+  g.query_in_flight = false;
+  int32_t now = rtcMillis();
+  GnssInfo info;
+  if (status == AT_OK && parseGnssInfo(response, info) && info.fix) {
+    g.remember(info);
+    if (g.timed) {
+      uint32_t ttff = now - g.powered_at;
+      g.ttff_count[g.start]++;
+      g.ttff_sum[g.start] += ttff;
+      if (ttff > g.ttff_max[g.start]) g.ttff_max[g.start] = ttff;
+      Serial.print(F("GNSS fix after ")); Serial.print(ttff);
+      Serial.print(F(" ms, ")); Serial.print(gnssStartName(g.start)); Serial.println(F(" start"));
+    }
+    g.finish(status, response);
+  } else if (now - g.search_started >= (int32_t)g.config.fix_timeout) {
+    g.timeouts++;
+    g.finish(status, response);
+  } else {
+    g.next_poll = now + g.config.poll_interval;
+  }
+}
+
+void GnssManager::printStats() {
+  uint32_t on = on_ms + (is_powered ? rtcMillis() - powered_at : 0);
+  Serial.print(F("GNSS on ")); Serial.print(on / 1000); Serial.print(F(" s, time to first fix:"));
+  for (int s = 0; s < GNSS_STARTS; s++) {
+    if (ttff_count[s] == 0) continue;
+    Serial.print(' '); Serial.print(start_name[s]);
+    Serial.print(' '); Serial.print(ttff_count[s]);
+    Serial.print(F("x mean ")); Serial.print(ttff_sum[s] / ttff_count[s]);
+    Serial.print(F(" max ")); Serial.print(ttff_max[s]); Serial.print(F(" ms,"));
+  }
+  Serial.print(F(" no fix ")); Serial.println(timeouts);
+}
+
+bool GnssManager::xtraDue(uint32_t now) const {
+  if (xtra_time != 0 && now - xtra_time < config.xtra_interval) return false;
+  if (xtra_failures == 0) return true;
+  uint32_t wait = xtra_retry;
+  for (uint32_t i = 1; i < xtra_failures && wait < config.xtra_interval; i++) wait *= 2;
+  if (wait > config.xtra_interval) wait = config.xtra_interval;
+  return now - xtra_attempt >= wait;
+}
+
+bool GnssManager::save() {
+  File f = SPIFFS.open(path, "w");
+  if (!f) return false;
+  Saved s = { gnss_magic, xtra_time, xtra_attempt, xtra_failures };
+  bool ok = f.write((const uint8_t *)&s, sizeof(s)) == sizeof(s);
+  f.close();
+  return ok;
+}
@@ -0,0 +1,22 @@
+#include "i2c_bus.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+namespace {
+
+// created on first use, by setup() before the sampler task starts
+SemaphoreHandle_t bus() {
+  static SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+  return mutex;
+}
+
+}
+
+I2cLock::I2cLock() {
+  xSemaphoreTake(bus(), portMAX_DELAY);
+}
+
+I2cLock::~I2cLock() {
+  xSemaphoreGive(bus());
+}
@@ -32,6 +32,27 @@
 #include "Adafruit_FONA.h"
 #include "Adafruit_Sensor.h"
 #include "Adafruit_BME280.h"
+#include "telemetry_frame.h"
+#include "telemetry_backlog.h"
+#include "power_scheduler.h"
+#include "modem_power.h"
+#include "at_engine.h"
+#include "gnss_info.h"
+#include "mqtt_urc.h"
+#include "motion_state.h"
+#include "track_compressor.h"
+#include "track_codec.h"
+#include "i2c_bus.h"
+#include "sensor_sampler.h"
+#include "power_stats.h"
+#include "battery_soc.h"
+#include "geofence.h"
+#include "motion_wake.h"
+#include "gnss_manager.h"
+#include "mqtt_publisher.h"
+#include "mqtt_session.h"
+#include "circuit_breaker.h"
+#include "modem_link.h"
 #include "./config.h"
 
 // For SIM7000 shield with ESP32
@@ -39,16 +60,127 @@
 #define FONA_RST 5
 #define FONA_TX 16 // ESP32 hardware serial RX2 (GPIO16)
 #define FONA_RX 17 // ESP32 hardware serial TX2 (GPIO17)
+#define FONA_UART 1
+// Optional: wire the shield's RI pin to an RTC GPIO to allow deep sleep
+// #define FONA_RI 4
+// Optional: wire the INA260's ALERT pin to sample power on conversion-ready
+// #define INA260_ALERT 19
+// Optional: an MPU6050 on the I2C bus with INT wired to a GPIO wakes a parked
+// tracker when it is moved; it must be an RTC GPIO to also wake deep sleep
+// #define IMU_INT 27
 #define BAUD_RATE 115200
+// fastest modem UART rate to try, see ModemLink
+#define FONA_MAX_BAUD 921600
 
-// battery info
-const float max_battery_voltage = 4.2;
-const float min_battery_voltage = 3.7;
+// battery pack, for the state-of-charge estimate
+const BatteryConfig battery_config = {
+  2500, // capacity_mah
+  0.15, // internal_resistance, ohms
+  1.5,  // sleep_current_ma, light sleep plus the modem's idle draw
+};
+// below this (%) the publish rate drops to the parked maximum and the
+// track is no longer sampled
+const float critical_battery = 10;
+// INA260 current that counts as moving, for a motion wake without the
+// MPU6050, e.g. with dynamo lights wired through it; 0 to not use it
+const float motion_wake_current_ma = 0;
+
+// at most this many backlog publishes per cycle so a long outage does not
+// keep the modem busy for minutes in one go
+const int max_backlog_batches = 16;
+// backlog batches handed to the modem back to back
+#define BACKLOG_WINDOW 4
+
+// GNSS is only powered while a fix is needed, and kept on while the track
+// is sampled
+const GnssConfig gnss_config = {
+  1000,                         // poll_interval (ms)
+  90 * 1000,                    // fix_timeout (ms)
+  2UL * 60 * 60 * 1000,         // hot_age (ms), ephemeris is good for about 4 h
+  7UL * 24 * 60 * 60 * 1000,    // warm_age (ms)
+  24UL * 60 * 60,               // xtra_interval (s), 0 to not use XTRA
+  "http://iot1.xtracloud.net/xtra3gr.bin",
+};
+
+// the broker keeps the session between connects, see MqttSession
+const MqttSessionConfig mqtt_config = {
+  MQTT_SERVER,
+  MQTT_PORT,
+  MQTT_USERNAME,
+  MQTT_PASSWORD,
+  COMMAND_TOPIC,
+  5 * 60, // keepalive (s), each ping wakes the radio
+  {
+    15 * 1000,            // base_ms
+    30UL * 60 * 1000,     // max_ms
+    25,                   // jitter (%)
+    6,                    // attempts
+    30UL * 60 * 1000,     // open_ms
+    2UL * 60 * 60 * 1000, // open_max_ms
+  },
+};
+
+// A failing subsystem backs off and is then parked for a while instead of
+// being retried every cycle, see CircuitBreaker; the rest keeps running and
+// its data goes to the backlog
+const RetryPolicy modem_retry = {
+  60 * 1000,            // base_ms
+  10UL * 60 * 1000,     // max_ms
+  25,                   // jitter (%)
+  3,                    // attempts
+  30UL * 60 * 1000,     // open_ms
+  4UL * 60 * 60 * 1000, // open_max_ms
+};
+const RetryPolicy data_retry = {
+  15 * 1000,            // base_ms
+  5UL * 60 * 1000,      // max_ms
+  25,                   // jitter (%)
+  5,                    // attempts
+  15UL * 60 * 1000,     // open_ms
+  2UL * 60 * 60 * 1000, // open_max_ms
+};
+// every cycle is a GNSS attempt, so only cycles without a fix count; a bad
+// antenna then stops costing a full fix_timeout per cycle
+const RetryPolicy gnss_retry = {
+  0,                    // base_ms
+  0,                    // max_ms
+  25,                   // jitter (%)
+  3,                    // attempts
+  30UL * 60 * 1000,     // open_ms
+  4UL * 60 * 60 * 1000, // open_max_ms
+};
+
+// restrict the modem to LTE CAT-M, skipping the NB-IoT and 2G scans
+const bool catm_only = true;
 
 // time intervals
 const int min_publish_interval = 1000; // ms
-const int publish_interval = 1000 * 5 * 60; // ms
-int next_publish, last_publish, last_poll = 0;
+// the sensors are read on their own core, the Arduino loop runs on core 1
+const int sample_interval = 1000; // ms
+const int sampler_core = 0;
+// set when the BME280 is fitted to publish weather readings
+const bool sample_weather = false;
+
+// adaptive publish rate, the interval follows how the bike is moving
+const MotionLimits motion_limits = {
+  3,    // walking_kph
+  10,   // riding_kph
+  45,   // turn_degrees
+  0,    // current_spike_ma, e.g. 150 with the lights on the INA260 rail
+  15 * 1000,      // riding_interval (ms)
+  60 * 1000,      // walking_interval (ms)
+  5 * 60 * 1000,  // parked_interval (ms)
+  60 * 60 * 1000, // parked_max_interval (ms)
+};
+// while moving the track is sampled at this rate and simplified on the
+// device, kept points reproduce every fix to within the tolerance
+const int track_sample_interval = 1000; // ms
+const float track_tolerance = 10; // m
+// kept points are batched, the deltas are cheap but the first point is not
+const int track_batch_interval = 2 * 60 * 1000; // ms
+// kept in RTC memory so the schedule survives deep sleep, in rtcMillis() time
+RTC_DATA_ATTR int publish_interval = 1000 * 5 * 60; // ms
+RTC_DATA_ATTR int next_publish = 0, last_publish = 0, last_poll = 0;
 
 // Create the BMP280 temperature sensor object
 Adafruit_BME280 temp_sensor;
@@ -63,17 +195,96 @@ HardwareSerial fonaSS(1);
 Adafruit_FONA_LTE fona = Adafruit_FONA_LTE();
 
 uint8_t type;
-char replybuffer[255]; // this is a large buffer for replies
-char latBuff[12], longBuff[12], locBuff[60], speedBuff[12],
-     headBuff[12], altBuff[12], altBuff2[12], pressureBuff[12],
-     tempBuff[12], humidityBuff[12], weatherBuff[50], currentBuff[12],
-     voltageBuff[12], powerBuff[12], battBuff[12], batteryBuff[60];
-char imei[16] = {0}; // MUST use a 16 character buffer for IMEI!
+uint8_t telemetryBuff[TELEMETRY_FRAME_SIZE];
+uint8_t backlogBuff[BACKLOG_WINDOW * BACKLOG_MAX_BATCH * TELEMETRY_FRAME_SIZE];
+TrackPoint trackPoints[TRACK_MAX_POINTS];
+// the SIM7000 accepts at most 512 bytes per MQTT publish
+uint8_t trackBuff[512];
+size_t track_points = 0;
+int next_track_sample = 0;
+RTC_DATA_ATTR int last_track_publish = 0;
+RTC_DATA_ATTR uint16_t telemetry_sequence = 0;
+TelemetryBacklog backlog;
+PowerScheduler scheduler;
+// The ESP32 runs the global constructors again on every wake from deep
+// sleep, so an object in RTC memory that needs one is reset by the wake.
+// Each class kept there must be constant-initialised, a constant
+// initialiser on every member, which this checks.
+template <typename T> constexpr bool constantInitialised() { return ((void)T(), true); }
+#define RTC_CHECK(T) static_assert(constantInitialised<T>(), #T " has a runtime constructor, a wake would reset it")
+RTC_DATA_ATTR ModemPower modemPower;
+RTC_CHECK(ModemPower);
+RTC_DATA_ATTR ModemLink modemLink;
+RTC_CHECK(ModemLink);
+RTC_DATA_ATTR MotionRate motionRate;
+RTC_CHECK(MotionRate);
+RTC_DATA_ATTR TrackCompressor track;
+RTC_CHECK(TrackCompressor);
+RTC_DATA_ATTR BatteryEstimator batteryEstimator;
+RTC_CHECK(BatteryEstimator);
+RTC_DATA_ATTR Geofences geofences;
+RTC_CHECK(Geofences);
+RTC_DATA_ATTR GnssManager gnss;
+RTC_CHECK(GnssManager);
+// breaches not published yet, kept across deep sleep until they go out
+RTC_DATA_ATTR FenceAlert fence_alerts[GEOFENCE_MAX_FENCES];
+RTC_DATA_ATTR size_t fence_alert_count = 0;
+size_t fence_alerts_sent = 0;
+uint8_t alertBuff[GEOFENCE_MAX_FENCES * FENCE_ALERT_SIZE];
+SensorSampler sampler;
+MotionWake motionWake;
+AtEngine at;
+MqttUrcParser urcParser;
+MqttPublisher publisher;
+RTC_DATA_ATTR MqttSession mqttSession;
+RTC_CHECK(MqttSession);
+// also the MQTT client id, so kept for connects after deep sleep
+RTC_DATA_ATTR char imei[16] = {0}; // MUST use a 16 character buffer for IMEI!
+RTC_DATA_ATTR CircuitBreaker modem_breaker, data_breaker, gnss_breaker;
+RTC_CHECK(CircuitBreaker);
+// whether the modem answered, a parked modem is left alone until its retry
+RTC_DATA_ATTR bool modem_up = false;
+// a missing sensor only takes its readings away
+bool weather_ok = false, power_ok = false;
+// subsystem health, published when it changes
+char healthBuff[128];
+RTC_DATA_ATTR char health_sent[128] = {0};
 float latitude, longitude, speed_kph, heading, altitude, second,
   temperature, altitude2, pressure, humidity, voltage, current,
   power, battery;
 uint16_t year;
 uint8_t month, day, hour, minute;
+bool location_valid, weather_valid = false;
+uint32_t sample_time = 0;
+// power readings since the last published summary
+PowerStats power_cycle, power_pending;
+uint16_t power_sequence = 0;
+uint8_t powerBuff[POWER_STATS_SIZE];
+
+// Publish cycle, driven by AT command completions
+enum CycleStage {
+  CYCLE_IDLE,
+  CYCLE_RUNNING,  // waiting on GPS, MQTT state and publishes
+  CYCLE_DONE,     // everything queued, wrap up once it has been sent
+};
+CycleStage cycle_stage = CYCLE_IDLE;
+bool mqtt_connected = false;
+// publishData() runs once both the fix and the MQTT session are settled
+bool gnss_done = false, mqtt_done = false;
+int8_t gps_stat = -1;
+int backlog_batches = 0;
+// the backlog batches in flight, oldest first
+size_t batch_frames[BACKLOG_WINDOW];
+size_t window_batches = 0, window_done = 0;
+bool window_failed = false;
+// command acknowledgements not published yet, one line each
+char ackBuff[128];
+size_t ack_len = 0, ack_sent = 0;
+char gpsMessage[32];
+
+// AT command timeouts (ms)
+const uint32_t gnss_timeout = 2000;
+const uint32_t publish_timeout = 10000;
 
 // Power on the module
 void powerOn() {
@@ -83,22 +294,29 @@ void powerOn() {
   digitalWrite(FONA_PWRKEY, HIGH);
 }
 
-void moduleSetup() {
+bool moduleSetup(bool warm) {
   // Note: The SIM7000A baud rate seems to reset after being power cycled (SIMCom firmware thing)
   // SIM7000 takes about 3s to turn on but SIM7500 takes about 15s
   // Press reset button if the module is still turning on and the board doesn't find it.
   // When the module is on it should communicate right after pressing reset
-  
-  // Start at default SIM7000 shield baud rate
-  fonaSS.begin(115200, SERIAL_8N1, FONA_TX, FONA_RX); // baud rate, protocol, ESP32 RX pin, ESP32 TX pin
-
-  Serial.println(F("Configuring to 9600 baud"));
-  fonaSS.println("AT+IPR=9600"); // Set baud rate
-  delay(100); // Short pause to let the command run
-  fonaSS.begin(9600, SERIAL_8N1, FONA_TX, FONA_RX); // Switch to 9600
-  if (! fona.begin(fonaSS)) {
+
+  if (warm) {
+    // Back from deep sleep: the modem stayed on and configured at the
+    // negotiated rate but has to be pulsed out of PSM before it answers
+    if (modemPower.profile() == MODEM_PSM) powerOn();
+    if (!modemLink.begin(fonaSS, FONA_TX, FONA_RX, FONA_MAX_BAUD, true) || ! fona.begin(fonaSS)) {
+      Serial.println(F("Couldn't find FONA"));
+      return false;
+    }
+    type = fona.type();
+    modemPower.begin(fona, FONA_PWRKEY, catm_only, true);
+    return true;
+  }
+
+  // Starts at the default SIM7000 shield baud rate and steps up from there
+  if (!modemLink.begin(fonaSS, FONA_TX, FONA_RX, FONA_MAX_BAUD, false) || ! fona.begin(fonaSS)) {
     Serial.println(F("Couldn't find FONA"));
-    while (1); // Don't proceed if it couldn't find the device
+    return false; // retried later, see startModem()
   }
 
   type = fona.type();
@@ -126,213 +344,613 @@ void moduleSetup() {
   // Set modem to full functionality
   fona.setFunctionality(1); // AT+CFUN=1
   fona.setNetworkSettings(F("hologram")); // For Hologram SIM card
+  // Network mode selection; PSM/eDRX are applied per cycle from the battery level
+  modemPower.begin(fona, FONA_PWRKEY, catm_only, false);
 
   /*
   // Other examples of some things you can set:
-  fona.setPreferredMode(38); // Use LTE only, not 2G
-  fona.setPreferredLTEMode(1); // Use LTE CAT-M only, not NB-IoT
   fona.enableRTC(true);
 
-  fona.enableSleepMode(true);
-  fona.set_eDRX(1, 4, "0010");
-  fona.enablePSM(true);
-
   fona.setNetLED(false); // Disable network status LED
   */
   // Set the network status LED blinking pattern while connected to a network (see AT+SLEDS command)
   fona.setNetLED(true, 2, 64, 3000); // on/off, mode, timer_on, timer_off
-  while (!fona.enableGPS(true)) {
-    Serial.println("Failed to turn on gps");
-    delay(1000);
-  }
-  while (!fona.enableGPRS(true)) {
+#ifdef FONA_RI
+  // Pulse RI on incoming URCs so a command can wake us from deep sleep
+  fona.sendCheckReply(F("AT+CFGRI=1"), F("OK"));
+#endif
+  if (fona.enableGPRS(true)) {
+    data_breaker.success();
+  } else {
+    // retried from the publish cycles, see dataUp()
     Serial.println("Failed to turn on data");
-    delay(1000);
+    data_breaker.failure();
   }
   // Optionally configure HTTP gets to follow redirects over SSL.
   // Default is not to follow SSL redirects, however if you uncomment
   // the following line then redirects over SSL will be followed.
   fona.setHTTPSRedirect(true);
+  return true;
+}
+
+// brings the modem up, unless it is parked; warm when it stayed on and
+// configured through deep sleep
+bool startModem(bool warm) {
+  if (!modem_breaker.allow()) return false;
+  // Turn on the module by pulsing PWRKEY low for a little bit
+  // This amount of time depends on the specific module that's used
+  // Another pulse would turn it off again, so skip it after deep sleep
+  if (!warm) powerOn();
+  if (moduleSetup(warm)) {
+    modem_breaker.success();
+    return true;
+  }
+  modem_breaker.failure();
+  return false;
+}
+
+// whether there is a data connection, retrying it once its backoff is over
+bool dataUp() {
+  if (data_breaker.healthy()) return true;
+  if (!data_breaker.allow()) return false;
+  if (fona.enableGPRS(true)) {
+    data_breaker.success();
+    return true;
+  }
+  Serial.println("Failed to turn on data");
+  data_breaker.failure();
+  return false;
 }
 
 void initializeSensors() {
+  // a missing sensor is reported in the health status, the tracker runs on
+  // without its readings
+  I2cLock bus;
   Serial.println("initializing the temp sensor...");
-  if (!temp_sensor.begin()) {
-    Serial.println("could not find valid temp sensor!");
-    while (1);
-  }
+  weather_ok = temp_sensor.begin();
+  if (!weather_ok) Serial.println("could not find valid temp sensor!");
   Serial.println("initializing the power sensor...");
-  if (!power_sensor.begin()) {
+  power_ok = power_sensor.begin();
+  if (!power_ok) {
     Serial.println("could not find valid power sensor!");
-    while (1);
+    return;
   }
   power_sensor.setAveragingCount(INA260_COUNT_4);
   power_sensor.setVoltageConversionTime(INA260_TIME_140_us);
   power_sensor.setCurrentConversionTime(INA260_TIME_140_us);
 }
 
-int8_t checkGPS() {
-  // get gps status current
-  int8_t gps_stat = fona.GPSstatus();
-  String message;
-  if (gps_stat < 0)
-    message = "Failed to query gps data";
-  if (gps_stat == 0) message = "GPS off";
-  if (gps_stat == 1) message = "No GPS fix";
-  if (gps_stat == 2) message = "2D GPS fix";
-  if (gps_stat == 3) message = "3D GPS fix";
-  Serial.println(message);
-  const char* message_char = message.c_str();
-  if (gps_stat <= 2 && !fona.MQTT_publish(ERROR_TOPIC, message_char, strlen(message_char), 1, 0))
-    Serial.println("Failed to publish error message");
-  return gps_stat;
-}
-
-void getLocation() {
-  if (fona.getGPS(&latitude, &longitude, &speed_kph, &heading, &altitude, &year, &month, &day, &hour, &minute, &second)) {
-    Serial.println(F("---------------------"));
-    Serial.print(F("Latitude: ")); Serial.println(latitude, 6);
-    Serial.print(F("Longitude: ")); Serial.println(longitude, 6);
-    Serial.print(F("Speed: ")); Serial.println(speed_kph);
-    Serial.print(F("Heading: ")); Serial.println(heading);
-    Serial.print(F("Altitude: ")); Serial.println(altitude);
-    Serial.print(F("Year: ")); Serial.println(year);
-    Serial.print(F("Month: ")); Serial.println(month);
-    Serial.print(F("Day: ")); Serial.println(day);
-    Serial.print(F("Hour: ")); Serial.println(hour);
-    Serial.print(F("Minute: ")); Serial.println(minute);
-    Serial.print(F("Second: ")); Serial.println(second);
-    Serial.println(F("---------------------"));
-  } else {
-    Serial.println("could not get location");
-  }
+void setGPSMessage() {
+  if (gps_stat < 0) strcpy(gpsMessage, "Failed to query gps data");
+  if (gps_stat == 0) strcpy(gpsMessage, "GPS off");
+  if (gps_stat == 1) strcpy(gpsMessage, "No GPS fix");
+  if (gps_stat == 2) strcpy(gpsMessage, "2D GPS fix");
+  if (gps_stat == 3) strcpy(gpsMessage, "3D GPS fix");
+  Serial.println(gpsMessage);
+}
+
+void printLocation() {
+  Serial.println(F("---------------------"));
+  Serial.print(F("Latitude: ")); Serial.println(latitude, 6);
+  Serial.print(F("Longitude: ")); Serial.println(longitude, 6);
+  Serial.print(F("Speed: ")); Serial.println(speed_kph);
+  Serial.print(F("Heading: ")); Serial.println(heading);
+  Serial.print(F("Altitude: ")); Serial.println(altitude);
+  Serial.print(F("Year: ")); Serial.println(year);
+  Serial.print(F("Month: ")); Serial.println(month);
+  Serial.print(F("Day: ")); Serial.println(day);
+  Serial.print(F("Hour: ")); Serial.println(hour);
+  Serial.print(F("Minute: ")); Serial.println(minute);
+  Serial.print(F("Second: ")); Serial.println(second);
+  Serial.println(F("---------------------"));
+}
+
+void addTrackFix(const GnssInfo &info) {
+  TrackPoint p;
+  p.latitude = (int32_t)lroundf(info.latitude * 1e6);
+  p.longitude = (int32_t)lroundf(info.longitude * 1e6);
+  p.altitude = (int32_t)lroundf(info.altitude * 10);
+  p.timestamp = unixTime(info.year, info.month, info.day, info.hour, info.minute, (uint8_t)info.second);
+  track.add(p);
 }
 
-void getTime() {
-  char buffer[23];
-  fona.getTime(buffer, 23);  // make sure replybuffer is at least 23 bytes!
-  Serial.print(F("Time = ")); Serial.println(buffer);
+void checkFences(const GnssInfo &info) {
+  GeoPoint fix = { (int32_t)lroundf(info.latitude * 1e6), (int32_t)lroundf(info.longitude * 1e6) };
+  uint8_t exited[GEOFENCE_MAX_FENCES];
+  size_t n = geofences.check(fix, exited, GEOFENCE_MAX_FENCES);
+  for (size_t i = 0; i < n; i++) {
+    Serial.print(F("Left geofence ")); Serial.println(exited[i]);
+    if (fence_alert_count == GEOFENCE_MAX_FENCES) break;
+    FenceAlert &a = fence_alerts[fence_alert_count++];
+    a.id = exited[i];
+    a.timestamp = unixTime(info.year, info.month, info.day, info.hour, info.minute, (uint8_t)info.second);
+    a.fix = fix;
+  }
+  // a breach goes out right away instead of waiting for publish_interval;
+  // inside a cycle it is picked up by publishData()
+  if (n > 0 && cycle_stage == CYCLE_IDLE) next_publish = rtcMillis();
 }
 
-void getWeatherSensorData() {
-  // Measure temperature
-  temperature = temp_sensor.readTemperature();
-  Serial.print("Temperature = ");
-  Serial.print(temperature);
-  Serial.println(" *C");
+void onTrackFix(AtStatus status, const char *response, void *) {
+  GnssInfo info;
+  if (status == AT_OK && parseGnssInfo(response, info) && info.fix) {
+    gnss.fixed(info);
+    addTrackFix(info);
+    checkFences(info);
+  }
+}
 
-  pressure = temp_sensor.readPressure() / 100.0F;
-  Serial.print("Pressure = ");
-  Serial.print(pressure);
-  Serial.println(" hPa");
+void onGnssInfo(AtStatus status, const char *response, void *) {
+  // One AT+CGNSINF gives both the fix status and the location
+  GnssInfo info;
+  location_valid = false;
+  if (status != AT_OK || !parseGnssInfo(response, info)) {
+    gps_stat = -1;
+  } else {
+    gps_stat = gnssStatus(info);
+    location_valid = info.fix;
+  }
+  setGPSMessage();
+  if (!location_valid) {
+    Serial.println("could not get location");
+    return;
+  }
+  addTrackFix(info);
+  checkFences(info);
+  latitude = info.latitude;
+  longitude = info.longitude;
+  speed_kph = info.speed_kph;
+  heading = info.heading;
+  altitude = info.altitude;
+  year = info.year;
+  month = info.month;
+  day = info.day;
+  hour = info.hour;
+  minute = info.minute;
+  second = info.second;
+  printLocation();
+}
 
-  // altitude
-  altitude2 = temp_sensor.readAltitude(SENSORS_PRESSURE_SEALEVELHPA);
-  Serial.print("Real altitude = ");
-  Serial.print(altitude2);
-  Serial.println(" meters");
+void applySample(const SensorSample &s) {
+  voltage = s.voltage;
+  current = s.current;
+  power = s.power;
+  batteryEstimator.correct(voltage, current);
+  battery = batteryEstimator.percent();
+  if (s.weather) {
+    temperature = s.temperature;
+    pressure = s.pressure;
+    altitude2 = 44330.0 * (1.0 - pow(pressure / SENSORS_PRESSURE_SEALEVELHPA, 0.1903));
+    humidity = s.humidity;
+    weather_valid = true;
+  }
+  sample_time = s.timestamp;
+}
 
-  // humidity
-  humidity = temp_sensor.readHumidity();
-  Serial.print("Humidity = ");
-  Serial.print(humidity);
-  Serial.println(" %");
+void drainSamples() {
+  // only the newest reading is used, older ones were superseded
+  // but every power window counts
+  SensorSample s;
+  bool any = false;
+  while (sampler.pop(s)) {
+    power_cycle.merge(s.power_window);
+    batteryEstimator.addUsage(s.power_window);
+    any = true;
+  }
+  if (any) applySample(s);
 }
 
-void getPowerSensorData() {
-  // get power readings
-  // voltage
-  voltage = power_sensor.readBusVoltage();
+void printSensorData() {
+  Serial.print("Sampled ");
+  Serial.print(millis() - sample_time);
+  Serial.println(" ms ago");
+  if (weather_valid) {
+    Serial.print("Temperature = ");
+    Serial.print(temperature);
+    Serial.println(" *C");
+    Serial.print("Pressure = ");
+    Serial.print(pressure);
+    Serial.println(" hPa");
+    Serial.print("Real altitude = ");
+    Serial.print(altitude2);
+    Serial.println(" meters");
+    Serial.print("Humidity = ");
+    Serial.print(humidity);
+    Serial.println(" %");
+  }
   Serial.print("Voltage = ");
   Serial.println(voltage);
-
-  // current
-  current = power_sensor.readCurrent();
   Serial.print("Current = ");
   Serial.println(current);
-
-  // power
-  power = power_sensor.readPower();
   Serial.print("Power = ");
   Serial.println(power);
-
-  // battery
-  battery = (voltage - min_battery_voltage) / (max_battery_voltage - min_battery_voltage) * 100;
   Serial.print("Battery = ");
   Serial.println(battery);
   Serial.println(" %");
+  int32_t minutes = batteryEstimator.minutesRemaining();
+  if (minutes >= 0) {
+    Serial.print("Time remaining = ");
+    Serial.print(minutes / 60); Serial.print(" h ");
+    Serial.print(minutes % 60); Serial.println(" min");
+  }
+  Serial.print("Current min/mean/max = ");
+  Serial.print(power_cycle.current_min * 1000); Serial.print("/");
+  Serial.print(power_cycle.currentMean() * 1000); Serial.print("/");
+  Serial.print(power_cycle.current_max * 1000); Serial.println(" mA");
+  Serial.print("Used = ");
+  Serial.print(power_cycle.charge_mah, 3); Serial.print(" mAh, ");
+  Serial.print(power_cycle.energy_mwh, 3); Serial.print(" mWh over ");
+  Serial.print((uint32_t)((power_cycle.sampled_us + power_cycle.unsampled_us) / 1000000)); Serial.print(" s, ");
+  Serial.print((uint32_t)(power_cycle.unsampled_us / 1000000)); Serial.println(" s unsampled");
 }
 
-void connectMQTT() {
-  // If not already connected, connect to MQTT
-  if (!fona.MQTT_connectionStatus()) {
-    // Set up MQTT parameters (see MQTT app note for explanation of parameter values)
-    fona.MQTT_setParameter("URL", MQTT_SERVER, MQTT_PORT);
-    // Set up MQTT username and password if necessary
-    fona.MQTT_setParameter("USERNAME", MQTT_USERNAME);
-    fona.MQTT_setParameter("PASSWORD", MQTT_PASSWORD);
-    // fona.MQTT_setParameter("KEEPTIME", "30"); // Time to connect to server, 60s by default
-    
-    Serial.println(F("Connecting to MQTT broker..."));
-    if (!fona.MQTT_connect(true)) {
-      Serial.println("Failed to connect to MQTT broker!");
-    }
-    // Note the command below may error out if you're already subscribed to the topic!
-    fona.MQTT_subscribe(COMMAND_TOPIC, 1); // Topic name, QoS
+void sampleTelemetry(bool has_fix) {
+  // Pack everything into one binary frame so a cycle costs a single publish
+  TelemetrySample sample;
+  sample.flags = 0;
+  sample.timestamp = 0;
+  if (has_fix) {
+    sample.flags |= TELEMETRY_FLAG_FIX | TELEMETRY_FLAG_TIME;
+    sample.timestamp = unixTime(year, month, day, hour, minute, (uint8_t)second);
+  }
+  if (weather_valid) sample.flags |= TELEMETRY_FLAG_WEATHER;
+  sample.latitude = latitude;
+  sample.longitude = longitude;
+  sample.speed_kph = speed_kph;
+  sample.heading = heading;
+  sample.altitude = altitude;
+  sample.voltage = voltage;
+  sample.current = current;
+  sample.power = power;
+  sample.battery = battery;
+  sample.temperature = temperature;
+  sample.pressure = pressure;
+  sample.humidity = humidity;
+  uint16_t sequence = telemetry_sequence++;
+  encodeTelemetryFrame(sample, sequence, telemetryBuff);
+  // the frame's fields as they will be decoded, not as sampled
+  char text[TELEMETRY_TEXT_SIZE];
+  formatTelemetry(sample, sequence, text);
+  Serial.print(F("Frame: ")); Serial.println(text);
+}
+
+void onBatchPublished(AtStatus status, const char *, void *);
+
+bool queueBacklogWindow() {
+  // Frames are sent back to back, oldest first, several batches at a time
+  size_t frames = backlog.peek(backlogBuff, BACKLOG_WINDOW * BACKLOG_MAX_BATCH);
+  window_batches = window_done = 0;
+  window_failed = false;
+  for (size_t off = 0; off < frames && backlog_batches < max_backlog_batches; off += BACKLOG_MAX_BATCH) {
+    size_t n = frames - off < BACKLOG_MAX_BATCH ? frames - off : BACKLOG_MAX_BATCH;
+    if (!publisher.publish(TELEMETRY_TOPIC, MQTT_BACKLOG, backlogBuff + off * TELEMETRY_FRAME_SIZE,
+                           n * TELEMETRY_FRAME_SIZE, onBatchPublished)) break;
+    batch_frames[window_batches++] = n;
+    backlog_batches++;
+  }
+  return window_batches > 0;
+}
+
+void onBatchPublished(AtStatus status, const char *, void *) {
+  size_t i = window_done++;
+  if (status != AT_OK) {
+    if (!window_failed) Serial.println(F("Failed to publish telemetry backlog"));
+    window_failed = true;
+  } else if (!window_failed) {
+    // the batch is QoS 1, so OK means the broker has it. A later batch
+    // going through after a failed one is sent again, the backlog can only
+    // drop its oldest frames
+    backlog.pop(batch_frames[i]);
+  }
+  if (window_done < window_batches) return;
+  // at most max_backlog_batches publishes per cycle so a long outage does
+  // not keep the modem busy for minutes in one go
+  if (!window_failed && backlog_batches < max_backlog_batches && queueBacklogWindow()) return;
+  if (backlog.size() > 0) {
+    Serial.print(backlog.size());
+    Serial.println(F(" frames still queued"));
+  }
+}
+
+void onLivePublished(AtStatus status, const char *, void *) {
+  if (status == AT_OK) return;
+  // the frame missed its cycle, the backlog sends it again at QoS 1
+  if (!backlog.push(telemetryBuff)) Serial.println(F("Failed to publish telemetry"));
+}
+
+void onTrackPublished(AtStatus status, const char *, void *) {
+  if (status == AT_OK) {
+    track.pop(track_points);
+    last_track_publish = rtcMillis();
+  }
+  else Serial.println(F("Failed to publish track"));
+}
+
+void queueTrack() {
+  // the kept points since the last publish, oldest first; the newest fix
+  // goes out in the telemetry frame, so the open window can stay open
+  size_t n = track.peek(trackPoints, TRACK_MAX_POINTS);
+  if (n == 0) return;
+  // whatever does not fit goes out with the next publish
+  size_t len = encodeTrack(trackPoints, n, trackBuff, sizeof(trackBuff), &track_points);
+  Serial.print(F("Track points: ")); Serial.print(track_points);
+  Serial.print(F(" in ")); Serial.print(len); Serial.println(F(" bytes"));
+  publisher.publish(TRACK_TOPIC, MQTT_TRACK, trackBuff, len, onTrackPublished);
+}
+
+void onAlertsPublished(AtStatus status, const char *, void *) {
+  if (status != AT_OK) {
+    // kept for the next cycle
+    Serial.println(F("Failed to publish fence alerts"));
+    return;
+  }
+  // breaches found while this publish was queued stay pending
+  fence_alert_count -= fence_alerts_sent;
+  memmove(fence_alerts, fence_alerts + fence_alerts_sent, fence_alert_count * sizeof(FenceAlert));
+}
+
+void queueAlerts() {
+  if (fence_alert_count == 0) return;
+  for (size_t i = 0; i < fence_alert_count; i++) {
+    encodeFenceAlert(fence_alerts[i], alertBuff + i * FENCE_ALERT_SIZE);
   }
+  fence_alerts_sent = fence_alert_count;
+  publisher.publish(ALERT_TOPIC, MQTT_ALERT, alertBuff, fence_alert_count * FENCE_ALERT_SIZE, onAlertsPublished);
+}
+
+void onPowerPublished(AtStatus status, const char *, void *) {
+  // a failed summary is folded into the next one
+  if (status != AT_OK) power_cycle.merge(power_pending);
+  power_pending.reset();
 }
 
-void getData() {
-  // getWeatherSensorData();
-  getPowerSensorData();
-  getLocation();
+void queuePowerStats() {
+  if (power_cycle.samples == 0) return;
+  encodePowerStats(power_cycle, power_sequence++, batteryEstimator.minutesRemaining(), powerBuff);
+  power_pending = power_cycle;
+  power_cycle.reset();
+  publisher.publish(POWER_TOPIC, MQTT_TELEMETRY, powerBuff, POWER_STATS_SIZE, onPowerPublished);
 }
 
-void publishLocationData() {
-  // Format the floating point numbers
-  dtostrf(latitude, 1, 6, latBuff); // float_val, min_width, digits_after_decimal, char_buffer
-  dtostrf(longitude, 1, 6, longBuff);
-  dtostrf(speed_kph, 1, 0, speedBuff);
-  dtostrf(heading, 1, 0, headBuff);
-  dtostrf(altitude, 1, 1, altBuff);
-  // Construct a combined, comma-separated location array
-  sprintf(locBuff, "%s,%s,%s,%s,%s", speedBuff, latBuff, longBuff, altBuff, headBuff); // This could look like "10,33.123456,-85.123456,120.5,50"
-  // Parameters for MQTT_publish: Topic, message (0-512 bytes), message length, QoS (0-2), retain (0-1)
-  if (!fona.MQTT_publish(GPS_TOPIC, locBuff, strlen(locBuff), 1, 0))
-    Serial.println(F("Failed to publish location")); // Send GPS location
+void onAcksPublished(AtStatus status, const char *, void *) {
+  // kept for the next cycle if they did not go out
+  if (status != AT_OK) return;
+  // commands handled while this publish was queued stay pending
+  ack_len -= ack_sent;
+  memmove(ackBuff, ackBuff + ack_sent, ack_len);
 }
 
-void publishWeatherSensorData() {
-  // Format the floating point numbers
-  dtostrf(temperature, 1, 2, tempBuff); // float_val, min_width, digits_after_decimal, char_buffer
-  dtostrf(pressure, 1, 2, pressureBuff); // float_val, min_width, digits_after_decimal, char_buffer
-  dtostrf(altitude2, 1, 2, altBuff2); // float_val, min_width, digits_after_decimal, char_buffer
-  dtostrf(humidity, 1, 2, humidityBuff); // float_val, min_width, digits_after_decimal, char_buffer
-  sprintf(weatherBuff, "%s,%s,%s,%s,%s", tempBuff, pressureBuff, altBuff2, humidityBuff);
-  if (!fona.MQTT_publish(WEATHER_TOPIC, weatherBuff, strlen(weatherBuff), 1, 0))
-    Serial.println("Failed to publish humidity");
+void queueAcks() {
+  if (ack_len == 0) return;
+  ack_sent = ack_len;
+  publisher.publish(ACK_TOPIC, MQTT_ACK, (const uint8_t *)ackBuff, ack_len, onAcksPublished);
 }
 
-void publishPowerSensorData() {
-  // Format the floating point numbers
-  dtostrf(voltage, 1, 2, voltageBuff); // float_val, min_width, digits_after_decimal, char_buffer
-  dtostrf(current, 1, 2, currentBuff); // float_val, min_width, digits_after_decimal, char_buffer
-  dtostrf(current, 1, 2, currentBuff); // float_val, min_width, digits_after_decimal, char_buffer
-  dtostrf(battery, 1, 2, battBuff); // float_val, min_width, digits_after_decimal, char_buffer
-  sprintf(batteryBuff, "%s,%s,%s,%s", voltageBuff, currentBuff, powerBuff, battBuff);
-  if (!fona.MQTT_publish(BATTERY_TOPIC, batteryBuff, strlen(batteryBuff), 1, 0))
-    Serial.println("Failed to publish battery level");
+size_t healthStatus(char *out, size_t size) {
+  // "modem=ok data=retry 2 gnss=open 1 mqtt=ok power=ok weather=off"
+  const CircuitBreaker *breakers[] = { &modem_breaker, &data_breaker, &gnss_breaker, &mqttSession.health() };
+  size_t n = 0;
+  for (size_t i = 0; i < sizeof(breakers) / sizeof(breakers[0]); i++) {
+    n += breakers[i]->status(out + n, size - n);
+    if (n + 1 < size) out[n++] = ' ';
+  }
+  const char *weather = !sample_weather ? "off" : weather_ok ? "ok" : "missing";
+  int m = snprintf(out + n, size - n, "power=%s weather=%s", power_ok ? "ok" : "missing", weather);
+  if (m > 0) n += (size_t)m < size - n ? m : size - n - 1;
+  return n;
+}
+
+void onHealthPublished(AtStatus status, const char *, void *) {
+  // sent again with the next cycle otherwise
+  if (status == AT_OK) strcpy(health_sent, healthBuff);
+}
+
+void queueHealth() {
+  if (strcmp(healthBuff, health_sent) == 0) return;
+  publisher.publish(HEALTH_TOPIC, MQTT_HEALTH, (const uint8_t *)healthBuff, strlen(healthBuff), onHealthPublished);
 }
 
 void publishData() {
-  // Now publish all the GPS, voltage and temperature data to their topics
-  getData();
-  if (checkGPS() >= (int8_t)2) {
-    publishLocationData();
+  healthStatus(healthBuff, sizeof(healthBuff));
+  Serial.print(F("Health: ")); Serial.println(healthBuff);
+  // Alerts first, they are what the cycle may have been started for
+  if (mqtt_connected) queueAlerts();
+  if (mqtt_connected) queueHealth();
+  if (mqtt_connected) queueAcks();
+  drainSamples();
+  printSensorData();
+  sampleTelemetry(gps_stat >= (int8_t)2 && location_valid);
+  if (mqtt_connected && gps_stat <= 2) {
+    // best effort, the telemetry below is what matters
+    publisher.publish(ERROR_TOPIC, MQTT_STATUS, (const uint8_t *)gpsMessage, strlen(gpsMessage));
+  }
+  bool track_due = rtcMillis() - last_track_publish >= track_batch_interval ||
+                   motionRate.state() == MOTION_PARKED;
+  if (mqtt_connected && track_due) queueTrack();
+  if (mqtt_connected) queuePowerStats();
+  backlog_batches = 0;
+  if (mqtt_connected) {
+    // frames that missed their cycle first, then this one live; it only
+    // joins the backlog if it does not go out
+    queueBacklogWindow();
+    if (!publisher.publish(TELEMETRY_TOPIC, MQTT_TELEMETRY, telemetryBuff, TELEMETRY_FRAME_SIZE, onLivePublished)) {
+      onLivePublished(AT_ERROR, "", nullptr);
+    }
+  } else if (!backlog.push(telemetryBuff)) {
+    Serial.println(F("Failed to publish telemetry"));
+  }
+  // everything for this connection window is queued, send it in one go
+  publisher.flush();
+  cycle_stage = CYCLE_DONE;
+}
+
+void maybePublish() {
+  if (gnss_done && mqtt_done) publishData();
+}
+
+void onCycleFix(AtStatus status, const char *response, void *) {
+  onGnssInfo(status, response, nullptr);
+  if (location_valid) gnss_breaker.success();
+  else gnss_breaker.failure();
+  gnss_done = true;
+  maybePublish();
+}
+
+void onMqttReady(bool connected, void *) {
+  mqtt_connected = connected;
+  mqtt_done = true;
+  maybePublish();
+}
+
+void armMotionWake() {
+  // only while parked, a moving bike would wake us on every bump
+  if (motionRate.state() != MOTION_PARKED || motionWake.sensor() == MOTION_SENSOR_NONE) return;
+  if (!motionWake.armed()) scheduler.wakeOnMotion(motionWake.arm());
+}
+
+void disarmMotionWake() {
+  motionWake.disarm();
+  scheduler.wakeOnMotion(-1);
+}
+
+void onMotion() {
+  Serial.println(F("Motion detected"));
+  disarmMotionWake();
+  motionRate.moved();
+  // report right away instead of at the parked interval
+  if (cycle_stage == CYCLE_IDLE) next_publish = rtcMillis();
+}
+
+bool trackSampling() {
+  // the modem's UART is off in PSM, so the track is only sampled otherwise,
+  // and not at all on a critical battery
+  return motionRate.state() != MOTION_PARKED && modemPower.profile() != MODEM_PSM && battery >= critical_battery;
+}
+
+void startCycle() {
+  // the sampler reads the sensors on the other core while the modem answers
+  sampler.request();
+  cycle_stage = CYCLE_RUNNING;
+  if (!modem_up && startModem(false)) {
+    modem_up = true;
+    // it came up from scratch, nothing from before is left on it
+    mqttSession.begin(at, mqtt_config, imei, false);
+    gnss.begin(at, fona, gnss_config, false);
   }
-  publishWeatherSensorData();
-  publishPowerSensorData();
-  last_publish = millis();
+  if (modem_up && !modemPower.wake()) data_breaker.failure();
+  // parked subsystems sit the cycle out, the sample goes to the backlog
+  bool fix_wanted = modem_up && gnss_breaker.allow();
+  bool session_wanted = modem_up && dataUp();
+  gnss_done = !fix_wanted;
+  mqtt_done = !session_wanted;
+  if (!fix_wanted) {
+    gps_stat = 0;
+    location_valid = false;
+    setGPSMessage();
+  }
+  if (!session_wanted) mqtt_connected = false;
+  // the fix can take a while on a cold start, MQTT is set up meanwhile
+  if (fix_wanted) gnss.acquire(onCycleFix);
+  if (session_wanted) mqttSession.ensure(onMqttReady);
+  if (!fix_wanted && !session_wanted) publishData();
+}
+
+void finishCycle() {
+  publish_interval = motionRate.update(location_valid, speed_kph, heading, current * 1000);
+  if (motionRate.state() == MOTION_PARKED && motionWake.sensor() != MOTION_SENSOR_NONE) {
+    // the motion sensor wakes us when it matters, the timer is only a heartbeat
+    publish_interval = motion_limits.parked_max_interval;
+  } else if (motionWake.armed()) {
+    disarmMotionWake();
+  }
+  if (battery < critical_battery && publish_interval < (int)motion_limits.parked_max_interval) {
+    // low battery: keep reporting, but only as often as when parked
+    publish_interval = motion_limits.parked_max_interval;
+  }
+  Serial.print(F("Motion: ")); Serial.print(motionStateName(motionRate.state()));
+  Serial.print(F(", next publish in ")); Serial.print(publish_interval / 1000); Serial.println(F(" s"));
+  // close the track once stopped, it goes out with the next publish
+  if (motionRate.state() == MOTION_PARKED) track.flush();
+  last_publish = rtcMillis();
+  next_publish = last_publish + publish_interval;
+  if (modem_up) {
+    // battery is fresh from this cycle's sample
+    modemPower.apply(modemPower.choose(battery, publish_interval));
+    // another start costs more than keeping the receiver on while the track
+    // is sampled
+    gnss.release(trackSampling());
+    modemPower.idle();
+  }
+  modemPower.printEnergy();
+  gnss.printStats();
+  mqttSession.printStats();
+  if (power_ok) {
+    Serial.print(F("Sampler stack free ")); Serial.print(sampler.stackFree()); Serial.println(F(" bytes"));
+  }
+  batteryEstimator.persist();
+  cycle_stage = CYCLE_IDLE;
+}
+
+void printView(TextView v) {
+  Serial.write((const uint8_t *)v.data, v.len);
+  Serial.println();
+}
+
+void ackCommand(TextView message, bool ok) {
+  // "<command> ok|invalid", the command cut short; goes out with the next cycle
+  const char *result = ok ? " ok\n" : " invalid\n";
+  size_t n = message.len < 32 ? message.len : 32;
+  if (ack_len + n + strlen(result) > sizeof(ackBuff)) return;
+  memcpy(ackBuff + ack_len, message.data, n);
+  memcpy(ackBuff + ack_len + n, result, strlen(result));
+  ack_len += n + strlen(result);
+}
+
+void onCommand(TextView topic, TextView message, void *) {
+  Serial.println(F("*** Received MQTT message! ***"));
+  Serial.print(F("Topic: ")); printView(topic);
+  Serial.print(F("Message: ")); printView(message);
+  int current_time = rtcMillis();
+  bool ok = true;
+  if (message.equals("connect")) {
+    if (next_publish - current_time > min_publish_interval) {
+      next_publish = current_time + min_publish_interval;
+    } else {
+      Serial.println("next connect output already queued");
+    }
+  } else if (message.len > 6 && memcmp(message.data, "fence ", 6) == 0) {
+    if (geofences.command(message.data + 6, message.len - 6)) {
+      Serial.print(geofences.size()); Serial.println(F(" geofences set"));
+    } else {
+      Serial.println(F("invalid fence command"));
+      ok = false;
+    }
+  } else if (message.equals("poll")) {
+    if (next_publish - current_time < publish_interval) {
+      Serial.println("next poll output already queued");
+    } else if (current_time - last_publish < publish_interval) {
+      next_publish = current_time + min_publish_interval;
+    } else {
+      next_publish = current_time;
+    }
+  } else {
+    Serial.println("invalid topic given");
+    ok = false;
+  }
+  ackCommand(message, ok);
+}
+
+void onUnknownTopic(TextView topic, TextView, void *) {
+  Serial.print(F("No handler for topic ")); printView(topic);
+}
+
+void handleUrc(const char *line, size_t len, void *) {
+  Serial.write((const uint8_t *)line, len);
+  Serial.println();
+  gnss.onUrc(line, len);
+  // the engine hands over complete lines without their ending
+  urcParser.feed(line, len);
+  urcParser.feed('\n');
 }
 
 void setup() {
@@ -342,73 +960,95 @@ void setup() {
   while (!Serial);
   Serial.begin(BAUD_RATE);
   Serial.println("ESP32");
-  Serial.println("Initializing....(May take several seconds)");
+#ifdef FONA_RI
+  scheduler.begin(FONA_RI, FONA_UART);
+#else
+  scheduler.begin(-1, FONA_UART);
+#endif
+  bool warm = scheduler.resumedFromDeepSleep();
+  Serial.println(warm ? "Waking from deep sleep" : "Initializing....(May take several seconds)");
   initializeSensors();
+  motionRate.begin(motion_limits);
+  track.begin(track_tolerance);
+  power_cycle.reset();
+  power_pending.reset();
+#ifdef INA260_ALERT
+  int8_t power_alert = INA260_ALERT;
+#else
+  int8_t power_alert = -1;
+#endif
+  if (power_ok && !sampler.begin(power_sensor, sample_weather && weather_ok ? &temp_sensor : nullptr,
+                                 sample_interval, sampler_core, power_alert)) {
+    Serial.println("could not start the sensor sampler");
+  }
+  if (!power_ok) power_alert = -1;
+#ifdef IMU_INT
+  int8_t imu_int = IMU_INT;
+#else
+  int8_t imu_int = -1;
+#endif
+  MotionSensor motion_sensor = motionWake.begin(power_sensor, imu_int, power_alert, power_alert >= 0,
+                                                motion_wake_current_ma);
+  Serial.print(F("Motion wake: ")); Serial.println(motionSensorName(motion_sensor));
+  if (!backlog.begin()) {
+    Serial.println("could not open the telemetry backlog, publishing live only");
+  }
+  // falls back to the voltage if nothing was saved
+  batteryEstimator.begin(battery_config);
+  // without the INA260 the level is unknown, which must not hold back the
+  // publish rate
+  if (!power_ok) battery = 100;
+  geofences.begin();
 
   pinMode(FONA_RST, OUTPUT);
   digitalWrite(FONA_RST, HIGH); // Default state
 
   pinMode(FONA_PWRKEY, OUTPUT);
+  digitalWrite(FONA_PWRKEY, HIGH);
 
-  // Turn on the module by pulsing PWRKEY low for a little bit
-  // This amount of time depends on the specific module that's used
-  powerOn(); // See function definition at the very end of the sketch
-  moduleSetup();
-  getData(); // get data on startup
+  modem_breaker.begin("modem", modem_retry, warm);
+  data_breaker.begin("data", data_retry, warm);
+  gnss_breaker.begin("gnss", gnss_retry, warm);
+  // after deep sleep the modem stayed on and configured, unless it was down
+  bool modem_warm = warm && modem_up;
+  modem_up = startModem(modem_warm);
+  // From here on the modem is only driven through the AT engine
+  at.begin(fonaSS);
+  at.onUrc(handleUrc);
+  publisher.begin(at, publish_timeout);
+  mqttSession.begin(at, mqtt_config, imei, modem_warm);
+  gnss.begin(at, fona, gnss_config, modem_warm);
+  urcParser.on(COMMAND_TOPIC, onCommand);
+  urcParser.onUnhandled(onUnknownTopic);
+  if (scheduler.bootReason() == WAKE_MOTION) onMotion();
 }
 
-void handleSubscribe() {
-  if (fona.available()) {
-    uint8_t i = 0;
-    while (fona.available()) {
-      replybuffer[i] = fona.read();
-      i++;
-    }
-    Serial.print(replybuffer);
-    delay(100); // Make sure it prints and also allow other stuff to run properly
-
-    // Format: +SMSUB: "topic_name","message"
-    String reply = String(replybuffer);
-    Serial.println(reply);
-
-    if (reply.indexOf("+SMSUB: ") != -1) {
-      Serial.println(F("*** Received MQTT message! ***"));
-      // Chop off the "SMSUB: " part plus the beginning quote
-      // After this, reply should be: "topic_name","message"
-      reply = reply.substring(9);
-      uint8_t idx = reply.indexOf("\",\""); // Search for second quote
-      String topic = reply.substring(1, idx); // Grab only the text (without quotes)
-      String message = reply.substring(idx+3, reply.length()-3);
-      Serial.print(F("Topic: ")); Serial.println(topic);
-      Serial.print(F("Message: ")); Serial.println(message);
-      // Do something with the message
-      int current_time = millis();
-      if (message == "connect") {
-        if (next_publish - current_time > min_publish_interval) {
-          next_publish = current_time + min_publish_interval;
-        } else {
-          Serial.println("next connect output already queued");
-        }
-      } else if (message == "poll") {
-        if (next_publish - current_time < publish_interval) {
-          Serial.println("next poll output already queued");
-        } else if (current_time - last_publish < publish_interval) {
-          next_publish = current_time + min_publish_interval;
-        } else {
-          next_publish = current_time;
-        }
-      } else {
-        Serial.println("invalid topic given");
-      }
+void loop() {
+  // Never blocks: the engine moves whatever UART bytes are ready and runs
+  // the completion callbacks that advance the publish cycle
+  at.poll();
+  publisher.poll();
+  gnss.poll();
+  drainSamples();
+  // the cycle starts with the blocking driver (power-up, PSM wake, data),
+  // so a track fix still in flight on the engine has to finish first
+  if (cycle_stage == CYCLE_IDLE && at.idle() && rtcMillis() - next_publish >= 0) startCycle();
+  if (cycle_stage == CYCLE_DONE && at.idle() && publisher.idle()) finishCycle();
+  int wake_at = next_publish;
+  if (trackSampling() && gnss.powered()) {
+    if (cycle_stage == CYCLE_IDLE && at.idle() && rtcMillis() - next_track_sample >= 0) {
+      next_track_sample = rtcMillis() + track_sample_interval;
+      at.send("AT+CGNSINF", gnss_timeout, onTrackFix);
     }
+    if (next_track_sample - wake_at < 0) wake_at = next_track_sample;
   }
-}
-
-void loop() {
-  if (millis() > next_publish) {
-    connectMQTT();
-    getTime();
-    publishData();
+  // Sleep until the next publish or track sample is due, the modem wakes
+  // us with a command or the bike is moved
+  if (cycle_stage == CYCLE_IDLE && at.idle()) {
+    armMotionWake();
+    if (scheduler.idleUntil(wake_at) == WAKE_MOTION) onMotion();
+  } else if (cycle_stage == CYCLE_RUNNING && at.idle() && gnss.searching()) {
+    // nothing else to do while the receiver looks for satellites
+    scheduler.idleUntil(gnss.nextPollAt());
   }
-  handleSubscribe();
 }
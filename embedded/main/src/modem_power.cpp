@@ -0,0 +1,133 @@
+#include "modem_power.h"
+
+#include <Arduino.h>
+#include "power_scheduler.h"
+
+namespace {
+
+// Battery thresholds (%) below which the profile is forced down
+const float psm_battery = 20;
+const float edrx_battery = 50;
+// Publish intervals (ms) from which the cheaper profiles pay off: a PSM
+// wake costs a PWRKEY pulse and a reconnect, eDRX delays commands
+const uint32_t psm_interval = 10UL * 60 * 1000;
+const uint32_t edrx_interval = 60UL * 1000;
+
+// eDRX cycle for LTE-M, "0010" is 20.48 s
+char edrx_cycle[] = "0010";
+
+// SIM7000 datasheet currents (mA) used for the charge estimate
+const float state_current[MODEM_POWER_STATES] = { 100, 9, 1.0, 0.01 };
+const char *state_name[MODEM_POWER_STATES] = { "active", "idle", "eDRX", "PSM" };
+
+// registration attempts after a wake before enabling data from scratch
+const int registration_tries = 10;
+
+}
+
+void ModemPower::begin(Adafruit_FONA_LTE &f, uint8_t pwrkey, bool catm_only, bool warm) {
+  fona = &f;
+  pwrkey_pin = pwrkey;
+  if (warm) return;
+  // whatever it kept from before is unknown, so everything is sent again
+  current = MODEM_ALWAYS_ON;
+  applied = false;
+  state_since = rtcMillis();
+  if (catm_only) {
+    fona->setPreferredMode(38);    // LTE only, not 2G
+    fona->setPreferredLTEMode(1);  // LTE CAT-M only, not NB-IoT
+  }
+}
+
+ModemPowerProfile ModemPower::choose(float battery, uint32_t publish_interval_ms) const {
+  if (battery < psm_battery || publish_interval_ms >= psm_interval) return MODEM_PSM;
+  if (battery < edrx_battery || publish_interval_ms >= edrx_interval) return MODEM_EDRX;
+  return MODEM_ALWAYS_ON;
+}
+
+bool ModemPower::apply(ModemPowerProfile profile) {
+  if (applied && profile == current) return true;
+  bool ok = true;
+  // the modem only honours one low-power mode at a time
+  if ((!applied || current == MODEM_PSM) && profile != MODEM_PSM) ok &= fona->enablePSM(false);
+  if ((!applied || current == MODEM_EDRX) && profile != MODEM_EDRX) ok &= fona->set_eDRX(0, 4, edrx_cycle);
+  if (profile == MODEM_EDRX) ok &= fona->set_eDRX(1, 4, edrx_cycle);
+  if (profile == MODEM_PSM) ok &= fona->enablePSM(true);
+  if (ok) {
+    current = profile;
+    applied = true;
+    Serial.print(F("Modem power profile: "));
+    Serial.println(profile == MODEM_PSM ? F("PSM") : profile == MODEM_EDRX ? F("eDRX") : F("always on"));
+  }
+  return ok;
+}
+
+bool ModemPower::waitForModem() {
+  for (int i = 0; i < 5; i++) {
+    if (fona->sendCheckReply(F("AT"), F("OK"))) return true;
+    delay(200);
+  }
+  return false;
+}
+
+bool ModemPower::wake() {
+  enterState(MODEM_STATE_ACTIVE);
+  // outside PSM the modem stays registered, nothing to do on the UART
+  if (current != MODEM_PSM) return true;
+  if (!fona->sendCheckReply(F("AT"), F("OK"))) {
+    // a short PWRKEY pulse brings the SIM7000 out of PSM
+    digitalWrite(pwrkey_pin, LOW);
+    delay(100);
+    digitalWrite(pwrkey_pin, HIGH);
+    if (!waitForModem()) {
+      Serial.println(F("Modem did not wake from PSM"));
+      return false;
+    }
+  }
+  // PSM keeps the registration and PDP context, so this is normally instant
+  for (int i = 0; i < registration_tries; i++) {
+    uint8_t status = fona->getNetworkStatus();
+    if (status == 1 || status == 5) return true;
+    delay(500);
+  }
+  Serial.println(F("Not registered after wake, re-enabling data"));
+  return fona->enableGPRS(true);
+}
+
+void ModemPower::idle() {
+  if (current == MODEM_PSM) enterState(MODEM_STATE_PSM);
+  else if (current == MODEM_EDRX) enterState(MODEM_STATE_EDRX);
+  else enterState(MODEM_STATE_IDLE);
+}
+
+void ModemPower::enterState(ModemPowerState s) {
+  int32_t now = rtcMillis();
+  state_ms[state] += now - state_since;
+  state_since = now;
+  state = s;
+}
+
+uint32_t ModemPower::stateMillis(ModemPowerState s) {
+  enterState(state); // bring the running state up to date
+  return state_ms[s];
+}
+
+float ModemPower::stateMilliampHours(ModemPowerState s) {
+  return stateMillis(s) / 3600000.0 * state_current[s];
+}
+
+void ModemPower::printEnergy() {
+  float total = 0;
+  Serial.print(F("Modem energy:"));
+  for (int s = 0; s < MODEM_POWER_STATES; s++) {
+    float q = stateMilliampHours((ModemPowerState)s);
+    total += q;
+    Serial.print(' ');
+    Serial.print(state_name[s]);
+    Serial.print('=');
+    Serial.print(q, 3);
+  }
+  Serial.print(F(" total="));
+  Serial.print(total, 3);
+  Serial.println(F(" mAh"));
+}
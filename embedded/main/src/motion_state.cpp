@@ -0,0 +1,77 @@
+#include "motion_state.h"
+
+#include <math.h>
+
+namespace {
+
+// falling back a state needs the speed to drop this far below its threshold,
+// so GPS noise around a threshold does not flip the rate every cycle
+const float hysteresis = 0.75;
+// below this the GPS course is noise
+const float min_turn_kph = 1;
+// weight of each parked sample in the current baseline
+const float baseline_weight = 0.2;
+
+float headingChange(float from, float to) {
+  float d = fabsf(to - from);
+  return d > 180 ? 360 - d : d;
+}
+
+}
+
+void MotionRate::begin(const MotionLimits &l) {
+  limits = l;
+}
+
+MotionState MotionRate::classify(bool has_fix, float speed_kph, float heading, float current_ma) {
+  bool spike = motion_seen || (limits.current_spike_ma > 0 && baseline_ma >= 0 &&
+                               current_ma - baseline_ma > limits.current_spike_ma);
+  if (!has_fix) {
+    // no speed to go on, only a spike or the motion sensor can tell us the
+    // bike moved
+    last_heading = -1;
+    if (spike && current == MOTION_PARKED) return MOTION_WALKING;
+    return current;
+  }
+
+  float riding = limits.riding_kph;
+  float walking = limits.walking_kph;
+  if (current == MOTION_RIDING) riding *= hysteresis;
+  if (current != MOTION_PARKED) walking *= hysteresis;
+
+  bool turned = last_heading >= 0 && speed_kph >= min_turn_kph &&
+                headingChange(last_heading, heading) > limits.turn_degrees;
+  last_heading = speed_kph >= min_turn_kph ? heading : -1;
+
+  if (speed_kph >= riding) return MOTION_RIDING;
+  if (speed_kph >= walking || turned || spike) return MOTION_WALKING;
+  return MOTION_PARKED;
+}
+
+uint32_t MotionRate::update(bool has_fix, float speed_kph, float heading, float current_ma) {
+  MotionState next = classify(has_fix, speed_kph, heading, current_ma);
+  motion_seen = false;
+  if (next == MOTION_RIDING) {
+    interval_ms = limits.riding_interval;
+  } else if (next == MOTION_WALKING) {
+    interval_ms = limits.walking_interval;
+  } else if (current != MOTION_PARKED || interval_ms < limits.parked_interval) {
+    interval_ms = limits.parked_interval;
+  } else {
+    // still parked, back off
+    interval_ms = interval_ms > limits.parked_max_interval / 2 ? limits.parked_max_interval : interval_ms * 2;
+  }
+  if (next == MOTION_PARKED) {
+    baseline_ma = baseline_ma < 0 ? current_ma : baseline_ma + baseline_weight * (current_ma - baseline_ma);
+  }
+  current = next;
+  return interval_ms;
+}
+
+const char *motionStateName(MotionState state) {
+  switch (state) {
+    case MOTION_RIDING: return "riding";
+    case MOTION_WALKING: return "walking";
+    default: return "parked";
+  }
+}
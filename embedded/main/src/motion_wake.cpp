@@ -0,0 +1,90 @@
+#include "motion_wake.h"
+
+#include <Arduino.h>
+#include "i2c_bus.h"
+
+namespace {
+
+// MPU6050 motion threshold in 2 mg steps and duration in ms at 1 kHz;
+// enough to ignore wind and a passing truck, not a bike being wheeled off
+const uint8_t imu_threshold = 20;
+const uint8_t imu_duration = 20;
+
+}
+
+MotionSensor MotionWake::begin(Adafruit_INA260 &power, int8_t imu_pin, int8_t alert_pin, bool shared_alert,
+                               float wake_current_ma) {
+  power_sensor = &power;
+  shared = shared_alert;
+  limit_ma = wake_current_ma;
+  is_armed = false;
+  source = MOTION_SENSOR_NONE;
+  pin = -1;
+  // the sensor sampler is already reading the INA260 on the other core
+  I2cLock bus;
+  if (imu_pin >= 0 && imu.begin()) {
+    // the accelerometer alone, sampled a few times a second in cycle mode
+    imu.setHighPassFilter(MPU6050_HIGHPASS_0_63_HZ);
+    imu.setMotionDetectionThreshold(imu_threshold);
+    imu.setMotionDetectionDuration(imu_duration);
+    imu.setInterruptPinPolarity(true); // active low, like the INA260 ALERT
+    imu.setInterruptPinLatch(true);
+    imu.setCycleRate(MPU6050_CYCLE_5_HZ);
+    imu.enableSleep(true);
+    source = MOTION_SENSOR_IMU;
+    pin = imu_pin;
+  } else if (alert_pin >= 0 && wake_current_ma > 0) {
+    source = MOTION_SENSOR_CURRENT;
+    pin = alert_pin;
+  }
+  if (pin >= 0) pinMode(pin, INPUT_PULLUP);
+  return source;
+}
+
+int8_t MotionWake::arm() {
+  I2cLock bus;
+  if (source == MOTION_SENSOR_IMU) {
+    imu.setMotionInterrupt(true);
+    imu.getMotionInterruptStatus(); // clears anything latched while awake
+    imu.enableSleep(false);
+    imu.enableCycle(true);
+  } else if (source == MOTION_SENSOR_CURRENT) {
+    power_sensor->setAlertType(INA260_ALERT_OVERCURRENT);
+    power_sensor->setAlertLimit(limit_ma);
+    power_sensor->setAlertPolarity(INA260_ALERT_POLARITY_NORMAL);
+    power_sensor->setAlertLatch(INA260_ALERT_LATCH_ENABLED);
+  }
+  is_armed = pin >= 0;
+  return pin;
+}
+
+bool MotionWake::disarm() {
+  if (!is_armed) return false;
+  is_armed = false;
+  bool moved = false;
+  I2cLock bus;
+  if (source == MOTION_SENSOR_IMU) {
+    moved = imu.getMotionInterruptStatus();
+    imu.setMotionInterrupt(false);
+    imu.enableCycle(false);
+    imu.enableSleep(true);
+  } else if (source == MOTION_SENSOR_CURRENT) {
+    // reading the flag also releases the latched pin
+    moved = power_sensor->alertFunctionFlag();
+    if (shared) {
+      power_sensor->setAlertType(INA260_ALERT_CONVERSION_READY);
+      power_sensor->setAlertLatch(INA260_ALERT_LATCH_TRANSPARENT);
+    } else {
+      power_sensor->setAlertType(INA260_ALERT_NONE);
+    }
+  }
+  return moved;
+}
+
+const char *motionSensorName(MotionSensor sensor) {
+  switch (sensor) {
+    case MOTION_SENSOR_IMU: return "MPU6050";
+    case MOTION_SENSOR_CURRENT: return "INA260 current alert";
+    default: return "none";
+  }
+}
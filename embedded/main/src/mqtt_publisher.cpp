@@ -0,0 +1,87 @@
+#include "mqtt_publisher.h"
+
+#include <stdio.h>
+
+namespace {
+
+const uint8_t class_qos[MQTT_CLASSES] = { 0, 1, 0, 1, 1, 1, 1 };
+
+}
+
+uint8_t mqttQos(MqttClass cls) {
+  return cls < MQTT_CLASSES ? class_qos[cls] : 1;
+}
+
+void MqttPublisher::begin(AtEngine &a, uint32_t timeout_ms) {
+  at = &a;
+  timeout = timeout_ms;
+}
+
+bool MqttPublisher::publish(const char *topic, MqttClass cls, const uint8_t *payload, size_t len,
+                            AtCallback cb, void *ctx) {
+  if (queued == MQTT_QUEUE_SIZE) return false;
+  Message &m = queue[(head + queued) % MQTT_QUEUE_SIZE];
+  m.topic = topic;
+  m.qos = mqttQos(cls);
+  m.payload = payload;
+  m.len = len;
+  m.cb = cb;
+  m.ctx = ctx;
+  queued++;
+  return true;
+}
+
+void MqttPublisher::flush() {
+  flushing = true;
+  poll();
+}
+
+void MqttPublisher::poll() {
+  if (!flushing) return;
+  char command[AT_COMMAND_SIZE];
+  while (in_flight < queued && in_flight < MQTT_MAX_IN_FLIGHT) {
+    const Message &m = queue[(head + in_flight) % MQTT_QUEUE_SIZE];
+    // Parameters for AT+SMPUB: Topic, message length (0-512 bytes), QoS (0-2), retain (0-1)
+    snprintf(command, sizeof(command), "AT+SMPUB=\"%s\",%u,%u,0", m.topic, (unsigned)m.len, m.qos);
+    if (!at->send(command, timeout, onPublished, this, m.payload, m.len)) break;
+    in_flight++;
+  }
+  if (queued == 0) flushing = false;
+}
+
+void MqttPublisher::drop() {
+  fail(in_flight);
+}
+
+void MqttPublisher::fail(size_t from) {
+  // the callbacks may queue more, those stay
+  size_t n = queued - from;
+  for (size_t i = 0; i < n; i++) {
+    Message m = queue[(head + from) % MQTT_QUEUE_SIZE];
+    for (size_t j = from; j + 1 < queued; j++)
+      queue[(head + j) % MQTT_QUEUE_SIZE] = queue[(head + j + 1) % MQTT_QUEUE_SIZE];
+    queued--;
+    failures++;
+    if (m.cb) m.cb(AT_ERROR, "", m.ctx);
+  }
+  if (queued == 0) flushing = false;
+}
+
+void MqttPublisher::onPublished(AtStatus status, const char *response, void *ctx) {
+  MqttPublisher &p = *(MqttPublisher *)ctx;
+  // the engine completes commands in order, so this is the oldest one
+  Message m = p.queue[p.head];
+  p.head = (p.head + 1) % MQTT_QUEUE_SIZE;
+  p.queued--;
+  p.in_flight--;
+  if (status == AT_OK) {
+    if (m.qos) p.sent_qos1++;
+    else p.sent_qos0++;
+  } else {
+    p.failures++;
+  }
+  if (m.cb) m.cb(status, response, m.ctx);
+  // without a session the rest would only run into the timeout one by one
+  if (status != AT_OK) p.fail(p.in_flight);
+  else p.poll();
+}
@@ -0,0 +1,162 @@
+#include "mqtt_session.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "power_scheduler.h"
+
+namespace {
+
+const uint32_t state_timeout = 1000;   // ms
+const uint32_t conf_timeout = 1000;    // ms
+const uint32_t connect_timeout = 30000; // ms
+const uint32_t subscribe_timeout = 10000; // ms
+
+const uint8_t config_steps = 6;
+
+}
+
+void MqttSession::begin(AtEngine &a, const MqttSessionConfig &c, const char *id, bool warm) {
+  at = &a;
+  config = c;
+  client_id = id;
+  busy = false;
+  callback = nullptr;
+  breaker.begin("mqtt", config.retry, warm);
+  if (!warm) {
+    // the modem forgot the settings, and the broker may have dropped the
+    // session while we were off
+    is_connected = false;
+    configured = false;
+  }
+}
+
+void MqttSession::ensure(MqttReadyCallback cb, void *ctx) {
+  callback = cb;
+  callback_ctx = ctx;
+  if (busy) return;
+  busy = true;
+  if (!at->send("AT+SMSTATE?", state_timeout, onState, this)) done(false);
+}
+
+void MqttSession::configure() {
+  char command[AT_COMMAND_SIZE];
+  switch (config_step) {
+    case 0:
+      snprintf(command, sizeof(command), "AT+SMCONF=\"URL\",\"%s\",\"%u\"", config.server, config.port); break;
+    case 1:
+      snprintf(command, sizeof(command), "AT+SMCONF=\"USERNAME\",\"%s\"", config.username); break;
+    case 2:
+      snprintf(command, sizeof(command), "AT+SMCONF=\"PASSWORD\",\"%s\"", config.password); break;
+    case 3:
+      // a persistent session is found by the client id
+      snprintf(command, sizeof(command), "AT+SMCONF=\"CLIENTID\",\"%s\"", client_id); break;
+    case 4:
+      if (!persistent()) Serial.println(F("No IMEI yet, using a clean MQTT session"));
+      snprintf(command, sizeof(command), "AT+SMCONF=\"CLEANSS\",%d", persistent() ? 0 : 1); break;
+    default:
+      snprintf(command, sizeof(command), "AT+SMCONF=\"KEEPTIME\",%u", config.keepalive); break;
+  }
+  if (!at->send(command, conf_timeout, onConfigured, this)) fail();
+}
+
+void MqttSession::connect() {
+  Serial.println(F("Connecting to MQTT broker..."));
+  connect_started = rtcMillis();
+  if (!at->send("AT+SMCONN", connect_timeout, onConnected, this)) fail();
+}
+
+void MqttSession::fail() {
+  breaker.failure();
+  done(false);
+}
+
+void MqttSession::done(bool ok) {
+  is_connected = ok;
+  busy = false;
+  MqttReadyCallback cb = callback;
+  callback = nullptr;
+  if (cb) cb(ok, callback_ctx);
+}
+
+void MqttSession::onState(AtStatus status, const char *response, void *ctx) {
+  MqttSession &s = *(MqttSession *)ctx;
+  if (status == AT_OK && strstr(response, "+SMSTATE: 1")) {
+    s.reused++;
+    s.breaker.success();
+    s.done(true);
+    return;
+  }
+  s.is_connected = false;
+  if (!s.breaker.allow()) {
+    // still backing off or parked, this cycle goes to the backlog
+    s.done(false);
+    return;
+  }
+  if (s.configured) {
+    s.connect();
+  } else {
+    s.config_step = 0;
+    s.configure();
+  }
+}
+
+void MqttSession::onConfigured(AtStatus status, const char *, void *ctx) {
+  MqttSession &s = *(MqttSession *)ctx;
+  if (status != AT_OK) {
+    Serial.println(F("Failed to configure MQTT"));
+    s.fail();
+    return;
+  }
+  if (++s.config_step < config_steps) {
+    s.configure();
+    return;
+  }
+  s.configured = true;
+  s.connect();
+}
+
+void MqttSession::onConnected(AtStatus status, const char *, void *ctx) {
+  MqttSession &s = *(MqttSession *)ctx;
+  if (status != AT_OK) {
+    Serial.println(F("Failed to connect to MQTT broker!"));
+    s.connect_failures++;
+    s.fail();
+    return;
+  }
+  uint32_t ms = rtcMillis() - s.connect_started;
+  if (s.connects == 0 || ms < s.connect_min) s.connect_min = ms;
+  if (ms > s.connect_max) s.connect_max = ms;
+  s.connect_sum += ms;
+  s.connects++;
+  s.breaker.success();
+  Serial.print(F("MQTT connected in ")); Serial.print(ms); Serial.println(F(" ms"));
+  if (!s.config.subscribe_topic || s.subscribed) {
+    s.done(true);
+    return;
+  }
+  char command[AT_COMMAND_SIZE];
+  snprintf(command, sizeof(command), "AT+SMSUB=\"%s\",1", s.config.subscribe_topic); // Topic name, QoS
+  if (!s.at->send(command, subscribe_timeout, onSubscribed, &s)) s.done(true);
+}
+
+void MqttSession::onSubscribed(AtStatus status, const char *, void *ctx) {
+  MqttSession &s = *(MqttSession *)ctx;
+  // connected either way; the subscription is tried again after the next
+  // connect
+  if (status != AT_OK) Serial.println(F("Failed to subscribe to the command topic"));
+  else if (s.persistent()) s.subscribed = true;
+  s.done(true);
+}
+
+void MqttSession::printStats() {
+  Serial.print(F("MQTT session reused ")); Serial.print(reused);
+  Serial.print(F("x, connected ")); Serial.print(connects);
+  if (connects) {
+    Serial.print(F("x in ")); Serial.print(connect_min);
+    Serial.print('/'); Serial.print(connect_sum / connects);
+    Serial.print('/'); Serial.print(connect_max); Serial.print(F(" ms min/mean/max"));
+  } else {
+    Serial.print('x');
+  }
+  Serial.print(F(", failed ")); Serial.println(connect_failures);
+}
@@ -0,0 +1,127 @@
+#include "mqtt_urc.h"
+
+#include <string.h>
+
+namespace {
+
+const char prefix[] = "+SMSUB: \"";
+const size_t prefix_len = sizeof(prefix) - 1;
+const char separator[] = "\",\"";
+
+}
+
+bool TextView::equals(const char *s) const {
+  return strlen(s) == len && memcmp(data, s, len) == 0;
+}
+
+bool MqttUrcParser::on(const char *topic, TopicHandler handler, void *ctx) {
+  if (route_count == URC_MAX_TOPICS) return false;
+  routes[route_count].topic = topic;
+  routes[route_count].handler = handler;
+  routes[route_count].ctx = ctx;
+  route_count++;
+  return true;
+}
+
+void MqttUrcParser::onUnhandled(TopicHandler handler, void *ctx) {
+  unhandled = handler;
+  unhandled_ctx = ctx;
+}
+
+void MqttUrcParser::feed(const char *data, size_t len) {
+  while (len--) feed(*data++);
+}
+
+void MqttUrcParser::discard() {
+  discarded++;
+  record_len = 0;
+  state = SKIP;
+}
+
+void MqttUrcParser::dispatch() {
+  TextView topic = { record + topic_start, topic_len };
+  // the closing quote is the last byte of the record
+  TextView message = { record + message_start, record_len - 1 - message_start };
+  state = LINE_START;
+  record_len = 0;
+  for (size_t i = 0; i < route_count; i++) {
+    if (topic.equals(routes[i].topic)) {
+      routes[i].handler(topic, message, routes[i].ctx);
+      return;
+    }
+  }
+  if (unhandled) unhandled(topic, message, unhandled_ctx);
+}
+
+void MqttUrcParser::feed(char c) {
+  bool eol = c == '\r' || c == '\n';
+  switch (state) {
+    case LINE_START:
+      if (c != prefix[0]) {
+        if (!eol) state = SKIP;
+        return;
+      }
+      matched = 1;
+      state = PREFIX;
+      return;
+    case PREFIX:
+      if (c != prefix[matched]) {
+        state = eol ? LINE_START : SKIP;
+        return;
+      }
+      if (++matched == prefix_len) {
+        record_len = 0;
+        topic_start = 0;
+        state = TOPIC;
+      }
+      return;
+    case SKIP:
+      if (eol) state = LINE_START;
+      return;
+    default:
+      break;
+  }
+
+  // inside a record from here on
+  if (record_len == URC_RECORD_SIZE) {
+    discard();
+    if (eol) state = LINE_START;
+    return;
+  }
+  record[record_len++] = c;
+  switch (state) {
+    case TOPIC:
+      if (c == '"') {
+        topic_len = record_len - 1 - topic_start;
+        matched = 1;
+        state = SEPARATOR;
+      } else if (eol) {
+        discard();
+        state = LINE_START;
+      }
+      break;
+    case SEPARATOR:
+      if (c != separator[matched]) {
+        discard();
+        if (eol) state = LINE_START;
+      } else if (++matched == sizeof(separator) - 1) {
+        message_start = record_len;
+        state = MESSAGE;
+      }
+      break;
+    case MESSAGE:
+      if (c == '"') state = MESSAGE_QUOTE;
+      break;
+    case MESSAGE_QUOTE:
+      if (eol) {
+        // drop the line ending so the record ends in the closing quote
+        record_len--;
+        dispatch();
+      } else if (c != '"') {
+        state = MESSAGE;
+      }
+      break;
+    default:
+      break;
+  }
+}
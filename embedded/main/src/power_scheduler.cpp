@@ -0,0 +1,81 @@
+#include "power_scheduler.h"
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+#include <esp_clk.h>
+#include <driver/uart.h>
+#include <driver/gpio.h>
+
+namespace {
+
+// not worth the wake-up cost below this
+const uint32_t min_sleep_ms = 20;
+// deep sleep reruns setup(), so it only pays off for long gaps
+const uint32_t min_deep_sleep_ms = 30000;
+// rx edges needed to wake from light sleep; the first character is lost
+const int uart_wakeup_threshold = 3;
+// time for the rest of a URC to arrive after the first bytes woke us
+const uint32_t urc_settle_ms = 100;
+
+}
+
+int32_t rtcMillis() {
+  return (int32_t)(esp_clk_rtc_time() / 1000);
+}
+
+void PowerScheduler::begin(int8_t ri, uint8_t uart) {
+  ri_pin = ri;
+  modem_uart = uart;
+  switch (esp_sleep_get_wakeup_cause()) {
+    case ESP_SLEEP_WAKEUP_TIMER:
+      boot_reason = WAKE_TIMER; break;
+    case ESP_SLEEP_WAKEUP_EXT0:
+      boot_reason = WAKE_MODEM; break;
+    case ESP_SLEEP_WAKEUP_EXT1:
+      boot_reason = WAKE_MOTION; break;
+    default:
+      boot_reason = WAKE_RESET; break;
+  }
+}
+
+WakeReason PowerScheduler::idleUntil(int32_t wake_at) {
+  int32_t remaining = wake_at - rtcMillis();
+  if (remaining < (int32_t)min_sleep_ms) return WAKE_TIMER;
+  // a motion pin that cannot wake from deep sleep rules it out
+  bool motion_ok = motion_pin < 0 || esp_sleep_is_valid_wakeup_gpio((gpio_num_t)motion_pin);
+  if (ri_pin >= 0 && motion_ok && remaining >= (int32_t)min_deep_sleep_ms) deepSleep(remaining);
+  return lightSleep(remaining);
+}
+
+WakeReason PowerScheduler::lightSleep(uint32_t ms) {
+  Serial.flush(); // the console UART stops while asleep
+  esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000);
+  uart_set_wakeup_threshold((uart_port_t)modem_uart, uart_wakeup_threshold);
+  esp_sleep_enable_uart_wakeup(modem_uart);
+  if (motion_pin >= 0) {
+    gpio_wakeup_enable((gpio_num_t)motion_pin, GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+  }
+  esp_light_sleep_start();
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+  if (motion_pin >= 0) gpio_wakeup_disable((gpio_num_t)motion_pin);
+  switch (esp_sleep_get_wakeup_cause()) {
+    case ESP_SLEEP_WAKEUP_UART:
+      delay(urc_settle_ms);
+      return WAKE_MODEM;
+    case ESP_SLEEP_WAKEUP_GPIO:
+      return WAKE_MOTION;
+    default:
+      return WAKE_TIMER;
+  }
+}
+
+void PowerScheduler::deepSleep(uint32_t ms) {
+  Serial.println(F("Entering deep sleep"));
+  Serial.flush();
+  esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000);
+  // RI is pulled low by the modem when a URC is pending
+  esp_sleep_enable_ext0_wakeup((gpio_num_t)ri_pin, 0);
+  if (motion_pin >= 0) esp_sleep_enable_ext1_wakeup(1ULL << motion_pin, ESP_EXT1_WAKEUP_ALL_LOW);
+  esp_deep_sleep_start();
+}
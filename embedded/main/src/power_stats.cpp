@@ -0,0 +1,83 @@
+#include "power_stats.h"
+
+#include <math.h>
+#include "wire_format.h"
+
+namespace {
+
+// microseconds in an hour, to turn A * us into mAh
+const double us_per_hour = 3.6e9;
+
+using wire::Fixed;
+
+typedef wire::Layout<
+  Fixed<uint8_t, 0>,                  // version
+  Fixed<uint16_t, 0>,                 // sequence
+  Fixed<uint32_t, 0>,                 // sampled ms
+  Fixed<uint32_t, 0>,                 // unsampled ms
+  Fixed<uint32_t, 0>,                 // samples
+  Fixed<uint16_t, 3>,                 // voltage min
+  Fixed<uint16_t, 3>,                 // voltage mean
+  Fixed<uint16_t, 3>,                 // voltage max
+  Fixed<int16_t, 3>,                  // current min
+  Fixed<int16_t, 3>,                  // current mean
+  Fixed<int16_t, 3>,                  // current max
+  Fixed<uint32_t, 3, 0, INT32_MAX>,   // charge
+  Fixed<uint32_t, 3, 0, INT32_MAX>,   // energy
+  Fixed<uint16_t, 0>                  // minutes remaining
+> PowerLayout;
+
+static_assert(PowerLayout::size == POWER_STATS_SIZE, "power layout does not match POWER_STATS_SIZE");
+
+}
+
+void PowerStats::reset() {
+  samples = 0;
+  sampled_us = unsampled_us = 0;
+  voltage_min = current_min = INFINITY;
+  voltage_max = current_max = -INFINITY;
+  voltage_sum = current_sum = 0;
+  charge_mah = energy_mwh = 0;
+}
+
+void PowerStats::add(float voltage, float current, uint32_t dt_us, float prev_voltage, float prev_current) {
+  samples++;
+  if (voltage < voltage_min) voltage_min = voltage;
+  if (voltage > voltage_max) voltage_max = voltage;
+  if (current < current_min) current_min = current;
+  if (current > current_max) current_max = current;
+  voltage_sum += voltage;
+  current_sum += current;
+  if (dt_us == 0) return;
+  if (dt_us > POWER_MAX_GAP_US) {
+    unsampled_us += dt_us;
+    return;
+  }
+  sampled_us += dt_us;
+  charge_mah += prev_current * 1000 * (dt_us / us_per_hour);
+  energy_mwh += prev_voltage * prev_current * 1000 * (dt_us / us_per_hour);
+}
+
+void PowerStats::merge(const PowerStats &o) {
+  samples += o.samples;
+  sampled_us += o.sampled_us;
+  unsampled_us += o.unsampled_us;
+  if (o.voltage_min < voltage_min) voltage_min = o.voltage_min;
+  if (o.voltage_max > voltage_max) voltage_max = o.voltage_max;
+  if (o.current_min < current_min) current_min = o.current_min;
+  if (o.current_max > current_max) current_max = o.current_max;
+  voltage_sum += o.voltage_sum;
+  current_sum += o.current_sum;
+  charge_mah += o.charge_mah;
+  energy_mwh += o.energy_mwh;
+}
+
+size_t encodePowerStats(const PowerStats &s, uint16_t sequence, int32_t minutes_remaining, uint8_t *out) {
+  bool any = s.samples > 0;
+  uint16_t minutes = minutes_remaining < 0 ? 0xffff : (uint16_t)(minutes_remaining < 0xfffe ? minutes_remaining : 0xfffe);
+  return PowerLayout::encode(out, (uint8_t)POWER_STATS_VERSION, sequence,
+                             s.sampled_us / 1000, s.unsampled_us / 1000, s.samples,
+                             any ? s.voltage_min : 0, s.voltageMean(), any ? s.voltage_max : 0,
+                             any ? s.current_min : 0, s.currentMean(), any ? s.current_max : 0,
+                             s.charge_mah, s.energy_mwh, minutes);
+}
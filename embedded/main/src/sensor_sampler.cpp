@@ -0,0 +1,105 @@
+#include "sensor_sampler.h"
+
+#include "i2c_bus.h"
+
+namespace {
+
+// in bytes, ESP-IDF does not count in words like plain FreeRTOS. Two
+// Adafruit drivers on top of Wire leave little of 2 KB, stackFree() shows
+// what this leaves on the board
+const uint32_t task_stack = 4096;
+// above the loop task, so a requested sample is taken straight away
+const UBaseType_t task_priority = 2;
+
+// the task the ALERT interrupt wakes
+TaskHandle_t alert_task = nullptr;
+
+}
+
+bool SensorSampler::begin(Adafruit_INA260 &power, Adafruit_BME280 *weather, uint32_t period_ms, int core,
+                          int8_t alert_pin) {
+  power_sensor = &power;
+  weather_sensor = weather;
+  period = period_ms;
+  alert = alert_pin;
+  window.reset();
+  I2cLock bus;
+  power_sensor->setMode(INA260_MODE_CONTINUOUS);
+  if (xTaskCreatePinnedToCore(task, "sampler", task_stack, this, task_priority, &handle, core) != pdPASS) {
+    return false;
+  }
+  if (alert >= 0) {
+    // ALERT is open drain and pulled low when a conversion completes
+    alert_task = handle;
+    power_sensor->setAlertType(INA260_ALERT_CONVERSION_READY);
+    power_sensor->setAlertPolarity(INA260_ALERT_POLARITY_NORMAL);
+    power_sensor->setAlertLatch(INA260_ALERT_LATCH_TRANSPARENT);
+    pinMode(alert, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(alert), conversionReady, FALLING);
+  }
+  return true;
+}
+
+void IRAM_ATTR SensorSampler::conversionReady() {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(alert_task, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+void SensorSampler::request() {
+  requested = true;
+  if (handle) xTaskNotifyGive(handle);
+}
+
+void SensorSampler::task(void *self) {
+  SensorSampler *s = static_cast<SensorSampler *>(self);
+  for (;;) {
+    s->readPower();
+    if (s->requested || millis() - s->last_sample >= s->period) {
+      s->requested = false;
+      s->sample();
+    }
+    // woken by the next conversion or by request(); without the ALERT pin
+    // the next conversion is about a tick away
+    ulTaskNotifyTake(pdTRUE, s->alert >= 0 ? pdMS_TO_TICKS(s->period) : 1);
+  }
+}
+
+void SensorSampler::readPower() {
+  // the INA260 reports mV and mA
+  float v, i;
+  {
+    I2cLock bus;
+    v = power_sensor->readBusVoltage() / 1000;
+    i = power_sensor->readCurrent() / 1000;
+    // in transparent mode ALERT is only released, and the next conversion
+    // only signalled, once Mask/Enable has been read
+    if (alert >= 0) power_sensor->conversionReady();
+  }
+  uint32_t now = micros();
+  window.add(v, i, have_reading ? now - last_read_us : 0, voltage, current);
+  voltage = v;
+  current = i;
+  last_read_us = now;
+  have_reading = true;
+}
+
+void SensorSampler::sample() {
+  SensorSample s;
+  s.timestamp = millis();
+  last_sample = s.timestamp;
+  s.voltage = voltage;
+  s.current = current;
+  s.power = voltage * current;
+  s.weather = weather_sensor != nullptr;
+  if (s.weather) {
+    I2cLock bus;
+    s.temperature = weather_sensor->readTemperature();
+    s.pressure = weather_sensor->readPressure() / 100.0F;
+    s.humidity = weather_sensor->readHumidity();
+  }
+  // when the queue is full the window carries over to the next sample
+  s.power_window = window;
+  if (queue.push(s)) window.reset();
+  else dropped++;
+}
@@ -0,0 +1,108 @@
+#include "telemetry_backlog.h"
+
+#include <SPIFFS.h>
+
+namespace {
+
+const uint32_t backlog_magic = 0x544c4231; // "TLB1"
+
+// file header, followed by BACKLOG_SLOTS records of TELEMETRY_FRAME_SIZE
+struct Header {
+  uint32_t magic;
+  uint16_t slots;
+  uint16_t record_size;
+  uint32_t head;
+  uint32_t count;
+  uint32_t evicted;
+};
+
+size_t slotOffset(uint32_t slot) {
+  return sizeof(Header) + (size_t)slot * TELEMETRY_FRAME_SIZE;
+}
+
+}
+
+bool TelemetryBacklog::begin(const char *file_path) {
+  path = file_path;
+  if (!SPIFFS.begin(true)) return false;
+  ready = true;
+  File f = SPIFFS.open(path, "r");
+  Header h;
+  if (f && f.read((uint8_t *)&h, sizeof(h)) == sizeof(h) && h.magic == backlog_magic &&
+      h.slots == BACKLOG_SLOTS && h.record_size == TELEMETRY_FRAME_SIZE && h.head < BACKLOG_SLOTS &&
+      h.count <= BACKLOG_SLOTS) {
+    head = h.head;
+    count = h.count;
+    evicted = h.evicted;
+    f.close();
+    return true;
+  }
+  if (f) f.close();
+  return reset();
+}
+
+bool TelemetryBacklog::reset() {
+  // preallocate the whole file so later writes never have to grow it
+  File f = SPIFFS.open(path, "w");
+  if (!f) return false;
+  head = count = evicted = 0;
+  uint8_t zero[TELEMETRY_FRAME_SIZE] = {0};
+  Header h = { backlog_magic, BACKLOG_SLOTS, TELEMETRY_FRAME_SIZE, 0, 0, 0 };
+  bool ok = f.write((const uint8_t *)&h, sizeof(h)) == sizeof(h);
+  for (uint32_t i = 0; ok && i < BACKLOG_SLOTS; i++)
+    ok = f.write(zero, sizeof(zero)) == sizeof(zero);
+  f.close();
+  return ok;
+}
+
+bool TelemetryBacklog::writeHeader() {
+  File f = SPIFFS.open(path, "r+");
+  if (!f) return false;
+  Header h = { backlog_magic, BACKLOG_SLOTS, TELEMETRY_FRAME_SIZE, head, count, evicted };
+  bool ok = f.write((const uint8_t *)&h, sizeof(h)) == sizeof(h);
+  f.close();
+  return ok;
+}
+
+bool TelemetryBacklog::push(const uint8_t *frame) {
+  if (!ready) return false;
+  File f = SPIFFS.open(path, "r+");
+  if (!f) return false;
+  uint32_t slot = (head + count) % BACKLOG_SLOTS;
+  bool ok = f.seek(slotOffset(slot)) && f.write(frame, TELEMETRY_FRAME_SIZE) == TELEMETRY_FRAME_SIZE;
+  f.close();
+  if (!ok) return false;
+  if (count == BACKLOG_SLOTS) {
+    head = (head + 1) % BACKLOG_SLOTS;
+    evicted++;
+  } else {
+    count++;
+  }
+  return writeHeader();
+}
+
+size_t TelemetryBacklog::peek(uint8_t *out, size_t max_frames) {
+  if (!ready || count == 0) return 0;
+  File f = SPIFFS.open(path, "r");
+  if (!f) return 0;
+  size_t n = max_frames < count ? max_frames : count;
+  size_t got = 0;
+  while (got < n) {
+    // read contiguous runs, wrapping at the end of the file
+    uint32_t slot = (head + got) % BACKLOG_SLOTS;
+    size_t run = BACKLOG_SLOTS - slot;
+    if (run > n - got) run = n - got;
+    size_t bytes = run * TELEMETRY_FRAME_SIZE;
+    if (!f.seek(slotOffset(slot)) || f.read(out + got * TELEMETRY_FRAME_SIZE, bytes) != bytes) break;
+    got += run;
+  }
+  f.close();
+  return got;
+}
+
+bool TelemetryBacklog::pop(size_t n) {
+  if (n > count) n = count;
+  head = (head + n) % BACKLOG_SLOTS;
+  count -= n;
+  return writeHeader();
+}
@@ -0,0 +1,56 @@
+#include "telemetry_frame.h"
+
+#include "wire_format.h"
+
+namespace {
+
+using wire::Fixed;
+
+typedef wire::Layout<
+  Fixed<uint8_t, 0>,                          // version
+  Fixed<uint8_t, 0>,                          // flags
+  Fixed<uint16_t, 0>,                         // sequence
+  Fixed<uint32_t, 0>,                         // timestamp
+  Fixed<int32_t, 6, -90000000, 90000000>,     // latitude
+  Fixed<int32_t, 6, -180000000, 180000000>,   // longitude
+  Fixed<uint16_t, 1>,                         // speed
+  Fixed<uint16_t, 1, 0, 3600>,                // heading
+  Fixed<int16_t, 0>,                          // altitude
+  Fixed<uint16_t, 3>,                         // voltage
+  Fixed<int16_t, 3>,                          // current
+  Fixed<uint16_t, 3>,                         // power
+  Fixed<uint8_t, 0, 0, 100>,                  // battery
+  Fixed<int16_t, 2>,                          // temperature
+  Fixed<uint16_t, 1>,                         // pressure
+  Fixed<uint16_t, 2, 0, 10000>                // humidity
+> TelemetryLayout;
+
+static_assert(TelemetryLayout::size == TELEMETRY_FRAME_SIZE, "telemetry layout does not match TELEMETRY_FRAME_SIZE");
+static_assert(TelemetryLayout::text_size <= TELEMETRY_TEXT_SIZE, "telemetry text does not fit TELEMETRY_TEXT_SIZE");
+
+}
+
+size_t encodeTelemetryFrame(const TelemetrySample &s, uint16_t sequence, uint8_t *out) {
+  return TelemetryLayout::encode(out, (uint8_t)TELEMETRY_FRAME_VERSION, s.flags, sequence, s.timestamp,
+                                 s.latitude, s.longitude, s.speed_kph, s.heading, s.altitude,
+                                 s.voltage, s.current, s.power, s.battery,
+                                 s.temperature, s.pressure, s.humidity);
+}
+
+size_t formatTelemetry(const TelemetrySample &s, uint16_t sequence, char *out) {
+  return TelemetryLayout::format(out, (uint8_t)TELEMETRY_FRAME_VERSION, s.flags, sequence, s.timestamp,
+                                 s.latitude, s.longitude, s.speed_kph, s.heading, s.altitude,
+                                 s.voltage, s.current, s.power, s.battery,
+                                 s.temperature, s.pressure, s.humidity);
+}
+
+uint32_t unixTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second) {
+  // days from civil date, counting years from March so leap days come last
+  int32_t y = year - (month <= 2);
+  int32_t era = (y >= 0 ? y : y - 399) / 400;
+  uint32_t yoe = (uint32_t)(y - era * 400);
+  uint32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  int32_t days = era * 146097 + (int32_t)doe - 719468;
+  return (uint32_t)days * 86400UL + hour * 3600UL + minute * 60UL + second;
+}
@@ -0,0 +1,79 @@
+#include "track_codec.h"
+
+namespace {
+
+uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+int32_t unzigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+uint8_t *putVarint(uint8_t *p, uint32_t v) {
+  while (v >= 0x80) {
+    *p++ = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (uint8_t)v;
+  return p;
+}
+
+bool getVarint(const uint8_t *&p, const uint8_t *end, uint32_t &v) {
+  v = 0;
+  for (int shift = 0; shift < 35 && p < end; shift += 7) {
+    uint8_t b = *p++;
+    v |= (uint32_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+// differences wrap like the decoder's, so any pair of points round-trips
+int32_t delta(int32_t to, int32_t from) {
+  return (int32_t)((uint32_t)to - (uint32_t)from);
+}
+
+}
+
+size_t encodeTrack(const TrackPoint *points, size_t n, uint8_t *out, size_t max_len, size_t *encoded) {
+  *encoded = 0;
+  if (max_len < 1) return 0;
+  uint8_t *p = out;
+  *p++ = TRACK_FORMAT_VERSION;
+  TrackPoint prev = {0, 0, 0, 0};
+  for (size_t i = 0; i < n; i++) {
+    uint8_t point[TRACK_MAX_POINT_BYTES];
+    uint8_t *q = point;
+    q = putVarint(q, zigzag(delta(points[i].latitude, prev.latitude)));
+    q = putVarint(q, zigzag(delta(points[i].longitude, prev.longitude)));
+    q = putVarint(q, zigzag(delta(points[i].altitude, prev.altitude)));
+    q = putVarint(q, zigzag(delta((int32_t)points[i].timestamp, (int32_t)prev.timestamp)));
+    size_t len = q - point;
+    if ((size_t)(p - out) + len > max_len) break;
+    for (size_t j = 0; j < len; j++) *p++ = point[j];
+    prev = points[i];
+    (*encoded)++;
+  }
+  return p - out;
+}
+
+bool decodeTrack(const uint8_t *data, size_t len, TrackPoint *points, size_t max_points, size_t *decoded) {
+  *decoded = 0;
+  if (len < 1 || data[0] != TRACK_FORMAT_VERSION) return false;
+  const uint8_t *p = data + 1;
+  const uint8_t *end = data + len;
+  TrackPoint prev = {0, 0, 0, 0};
+  while (p < end && *decoded < max_points) {
+    uint32_t v[4];
+    for (int i = 0; i < 4; i++) {
+      if (!getVarint(p, end, v[i])) return false;
+    }
+    prev.latitude = (int32_t)((uint32_t)prev.latitude + (uint32_t)unzigzag(v[0]));
+    prev.longitude = (int32_t)((uint32_t)prev.longitude + (uint32_t)unzigzag(v[1]));
+    prev.altitude = (int32_t)((uint32_t)prev.altitude + (uint32_t)unzigzag(v[2]));
+    prev.timestamp += (uint32_t)unzigzag(v[3]);
+    points[(*decoded)++] = prev;
+  }
+  return true;
+}
@@ -0,0 +1,78 @@
+#include "track_compressor.h"
+
+#include <math.h>
+
+namespace {
+
+// metres per microdegree of latitude; longitude is scaled by cos(latitude)
+const float metres_per_e6 = 0.111195;
+
+}
+
+void TrackCompressor::begin(float tolerance_m) {
+  tolerance = tolerance_m;
+}
+
+bool TrackCompressor::fits(const TrackPoint &end) const {
+  // flat projection around the anchor, fine over a window's few hundred metres
+  float kx = metres_per_e6 * cosf(anchor.latitude * 1e-6f * (float)M_PI / 180);
+  float ky = metres_per_e6;
+  float dx = (end.longitude - anchor.longitude) * kx;
+  float dy = (end.latitude - anchor.latitude) * ky;
+  float len2 = dx * dx + dy * dy;
+  for (size_t i = 0; i < window_len; i++) {
+    float px = (window[i].longitude - anchor.longitude) * kx;
+    float py = (window[i].latitude - anchor.latitude) * ky;
+    // distance to the segment, so doubling back is caught too
+    float t = len2 > 0 ? (px * dx + py * dy) / len2 : 0;
+    if (t < 0) t = 0;
+    if (t > 1) t = 1;
+    float ex = px - t * dx;
+    float ey = py - t * dy;
+    if (ex * ex + ey * ey > tolerance * tolerance) return false;
+  }
+  return true;
+}
+
+void TrackCompressor::keep(const TrackPoint &p) {
+  if (count == TRACK_MAX_POINTS) {
+    head = (head + 1) % TRACK_MAX_POINTS;
+    count--;
+    evicted++;
+  }
+  kept[(head + count) % TRACK_MAX_POINTS] = p;
+  count++;
+  anchor = p;
+  anchored = true;
+}
+
+void TrackCompressor::add(const TrackPoint &fix) {
+  if (!anchored) {
+    keep(fix);
+    return;
+  }
+  if (window_len > 0 && (window_len == TRACK_WINDOW || !fits(fix))) {
+    // the previous fix is the last one the straight line still covers
+    keep(window[window_len - 1]);
+    window_len = 0;
+  }
+  window[window_len++] = fix;
+}
+
+void TrackCompressor::flush() {
+  if (window_len == 0) return;
+  keep(window[window_len - 1]);
+  window_len = 0;
+}
+
+size_t TrackCompressor::peek(TrackPoint *out, size_t max_points) const {
+  size_t n = count < max_points ? count : max_points;
+  for (size_t i = 0; i < n; i++) out[i] = kept[(head + i) % TRACK_MAX_POINTS];
+  return n;
+}
+
+void TrackCompressor::pop(size_t n) {
+  if (n > count) n = count;
+  head = (head + n) % TRACK_MAX_POINTS;
+  count -= n;
+}
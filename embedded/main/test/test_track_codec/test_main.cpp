@@ -0,0 +1,156 @@
+// Round trip of the batched track encoding. Run with `pio test -e native`.
+#include <unity.h>
+#include <string.h>
+
+#include "track_codec.h"
+// src/ is not built for tests, the codec has no other dependencies
+#include "../../src/track_codec.cpp"
+
+namespace {
+
+const TrackPoint ride[] = {
+  { 40744000, -74025000, 120, 1600000000 },
+  { 40744310, -74024620, 125, 1600000060 },
+  { 40744890, -74023980, 118, 1600000120 },
+  { 40743200, -74026100, 96, 1600000185 },
+  // a fix from the other side of the world, and back
+  { -33856800, 151215300, -40, 1600003785 },
+  { 40743210, -74026090, 97, 1600003845 },
+};
+const size_t ride_n = sizeof(ride) / sizeof(ride[0]);
+
+void assertPoint(const TrackPoint &expected, const TrackPoint &actual) {
+  TEST_ASSERT_EQUAL_INT32(expected.latitude, actual.latitude);
+  TEST_ASSERT_EQUAL_INT32(expected.longitude, actual.longitude);
+  TEST_ASSERT_EQUAL_INT32(expected.altitude, actual.altitude);
+  TEST_ASSERT_EQUAL_UINT32(expected.timestamp, actual.timestamp);
+}
+
+size_t encodeRide(uint8_t *out, size_t max_len) {
+  size_t encoded;
+  size_t len = encodeTrack(ride, ride_n, out, max_len, &encoded);
+  TEST_ASSERT_EQUAL(ride_n, encoded);
+  return len;
+}
+
+}
+
+void test_round_trip() {
+  uint8_t buf[ride_n * TRACK_MAX_POINT_BYTES + 1];
+  size_t len = encodeRide(buf, sizeof(buf));
+  TEST_ASSERT_EQUAL_UINT8(TRACK_FORMAT_VERSION, buf[0]);
+  TrackPoint out[ride_n];
+  size_t decoded;
+  TEST_ASSERT_TRUE(decodeTrack(buf, len, out, ride_n, &decoded));
+  TEST_ASSERT_EQUAL(ride_n, decoded);
+  for (size_t i = 0; i < ride_n; i++) assertPoint(ride[i], out[i]);
+}
+
+void test_round_trip_extremes() {
+  // differences that overflow int32 wrap and still come back
+  const TrackPoint points[] = {
+    { INT32_MAX, INT32_MIN, INT32_MAX, 0xffffffff },
+    { INT32_MIN, INT32_MAX, INT32_MIN, 0 },
+    { 0, 0, 0, 0x80000000 },
+  };
+  const size_t n = sizeof(points) / sizeof(points[0]);
+  uint8_t buf[n * TRACK_MAX_POINT_BYTES + 1];
+  size_t encoded;
+  size_t len = encodeTrack(points, n, buf, sizeof(buf), &encoded);
+  TEST_ASSERT_EQUAL(n, encoded);
+  TrackPoint out[n];
+  size_t decoded;
+  TEST_ASSERT_TRUE(decodeTrack(buf, len, out, n, &decoded));
+  TEST_ASSERT_EQUAL(n, decoded);
+  for (size_t i = 0; i < n; i++) assertPoint(points[i], out[i]);
+}
+
+void test_encode_stops_at_max_len() {
+  uint8_t full[ride_n * TRACK_MAX_POINT_BYTES + 1];
+  size_t full_len = encodeRide(full, sizeof(full));
+  uint8_t buf[sizeof(full)];
+  size_t encoded;
+  size_t len = encodeTrack(ride, ride_n, buf, full_len - 1, &encoded);
+  TEST_ASSERT_LESS_THAN(ride_n, encoded);
+  TEST_ASSERT_LESS_OR_EQUAL(full_len - 1, len);
+  // only whole points, which are the start of the full message
+  TEST_ASSERT_EQUAL_MEMORY(full, buf, len);
+  TrackPoint out[ride_n];
+  size_t decoded;
+  TEST_ASSERT_TRUE(decodeTrack(buf, len, out, ride_n, &decoded));
+  TEST_ASSERT_EQUAL(encoded, decoded);
+
+  TEST_ASSERT_EQUAL(0, encodeTrack(ride, ride_n, buf, 0, &encoded));
+  TEST_ASSERT_EQUAL(0, encoded);
+  TEST_ASSERT_EQUAL(1, encodeTrack(ride, ride_n, buf, 1, &encoded));
+  TEST_ASSERT_EQUAL(0, encoded);
+}
+
+void test_decode_max_points() {
+  uint8_t buf[ride_n * TRACK_MAX_POINT_BYTES + 1];
+  size_t len = encodeRide(buf, sizeof(buf));
+  TrackPoint out[2];
+  size_t decoded;
+  TEST_ASSERT_TRUE(decodeTrack(buf, len, out, 2, &decoded));
+  TEST_ASSERT_EQUAL(2, decoded);
+  assertPoint(ride[1], out[1]);
+}
+
+void test_truncated() {
+  uint8_t buf[ride_n * TRACK_MAX_POINT_BYTES + 1];
+  size_t len = encodeRide(buf, sizeof(buf));
+  uint8_t point_end[ride_n + 1];
+  point_end[0] = 1;
+  for (size_t i = 1; i <= ride_n; i++) {
+    size_t encoded;
+    uint8_t part[sizeof(buf)];
+    point_end[i] = encodeTrack(ride, i, part, sizeof(part), &encoded);
+  }
+  TrackPoint out[ride_n];
+  size_t decoded;
+  // cut at a point boundary, the points before it survive; anywhere else
+  // the message is malformed
+  for (size_t cut = 1; cut < len; cut++) {
+    size_t whole = 0;
+    while (whole < ride_n && point_end[whole + 1] <= cut) whole++;
+    bool boundary = point_end[whole] == cut;
+    TEST_ASSERT_EQUAL(boundary, decodeTrack(buf, cut, out, ride_n, &decoded));
+    if (boundary) TEST_ASSERT_EQUAL(whole, decoded);
+    else TEST_ASSERT_LESS_OR_EQUAL(whole, decoded);
+  }
+}
+
+void test_corrupt() {
+  TrackPoint out[ride_n];
+  size_t decoded;
+  TEST_ASSERT_FALSE(decodeTrack(NULL, 0, out, ride_n, &decoded));
+  TEST_ASSERT_EQUAL(0, decoded);
+
+  uint8_t buf[ride_n * TRACK_MAX_POINT_BYTES + 1];
+  size_t len = encodeRide(buf, sizeof(buf));
+  buf[0] = TRACK_FORMAT_VERSION + 1;
+  TEST_ASSERT_FALSE(decodeTrack(buf, len, out, ride_n, &decoded));
+  TEST_ASSERT_EQUAL(0, decoded);
+
+  // a varint that never ends within five bytes
+  const uint8_t runaway[] = { TRACK_FORMAT_VERSION, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01, 0, 0, 0 };
+  TEST_ASSERT_FALSE(decodeTrack(runaway, sizeof(runaway), out, ride_n, &decoded));
+  TEST_ASSERT_EQUAL(0, decoded);
+
+  // the last point's final varint cut off mid-way
+  len = encodeRide(buf, sizeof(buf));
+  buf[len - 1] |= 0x80;
+  TEST_ASSERT_FALSE(decodeTrack(buf, len, out, ride_n, &decoded));
+  TEST_ASSERT_EQUAL(ride_n - 1, decoded);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_round_trip_extremes);
+  RUN_TEST(test_encode_stops_at_max_len);
+  RUN_TEST(test_decode_max_points);
+  RUN_TEST(test_truncated);
+  RUN_TEST(test_corrupt);
+  return UNITY_END();
+}
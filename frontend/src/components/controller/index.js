@@ -6,19 +6,150 @@ import $ from 'jquery'
 import 'bootstrap/dist/js/bootstrap.bundle.min.js'
 import 'react-toastify/dist/ReactToastify.min.css'
 import './style.scss'
+import { decodeTrack } from './track'
 
 const defaultLatitude = 40.742702
 const defaultLongitude = -74.027167
 const defaultZoom = 13
 
 const topics = {
-  location: 'location',
-  weather: 'weather',
-  battery: 'battery',
+  telemetry: 'telemetry',
   command: 'command',
   error: 'error',
+  track: 'track',
+  power: 'power',
+  alert: 'alert',
+  ack: 'ack',
+  health: 'health',
 }
 
+// must match embedded/main/include/telemetry_frame.h
+const telemetryFrameVersion = 1
+const telemetryFrameSize = 35
+const telemetryFlags = {
+  fix: 0x01,
+  weather: 0x02,
+  time: 0x04,
+}
+
+const pressureToAltitude = pressure =>
+  44330 * (1 - Math.pow(pressure / 1013.25, 0.1903))
+
+// decode one binary telemetry frame into the arrays the table expects
+const decodeTelemetry = (message, offset) => {
+  if (message[offset] !== telemetryFrameVersion) return null
+  const view = new DataView(
+    message.buffer,
+    message.byteOffset + offset,
+    telemetryFrameSize
+  )
+  const flags = view.getUint8(1)
+  const frame = {
+    sequence: view.getUint16(2, true),
+    timestamp: flags & telemetryFlags.time ? view.getUint32(4, true) : null,
+  }
+  if (flags & telemetryFlags.fix) {
+    frame.location = [
+      view.getUint16(16, true) / 10, // speed
+      view.getInt32(8, true) / 1e6, // latitude
+      view.getInt32(12, true) / 1e6, // longitude
+      view.getInt16(20, true), // altitude
+      view.getUint16(18, true) / 10, // heading
+    ]
+  }
+  frame.battery = [
+    view.getUint16(22, true) / 1000, // voltage
+    view.getInt16(24, true) / 1000, // current
+    view.getUint16(26, true) / 1000, // power
+    view.getUint8(28), // battery
+  ]
+  if (flags & telemetryFlags.weather) {
+    const pressure = view.getUint16(31, true) / 10
+    frame.weather = [
+      view.getInt16(29, true) / 100, // temperature
+      pressure,
+      pressureToAltitude(pressure).toFixed(2),
+      view.getUint16(33, true) / 100, // humidity
+    ]
+  }
+  return frame
+}
+
+// a message carries one or more frames back to back, oldest first, when the
+// device flushes its store-and-forward backlog
+const decodeTelemetryFrames = message => {
+  const frames = []
+  if (message.length === 0 || message.length % telemetryFrameSize !== 0)
+    return frames
+  for (let i = 0; i < message.length; i += telemetryFrameSize) {
+    const frame = decodeTelemetry(message, i)
+    if (frame) frames.push(frame)
+  }
+  return frames
+}
+
+// must match embedded/main/include/power_stats.h
+const powerStatsVersion = 2
+const powerStatsSize = 37
+
+// the device samples the INA260 at about 1 kHz while awake and only sends
+// the aggregate since its previous summary
+const decodePowerStats = message => {
+  if (message.length !== powerStatsSize || message[0] !== powerStatsVersion)
+    return null
+  const view = new DataView(message.buffer, message.byteOffset, powerStatsSize)
+  const remaining = view.getUint16(35, true)
+  return {
+    sequence: view.getUint16(1, true),
+    sampled: view.getUint32(3, true) / 1000, // s
+    unsampled: view.getUint32(7, true) / 1000, // s, asleep
+    samples: view.getUint32(11, true),
+    voltage: [
+      view.getUint16(15, true) / 1000, // min
+      view.getUint16(17, true) / 1000, // mean
+      view.getUint16(19, true) / 1000, // max
+    ],
+    current: [
+      view.getInt16(21, true) / 1000, // min
+      view.getInt16(23, true) / 1000, // mean
+      view.getInt16(25, true) / 1000, // max
+    ],
+    charge: view.getUint32(27, true) / 1000, // mAh
+    energy: view.getUint32(31, true) / 1000, // mWh
+    // minutes at the recent average draw, from the device's charge estimate
+    remaining: remaining === 0xffff ? null : remaining,
+  }
+}
+
+// must match embedded/main/include/geofence.h
+const fenceAlertVersion = 1
+const fenceAlertSize = 14
+
+// the device sends one or more geofence breaches back to back, oldest first
+const decodeFenceAlerts = message => {
+  const alerts = []
+  if (message.length === 0 || message.length % fenceAlertSize !== 0)
+    return alerts
+  for (let i = 0; i < message.length; i += fenceAlertSize) {
+    if (message[i] !== fenceAlertVersion) return []
+    const view = new DataView(
+      message.buffer,
+      message.byteOffset + i,
+      fenceAlertSize
+    )
+    alerts.push({
+      id: view.getUint8(1),
+      timestamp: view.getUint32(2, true),
+      lat: view.getInt32(6, true) / 1e6,
+      lng: view.getInt32(10, true) / 1e6,
+    })
+  }
+  return alerts
+}
+
+// points kept for the path on the map
+const maxTrackPoints = 5000
+
 const pollingRate = 1 // times per minute
 
 const mqttOptions = {
@@ -42,6 +173,7 @@ class TheMap extends React.Component {
     super(props)
     this.state = {
       map: null,
+      path: null,
     }
   }
   componentDidUpdate(prevProps) {
@@ -50,6 +182,32 @@ class TheMap extends React.Component {
       (this.props.lat !== prevProps.lat || this.props.lgn !== prevProps.lgn)
     )
       this.state.map.setCenter({ lat: this.props.lat, lng: this.props.lgn })
+    if (
+      this.state.path !== null &&
+      (this.props.track !== prevProps.track ||
+        this.props.lat !== prevProps.lat ||
+        this.props.lgn !== prevProps.lgn)
+    )
+      this.updatePath()
+  }
+  updatePath() {
+    const path = this.props.track.map(point => ({
+      lat: point.lat,
+      lng: point.lng,
+    }))
+    // the newest fix comes with the telemetry, ahead of the kept points
+    if (this.props.lat !== -1 && path.length > 0)
+      path.push({ lat: this.props.lat, lng: this.props.lgn })
+    this.state.path.setPath(path)
+  }
+  apiLoaded(map, maps) {
+    this.state.map = map
+    this.state.path = new maps.Polyline({
+      map,
+      strokeColor: '#007bff',
+      strokeWeight: 3,
+    })
+    this.updatePath()
   }
   render() {
     const Marker = () => {
@@ -63,7 +221,7 @@ class TheMap extends React.Component {
         defaultCenter={{ lat: defaultLatitude, lng: defaultLongitude }}
         defaultZoom={defaultZoom}
         yesIWantToUseGoogleMapApiInternals
-        onGoogleApiLoaded={({ map }) => (this.state.map = map)}
+        onGoogleApiLoaded={({ map, maps }) => this.apiLoaded(map, maps)}
       >
         <Marker lat={this.props.lat} lng={this.props.lgn} />
       </GoogleMapReact>
@@ -78,6 +236,8 @@ class Controller extends React.Component {
       location: [-1, -1, -1, -1, -1],
       weather: [-1, -1, -1, -1],
       battery: [-1, -1, -1, -1],
+      track: [],
+      power: null,
       pollingInterval: null,
     }
   }
@@ -94,26 +254,37 @@ class Controller extends React.Component {
     })
     this.state.client.on('connect', () => {
       console.log('connected!')
-      this.state.client.subscribe(topics.location, err => {
-        if (!err) console.log('subscribed to location topic')
+      this.state.client.subscribe(topics.telemetry, err => {
+        if (!err) console.log('subscribed to telemetry topic')
         else
           toast.error(
-            `error connecting to location topic: ${JSON.stringify(err)}`
+            `error connecting to telemetry topic: ${JSON.stringify(err)}`
           )
       })
-      this.state.client.subscribe(topics.weather, err => {
-        if (!err) console.log('subscribed to weather topic')
+      this.state.client.subscribe(topics.track, err => {
+        if (!err) console.log('subscribed to track topic')
         else
-          toast.error(
-            `error connecting to weather topic: ${JSON.stringify(err)}`
-          )
+          toast.error(`error connecting to track topic: ${JSON.stringify(err)}`)
       })
-      this.state.client.subscribe(topics.battery, err => {
-        if (!err) console.log('subscribed to battery topic')
+      this.state.client.subscribe(topics.power, err => {
+        if (!err) console.log('subscribed to power topic')
         else
-          toast.error(
-            `error connecting to battery topic: ${JSON.stringify(err)}`
-          )
+          toast.error(`error connecting to power topic: ${JSON.stringify(err)}`)
+      })
+      this.state.client.subscribe(topics.alert, err => {
+        if (!err) console.log('subscribed to alert topic')
+        else
+          toast.error(`error connecting to alert topic: ${JSON.stringify(err)}`)
+      })
+      this.state.client.subscribe(topics.ack, err => {
+        if (!err) console.log('subscribed to ack topic')
+        else
+          toast.error(`error connecting to ack topic: ${JSON.stringify(err)}`)
+      })
+      this.state.client.subscribe(topics.health, err => {
+        if (!err) console.log('subscribed to health topic')
+        else
+          toast.error(`error connecting to health topic: ${JSON.stringify(err)}`)
       })
       this.state.client.subscribe(topics.error, err => {
         if (!err) console.log('subscribed to error topic')
@@ -123,32 +294,76 @@ class Controller extends React.Component {
     })
     this.state.client.on('message', (topic, message) => {
       // message is Buffer
-      const messageStr = message.toString()
-      console.log(`${topic}: ${messageStr}`)
       switch (topic) {
         case topics.error:
-          toast.error(messageStr)
+          toast.error(message.toString())
           break
-        case topics.location:
-          const locationData = messageStr.split(',')
-          this.setState({
-            location: locationData,
+        case topics.telemetry:
+          const frames = decodeTelemetryFrames(message)
+          if (frames.length === 0) {
+            console.log(`invalid telemetry message of ${message.length} bytes`)
+            break
+          }
+          // the table shows the newest reading of each kind
+          const update = {}
+          frames.forEach(frame => {
+            console.log(`telemetry #${frame.sequence}`)
+            update.battery = frame.battery
+            if (frame.location) update.location = frame.location
+            if (frame.weather) update.weather = frame.weather
           })
+          this.setState(update)
           break
-        case topics.weather:
-          const weatherData = messageStr.split(',')
-          this.setState({
-            weather: weatherData,
-          })
+        case topics.track:
+          // the device only sends the points needed to keep the path within
+          // its tolerance, so straight lines between them reconstruct the ride
+          let points
+          try {
+            points = decodeTrack(message)
+          } catch (err) {
+            console.log(`invalid track message: ${err.message}`)
+            break
+          }
+          this.setState(state => ({
+            track: state.track.concat(points).slice(-maxTrackPoints),
+          }))
           break
-        case topics.battery:
-          const batteryData = messageStr.split(',')
-          this.setState({
-            battery: batteryData,
+        case topics.alert:
+          const alerts = decodeFenceAlerts(message)
+          if (alerts.length === 0) {
+            console.log(`invalid alert message of ${message.length} bytes`)
+            break
+          }
+          alerts.forEach(alert => {
+            const time = new Date(alert.timestamp * 1000).toLocaleString()
+            const where = `${alert.lat}, ${alert.lng}`
+            toast.error(`left geofence ${alert.id} at ${where} (${time})`)
           })
           break
+        case topics.ack:
+          // one "<command> ok|invalid" line per command the device handled
+          message
+            .toString()
+            .split('\n')
+            .filter(line => line.length > 0)
+            .forEach(line => toast.info(`device: ${line}`))
+          break
+        case topics.health:
+          // "modem=ok data=retry 2 gnss=open 1 ...", sent when it changes
+          if (/=(retry|open|missing)/.test(message.toString()))
+            toast.warn(`device health: ${message.toString()}`)
+          else console.log(`device health: ${message.toString()}`)
+          break
+        case topics.power:
+          const power = decodePowerStats(message)
+          if (power === null) {
+            console.log(`invalid power message of ${message.length} bytes`)
+            break
+          }
+          this.setState({ power })
+          break
         default:
-          console.log(messageStr)
+          console.log(`${topic}: ${message.toString()}`)
           break
       }
     })
@@ -183,7 +398,11 @@ class Controller extends React.Component {
           pauseOnHover
         />
         <div style={{ height: '92.5vh', width: '100%' }}>
-          <TheMap lat={this.state.location[1]} lgn={this.state.location[2]} />
+          <TheMap
+            lat={this.state.location[1]}
+            lgn={this.state.location[2]}
+            track={this.state.track}
+          />
         </div>
         <table className="table table-hover table-dark">
           <tbody>
@@ -239,6 +458,33 @@ class Controller extends React.Component {
               <th scope="row">battery</th>
               <td>{this.state.battery[3]}%</td>
             </tr>
+            {this.state.power && (
+              <tr>
+                <th scope="row">current min / mean / max</th>
+                <td>
+                  {this.state.power.current.join(' / ')} A over{' '}
+                  {this.state.power.sampled} s awake
+                </td>
+              </tr>
+            )}
+            {this.state.power && this.state.power.remaining !== null && (
+              <tr>
+                <th scope="row">time remaining</th>
+                <td>
+                  {Math.floor(this.state.power.remaining / 60)} h{' '}
+                  {this.state.power.remaining % 60} min
+                </td>
+              </tr>
+            )}
+            {this.state.power && (
+              <tr>
+                <th scope="row">used while awake</th>
+                <td>
+                  {this.state.power.charge} mAh, {this.state.power.energy}{' '}
+                  mWh
+                </td>
+              </tr>
+            )}
           </tbody>
         </table>
       </div>
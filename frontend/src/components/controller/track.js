@@ -0,0 +1,54 @@
+// decoder for the batched track encoding,
+// must match embedded/main/include/track_codec.h
+const trackFormatVersion = 1
+
+// reads one unsigned LEB128 varint, at most 32 bits
+const readVarint = (bytes, state) => {
+  let value = 0
+  for (let shift = 0; shift < 35; shift += 7) {
+    if (state.offset >= bytes.length) throw new Error('truncated track')
+    const byte = bytes[state.offset++]
+    value += (byte & 0x7f) * Math.pow(2, shift)
+    if (!(byte & 0x80)) return value
+  }
+  throw new Error('varint too long')
+}
+
+const unzigzag = value =>
+  value % 2 === 0 ? value / 2 : -(value + 1) / 2
+
+// 32-bit wrapping add, as the device computes its deltas
+const add32 = (a, b) => (a + b) | 0
+
+// Decodes a track message into [{ lat, lng, altitude, timestamp }], oldest
+// first. Each point is stored as zigzag varint deltas of fixed-point
+// latitude, longitude, altitude and time from the previous one; the first
+// point is relative to zero. Throws on a malformed message.
+export const decodeTrack = message => {
+  const bytes = new Uint8Array(
+    message.buffer,
+    message.byteOffset,
+    message.length
+  )
+  if (bytes.length === 0 || bytes[0] !== trackFormatVersion)
+    throw new Error('unknown track format')
+  const state = { offset: 1 }
+  const points = []
+  let latitude = 0
+  let longitude = 0
+  let altitude = 0
+  let timestamp = 0
+  while (state.offset < bytes.length) {
+    latitude = add32(latitude, unzigzag(readVarint(bytes, state)))
+    longitude = add32(longitude, unzigzag(readVarint(bytes, state)))
+    altitude = add32(altitude, unzigzag(readVarint(bytes, state)))
+    timestamp = add32(timestamp, unzigzag(readVarint(bytes, state))) >>> 0
+    points.push({
+      lat: latitude / 1e6,
+      lng: longitude / 1e6,
+      altitude: altitude / 10,
+      timestamp,
+    })
+  }
+  return points
+}